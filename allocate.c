@@ -0,0 +1,345 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <limits.h> //for LONG_MAX
+#include "reliefdb.h"
+#include "search.h"
+#include "allocate.h"
+#include "memacct.h"
+
+#define INF LONG_MAX
+#define SOURCE 0
+#define SINK 1
+
+/*
+ The flow network for an allocation: a source feeding every candidate provider up to its stock,
+ provider-to-site edges costing the travel distance, and every site draining into the sink up
+ to its demand. Edges are stored in pairs, so edge e ^ 1 is the residual of e.
+*/
+typedef struct flownetwork {
+	long int nodes;
+	long int edges;
+	long int* head;
+	long int* next;
+	long int* to;
+	long int* cap;
+	long int* cost;
+	long int* potential;
+	long int* dist;
+	long int* level;
+	long int* arc;
+	long int* pathEdge;
+	long int* heapDist;
+	long int* heapNode;
+	long int heapSize;
+} fnet;
+
+static void addFlowEdge(fnet* net, long int from, long int to, long int cap, long int cost)
+{
+	net->to[net->edges] = to;
+	net->cap[net->edges] = cap;
+	net->cost[net->edges] = cost;
+	net->next[net->edges] = net->head[from];
+	net->head[from] = net->edges++;
+	
+	net->to[net->edges] = from;
+	net->cap[net->edges] = 0;
+	net->cost[net->edges] = -cost;
+	net->next[net->edges] = net->head[to];
+	net->head[to] = net->edges++;
+}
+
+/*
+ Pushes a (distance, node) pair onto the network's heap. Stale pairs are
+ skipped when popped rather than updated in place.
+*/
+static void flowPush(fnet* net, long int distance, long int node)
+{
+	long int slot = net->heapSize++;
+	long int parent;
+	
+	while(slot > 0 && net->heapDist[parent = (slot - 1) / 2] > distance) {
+		net->heapDist[slot] = net->heapDist[parent];
+		net->heapNode[slot] = net->heapNode[parent];
+		slot = parent;
+	}
+	net->heapDist[slot] = distance;
+	net->heapNode[slot] = node;
+}
+
+static long int flowPop(fnet* net)
+{
+	long int node = net->heapNode[0];
+	long int distance = net->heapDist[--net->heapSize];
+	long int last = net->heapNode[net->heapSize];
+	long int slot = 0;
+	long int child;
+	
+	while((child = slot * 2 + 1) < net->heapSize) {
+		if(child + 1 < net->heapSize && net->heapDist[child + 1] < net->heapDist[child]) child++;
+		if(net->heapDist[child] >= distance) break;
+		net->heapDist[slot] = net->heapDist[child];
+		net->heapNode[slot] = net->heapNode[child];
+		slot = child;
+	}
+	net->heapDist[slot] = distance;
+	net->heapNode[slot] = last;
+	
+	return node;
+}
+
+/*
+ Finds the cheapest distance from the source to every node using reduced costs, which the
+ potentials keep non-negative, then folds the distances into the potentials. Afterwards the
+ edges with zero reduced cost are exactly those on cheapest augmenting paths.
+ 
+ Returns 1 if the sink can still be reached, 0 if not.
+*/
+static int updatePotentials(fnet* net)
+{
+	long int node;
+	long int e;
+	long int reduced;
+	
+	for(node = 0; node < net->nodes; node++) net->dist[node] = INF;
+	net->dist[SOURCE] = 0;
+	net->heapSize = 0;
+	flowPush(net, 0, SOURCE);
+	
+	while(net->heapSize > 0) {
+		reduced = net->heapDist[0];
+		node = flowPop(net);
+		if(reduced > net->dist[node]) continue;
+		
+		for(e = net->head[node]; e != -1; e = net->next[e]) {
+			if(net->cap[e] == 0) continue;
+			reduced = net->dist[node] + net->cost[e] + net->potential[node] - net->potential[net->to[e]];
+			if(reduced < net->dist[net->to[e]]) {
+				net->dist[net->to[e]] = reduced;
+				flowPush(net, reduced, net->to[e]);
+			}
+		}
+	}
+	
+	if(net->dist[SINK] == INF) return 0;
+	
+	for(node = 0; node < net->nodes; node++) {
+		if(net->dist[node] != INF) net->potential[node] += net->dist[node];
+	}
+	return 1;
+}
+
+/*
+ Returns 1 if an edge has room and lies on a cheapest augmenting path.
+*/
+static int admissible(fnet* net, long int from, long int e)
+{
+	return net->cap[e] > 0 && net->cost[e] + net->potential[from] - net->potential[net->to[e]] == 0;
+}
+
+/*
+ Pushes as much flow as possible, up to limit, along cheapest augmenting paths only: levels
+ from a breadth first pass over the admissible edges keep the paths short and free of zero-cost
+ cycles, and each node's current arc means no edge is retried once it has been found useless.
+ This lets one shortest path pass serve many augmentations, instead of one each.
+ 
+ Returns the amount of flow pushed.
+*/
+static long int blockingFlow(fnet* net, long int limit)
+{
+	long int total = 0;
+	long int depth = 0;
+	long int node;
+	long int amount;
+	long int queueHead = 0;
+	long int queueTail = 0;
+	long int e;
+	long int x;
+	
+	// Level the admissible subgraph, using arc as the queue.
+	for(node = 0; node < net->nodes; node++) net->level[node] = -1;
+	net->level[SOURCE] = 0;
+	net->arc[queueTail++] = SOURCE;
+	while(queueHead < queueTail) {
+		node = net->arc[queueHead++];
+		for(e = net->head[node]; e != -1; e = net->next[e]) {
+			if(net->level[net->to[e]] != -1 || !admissible(net, node, e)) continue;
+			net->level[net->to[e]] = net->level[node] + 1;
+			net->arc[queueTail++] = net->to[e];
+		}
+	}
+	if(net->level[SINK] == -1) return 0;
+	
+	for(node = 0; node < net->nodes; node++) net->arc[node] = net->head[node];
+	node = SOURCE;
+	
+	while(total < limit) {
+		if(node == SINK) {
+			amount = limit - total;
+			for(x = 0; x < depth; x++) {
+				if(net->cap[net->pathEdge[x]] < amount) amount = net->cap[net->pathEdge[x]];
+			}
+			for(x = 0; x < depth; x++) {
+				net->cap[net->pathEdge[x]] -= amount;
+				net->cap[net->pathEdge[x] ^ 1] += amount;
+			}
+			total += amount;
+			depth = 0;
+			node = SOURCE;
+			continue;
+		}
+		
+		// Advance along the current arc if it still leads somewhere.
+		for(e = net->arc[node]; e != -1; e = net->next[e]) {
+			if(net->level[net->to[e]] == net->level[node] + 1 && admissible(net, node, e)) break;
+		}
+		net->arc[node] = e;
+		
+		if(e != -1) {
+			net->pathEdge[depth++] = e;
+			node = net->to[e];
+			continue;
+		}
+		
+		// Dead end: retreat and never come back here this phase.
+		if(node == SOURCE) break;
+		net->level[node] = -1;
+		node = net->to[net->pathEdge[--depth] ^ 1];
+		net->arc[node] = net->next[net->arc[node]];
+	}
+	
+	return total;
+}
+
+/*
+ Allocates one resource from providers with limited stock to sites with the given demands,
+ minimising the total of amount * distance (a transportation problem solved as min-cost flow by
+ the primal-dual method: a shortest path pass, then a blocking flow over the cheapest paths).
+ 
+ To keep the network sparse, each site is only connected to its nearest few (candidates)
+ providers with stock, found by one early-stopping backward search per site. A provider with no
+ stock level is treated as having as much as every site together demands. Sites are not counted
+ as providers for themselves.
+ 
+ Returns the new allocation; demand no candidate could serve is reported in unmet.
+*/
+alloc* allocateResource(cdb* db, qctx* ctx, char resource, long int* sites, long int* demand, long int count, long int candidates)
+{
+	sgraph* graph = db->graph;
+	alloc* plan = (alloc*)memAlloc(MEM_PATHS, sizeof(alloc));
+	int r = resourceIndex(resource);
+	long int* providerNode = (long int*)memAlloc(MEM_SCRATCH, sizeof(long int) * (graph->size + 1));
+	long int* providerCity = (long int*)memAlloc(MEM_SCRATCH, sizeof(long int) * (count * candidates + 1));
+	long int* candidateCity = (long int*)memAlloc(MEM_SCRATCH, sizeof(long int) * (count * candidates + 1));
+	long int* candidateDist = (long int*)memAlloc(MEM_SCRATCH, sizeof(long int) * (count * candidates + 1));
+	long int* candidateCount = (long int*)memCalloc(MEM_SCRATCH, count + 1, sizeof(long int));
+	long int providers = 0;
+	long int totalDemand = 0;
+	long int flow = 0;
+	long int city;
+	long int found;
+	long int amount;
+	long int node;
+	long int e;
+	long int s;
+	long int x;
+	fnet net;
+	
+	for(s = 0; s < count; s++) totalDemand += demand[s];
+	for(x = 0; x < graph->size; x++) providerNode[x] = -1;
+	
+	// Find each site's nearest providers that have stock.
+	for(s = 0; s < count; s++) {
+		found = 0;
+		searchBegin(ctx);
+		searchSeed(ctx, sites[s], 0);
+		while(found < candidates && (city = searchNext(ctx, graph, SEARCH_BACKWARD)) != -1) {
+			if(city == sites[s] || r == -1 || graph->cities[city]->stock[r] == 0) continue;
+			
+			candidateCity[s * candidates + found] = city;
+			candidateDist[s * candidates + found] = searchDistance(ctx, city);
+			found++;
+			
+			if(providerNode[city] == -1) {
+				providerNode[city] = 2 + providers;
+				providerCity[providers++] = city;
+			}
+		}
+		candidateCount[s] = found;
+	}
+	
+	// Build the network: source, sink, providers, then sites.
+	net.nodes = 2 + providers + count;
+	net.edges = 0;
+	e = 2 * (providers + count + count * candidates) + 2;
+	net.head = (long int*)memAlloc(MEM_SCRATCH, sizeof(long int) * net.nodes);
+	net.next = (long int*)memAlloc(MEM_SCRATCH, sizeof(long int) * e);
+	net.to = (long int*)memAlloc(MEM_SCRATCH, sizeof(long int) * e);
+	net.cap = (long int*)memAlloc(MEM_SCRATCH, sizeof(long int) * e);
+	net.cost = (long int*)memAlloc(MEM_SCRATCH, sizeof(long int) * e);
+	net.potential = (long int*)memCalloc(MEM_SCRATCH, net.nodes, sizeof(long int));
+	net.dist = (long int*)memAlloc(MEM_SCRATCH, sizeof(long int) * net.nodes);
+	net.level = (long int*)memAlloc(MEM_SCRATCH, sizeof(long int) * net.nodes);
+	net.arc = (long int*)memAlloc(MEM_SCRATCH, sizeof(long int) * net.nodes);
+	net.pathEdge = (long int*)memAlloc(MEM_SCRATCH, sizeof(long int) * net.nodes);
+	net.heapDist = (long int*)memAlloc(MEM_SCRATCH, sizeof(long int) * e);
+	net.heapNode = (long int*)memAlloc(MEM_SCRATCH, sizeof(long int) * e);
+	for(node = 0; node < net.nodes; node++) net.head[node] = -1;
+	
+	for(x = 0; x < providers; x++) {
+		amount = graph->cities[providerCity[x]]->stock[r];
+		addFlowEdge(&net, SOURCE, 2 + x, amount == STOCK_UNLIMITED ? totalDemand : amount, 0);
+	}
+	for(s = 0; s < count; s++) {
+		for(x = 0; x < candidateCount[s]; x++) {
+			addFlowEdge(&net, providerNode[candidateCity[s * candidates + x]], 2 + providers + s, totalDemand, candidateDist[s * candidates + x]);
+		}
+		addFlowEdge(&net, 2 + providers + s, SINK, demand[s], 0);
+	}
+	
+	// Augment along cheapest paths, a whole cost level at a time, until every demand is met or nothing more can move.
+	while(flow < totalDemand && updatePotentials(&net)) {
+		flow += blockingFlow(&net, totalDemand - flow);
+	}
+	
+	// Every provider-to-site edge carrying flow is an assignment; its residual holds the amount.
+	plan->count = 0;
+	plan->unmet = totalDemand - flow;
+	plan->totalCost = 0;
+	plan->assigned = (asgn*)memAlloc(MEM_PATHS, sizeof(asgn) * (count * candidates + 1));
+	for(e = 2 * providers; e < net.edges; e += 2) {
+		if(net.to[e] == SINK || net.cap[e ^ 1] == 0) continue;
+		plan->assigned[plan->count].provider = providerCity[net.to[e ^ 1] - 2];
+		plan->assigned[plan->count].site = sites[net.to[e] - 2 - providers];
+		plan->assigned[plan->count].amount = net.cap[e ^ 1];
+		plan->assigned[plan->count].distance = net.cost[e];
+		plan->totalCost += net.cap[e ^ 1] * net.cost[e];
+		plan->count++;
+	}
+	
+	memFree(net.head);
+	memFree(net.next);
+	memFree(net.to);
+	memFree(net.cap);
+	memFree(net.cost);
+	memFree(net.potential);
+	memFree(net.dist);
+	memFree(net.level);
+	memFree(net.arc);
+	memFree(net.pathEdge);
+	memFree(net.heapDist);
+	memFree(net.heapNode);
+	memFree(providerNode);
+	memFree(providerCity);
+	memFree(candidateCity);
+	memFree(candidateDist);
+	memFree(candidateCount);
+	
+	return plan;
+}
+
+void purgeAllocation(alloc* plan)
+{
+	if(plan == NULL) return;
+	memFree(plan->assigned);
+	memFree(plan);
+}
@@ -0,0 +1,35 @@
+#include "reliefdb.h"
+#include "search.h"
+
+#ifndef allocate_h
+#define allocate_h
+
+/*
+ An assignment sends an amount of a resource from one provider to one site.
+ Cities are given by their search graph index.
+*/
+typedef struct assignment {
+	long int provider;
+	long int site;
+	long int amount;
+	long int distance;
+} asgn;
+
+/*
+ An allocation is the solved plan for one resource across many sites.
+ 
+ - count is the number of assignments.
+ - unmet is the total demand no candidate provider could serve.
+ - totalCost is the sum of amount * distance over every assignment.
+*/
+typedef struct allocation {
+	long int count;
+	asgn* assigned;
+	long int unmet;
+	long int totalCost;
+} alloc;
+
+alloc* allocateResource(cdb* db, qctx* ctx, char resource, long int* sites, long int* demand, long int count, long int candidates);
+void purgeAllocation(alloc* plan);
+
+#endif
@@ -0,0 +1,274 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <limits.h> //for LONG_MAX
+#include "reliefdb.h"
+#include "search.h"
+#include "coverage.h"
+#include "memacct.h"
+
+/*
+ The gain of placing a depot at a candidate city: how many cities it would bring within reach
+ of the resource for the first time, then how many hours it would take off the total distance.
+ id is the candidate's city ID, which breaks ties. round is the number of depots placed when it
+ was worked out.
+*/
+typedef struct depotgain {
+	long int city;
+	long int id;
+	long int reached;
+	long int saved;
+	long int round;
+} dgain;
+
+/*
+ Returns 1 if one gain is better than another, 0 if not.
+*/
+static int betterGain(dgain* a, dgain* b)
+{
+	if(a->reached != b->reached) return a->reached > b->reached;
+	if(a->saved != b->saved) return a->saved > b->saved;
+	return a->id < b->id;
+}
+
+/*
+ Compares two city indexes by how badly they are served, worst first, then by city ID so the
+ order does not depend on how the graph is ordered.
+*/
+static dist_t* sortServed;
+static sgraph* sortGraph;
+static int compareServed(const void* a, const void* b)
+{
+	long int x = *(const long int*)a;
+	long int y = *(const long int*)b;
+	if(sortServed[x] != sortServed[y]) return (sortServed[x] < sortServed[y]) - (sortServed[x] > sortServed[y]);
+	return (sortGraph->cities[x]->id > sortGraph->cities[y]->id) - (sortGraph->cities[x]->id < sortGraph->cities[y]->id);
+}
+
+/*
+ Creates an empty coverage for a graph of the given size, to be filled by measureCoverage.
+*/
+cover* newCoverage(long int size)
+{
+	cover* coverage = (cover*)memAlloc(MEM_PATHS, sizeof(cover));
+	
+	coverage->resource = '\0';
+	coverage->size = size;
+	coverage->served = (dist_t*)memAlloc(MEM_PATHS, sizeof(dist_t) * (size + 1));
+	coverage->providers = 0;
+	coverage->unreached = size;
+	coverage->total = 0;
+	coverage->worst = 0;
+	
+	return coverage;
+}
+
+/*
+ Works out the unreached count, total and worst distance from served.
+*/
+static void summarise(cover* coverage)
+{
+	long int city;
+	
+	coverage->unreached = 0;
+	coverage->total = 0;
+	coverage->worst = 0;
+	for(city = 0; city < coverage->size; city++) {
+		if(coverage->served[city] == DIST_INF) coverage->unreached++;
+		else {
+			coverage->total += coverage->served[city];
+			if(coverage->served[city] > coverage->worst) coverage->worst = coverage->served[city];
+		}
+	}
+}
+
+/*
+ Measures how well a resource serves every city of a graph, with one search forward from all of
+ its providers at once.
+*/
+void measureCoverage(cover* coverage, sgraph* graph, qctx* ctx, char resource)
+{
+	unsigned char wanted = 1 << resourceIndex(resource);
+	long int city;
+	
+	coverage->resource = resource;
+	coverage->providers = 0;
+	
+	searchBegin(ctx);
+	for(city = 0; city < graph->size; city++) {
+		if(!(graph->resources[city] & wanted)) continue;
+		searchSeed(ctx, city, 0);
+		coverage->providers++;
+	}
+	while(searchNext(ctx, graph, SEARCH_FORWARD) != -1);
+	
+	for(city = 0; city < graph->size; city++) coverage->served[city] = distClamp(searchDistance(ctx, city));
+	summarise(coverage);
+}
+
+/*
+ Writes the indexes of the n worst served cities into cities, those no provider can reach first,
+ then the furthest from one, and by city ID among cities served equally.
+ 
+ Returns the number of cities written.
+*/
+long int worstServed(cover* coverage, sgraph* graph, long int* cities, long int n)
+{
+	long int* order = (long int*)memAlloc(MEM_SCRATCH, sizeof(long int) * (coverage->size + 1));
+	long int city;
+	
+	for(city = 0; city < coverage->size; city++) order[city] = city;
+	sortServed = coverage->served;
+	sortGraph = graph;
+	qsort(order, coverage->size, sizeof(long int), compareServed);
+	
+	if(n > coverage->size) n = coverage->size;
+	for(city = 0; city < n; city++) cities[city] = order[city];
+	memFree(order);
+	
+	return n;
+}
+
+/*
+ Returns the index of the worst served city, as worstServed orders them.
+*/
+static long int worstCity(cover* coverage, sgraph* graph)
+{
+	long int worst = 0;
+	long int city;
+	
+	for(city = 1; city < coverage->size; city++) {
+		if(coverage->served[city] > coverage->served[worst]
+		   || (coverage->served[city] == coverage->served[worst] && graph->cities[city]->id < graph->cities[worst]->id)) worst = city;
+	}
+	
+	return worst;
+}
+
+/*
+ Searches forward from a candidate depot through the cities it would serve better than they are
+ served now, and nowhere else: a city that is no nearer to the depot than to a provider only
+ leads to cities that are not either, so the search stops there. Evaluating a candidate therefore
+ costs only the region it would improve. The gain is written to gain, and with apply set the
+ cities are moved over to the depot.
+*/
+static void improveFrom(cover* coverage, sgraph* graph, qctx* ctx, long int site, int apply, dgain* gain)
+{
+	sedges* edges = ctx->edges;
+	dist_t* served = coverage->served;
+	dist_t distance;
+	dist_t next;
+	long int city;
+	long int e;
+	
+	gain->city = site;
+	gain->id = graph->cities[site]->id;
+	gain->reached = 0;
+	gain->saved = 0;
+	if(served[site] == 0) return;
+	
+	searchBegin(ctx);
+	searchSeed(ctx, site, 0);
+	
+	while((city = searchSettle(ctx)) != -1) {
+		distance = ctx->dist[city];
+		if(served[city] == DIST_INF) {
+			gain->reached++;
+			gain->saved -= distance;
+		}
+		else gain->saved += served[city] - distance;
+		if(apply) served[city] = distance;
+		
+		searchEdges(graph, city, SEARCH_FORWARD, 0, edges);
+		for(e = 0; e < edges->count; e++) {
+			next = distAdd(distance, edges->dist[e]);
+			if(next < served[edges->to[e]]) searchRelax(ctx, city, edges->to[e], next);
+		}
+	}
+}
+
+/*
+ Moves a gain down a max heap of gains from the given slot.
+*/
+static void gainDown(dgain* heap, long int size, long int slot)
+{
+	long int child;
+	dgain item = heap[slot];
+	
+	while((child = 2 * slot + 1) < size) {
+		if(child + 1 < size && betterGain(&heap[child + 1], &heap[child])) child++;
+		if(!betterGain(&heap[child], &item)) break;
+		heap[slot] = heap[child];
+		slot = child;
+	}
+	heap[slot] = item;
+}
+
+/*
+ Proposes up to k cities for new depots of the coverage's resource, one at a time, and moves the
+ coverage over to them. served must be up to date with measureCoverage.
+ 
+ For PLACE_MEDIAN each depot goes where it brings the most cities within reach, then takes the
+ most hours off the total distance: greedy k-median with lazy evaluation. A depot's gain can only
+ shrink as others are placed, so candidates wait in a heap under the gain last worked out for
+ them and only the one on top is worked out again; it is placed if it stays on top. For
+ PLACE_CENTER each depot goes to the worst served city (farthest first k-center).
+ 
+ Either way placing a depot only searches the cities it improves (see improveFrom).
+ 
+ Returns the number of depots placed; fewer than k once no depot would improve anything.
+*/
+long int placeDepots(cover* coverage, sgraph* graph, qctx* ctx, long int k, int objective, long int* sites)
+{
+	dgain* heap;
+	dgain gain;
+	long int placed = 0;
+	long int size = 0;
+	long int city;
+	
+	if(objective == PLACE_CENTER) {
+		while(placed < k && coverage->size > 0 && coverage->served[city = worstCity(coverage, graph)] != 0) {
+			improveFrom(coverage, graph, ctx, city, 1, &gain);
+			sites[placed++] = city;
+			coverage->providers++;
+		}
+		summarise(coverage);
+		return placed;
+	}
+	
+	// Every city that is not already a provider starts out with its gain worked out once.
+	heap = (dgain*)memAlloc(MEM_SCRATCH, sizeof(dgain) * (graph->size + 1));
+	for(city = 0; city < graph->size; city++) {
+		if(coverage->served[city] == 0) continue;
+		improveFrom(coverage, graph, ctx, city, 0, &heap[size]);
+		heap[size++].round = 0;
+	}
+	for(city = size / 2 - 1; city >= 0; city--) gainDown(heap, size, city);
+	
+	while(placed < k && size > 0) {
+		if(heap[0].round != placed) {
+			improveFrom(coverage, graph, ctx, heap[0].city, 0, &heap[0]);
+			heap[0].round = placed;
+			gainDown(heap, size, 0);
+			continue;
+		}
+		if(heap[0].reached == 0 && heap[0].saved <= 0) break;
+		
+		improveFrom(coverage, graph, ctx, heap[0].city, 1, &gain);
+		sites[placed++] = heap[0].city;
+		coverage->providers++;
+		heap[0] = heap[--size];
+		gainDown(heap, size, 0);
+	}
+	
+	memFree(heap);
+	summarise(coverage);
+	
+	return placed;
+}
+
+void purgeCoverage(cover* coverage)
+{
+	if(coverage == NULL) return;
+	memFree(coverage->served);
+	memFree(coverage);
+}
@@ -0,0 +1,39 @@
+#include "reliefdb.h"
+#include "search.h"
+#include "dist.h"
+
+#ifndef coverage_h
+#define coverage_h
+
+#define PLACE_MEDIAN 0	// Place depots to bring the average distance down most.
+#define PLACE_CENTER 1	// Place depots to bring the longest distance down most.
+
+/*
+ A coverage holds how well one resource serves every city: the distance
+ from the nearest provider of it to each city, as one multi-source search
+ from every provider finds it.
+ 
+ - resource is the resource letter.
+ - served holds the distance for each city index, DIST_INF where no provider
+   can reach the city.
+ - providers counts the providers (and depots placed with placeDepots).
+ - unreached counts the cities no provider can reach; total and worst are
+   the sum and the largest of the distances to every other city.
+*/
+typedef struct coverage {
+	char resource;
+	long int size;
+	dist_t* served;
+	long int providers;
+	long int unreached;
+	long int total;
+	long int worst;
+} cover;
+
+cover* newCoverage(long int size);
+void measureCoverage(cover* coverage, sgraph* graph, qctx* ctx, char resource);
+long int worstServed(cover* coverage, sgraph* graph, long int* cities, long int n);
+long int placeDepots(cover* coverage, sgraph* graph, qctx* ctx, long int k, int objective, long int* sites);
+void purgeCoverage(cover* coverage);
+
+#endif
@@ -0,0 +1,198 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "reliefdb.h"
+#include "objects.h"
+#include "search.h"
+#include "skipdict.h"
+#include "strlib.h"
+#include "dbfile.h"
+#include "memacct.h"
+
+/*
+ Returns 1 if a file starts like a binary database file, 0 if not (a text database). The file is
+ left at its start either way.
+*/
+int isDatabaseFile(FILE* file)
+{
+	char magic[8];
+	int binary = fread(magic, 1, sizeof(magic), file) == sizeof(magic) && !memcmp(magic, DB_MAGIC, sizeof(magic));
+	
+	rewind(file);
+	
+	return binary;
+}
+
+/*
+ Returns the resources string a city is written with: its entry in stock, by index, if it has one.
+*/
+static char* stockOf(cn* city, cn** stock)
+{
+	return stock != NULL && stock[city->index] != NULL ? stock[city->index]->resources : city->resources;
+}
+
+/*
+ Writes a database, with the road edits in force (by city ID), to a binary database file. Cities
+ with an entry in stock (by index, as copySearchGraph takes it) are written with its resources; stock
+ may be NULL. The file is written beside its final name, flushed to disk and then renamed over it,
+ so a crash leaves either the old file or the new one whole.
+ 
+ Returns 1 on success, 0 if the file cannot be written.
+*/
+int saveDatabaseFile(cdb* db, cn** stock, redit* edits, long int count, char* filename)
+{
+	char* temporary = (char*)memAlloc(MEM_SCRATCH, lengthof(filename) + 5);
+	dbheader header;
+	FILE* file;
+	cdbn* node;
+	char* resources;
+	int64_t value;
+	int64_t at;
+	long int x;
+	int ok;
+	
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, DB_MAGIC, sizeof(header.magic));
+	for(node = db->chead; node != NULL; node = node->next) {
+		header.cities++;
+		header.roads += node->cur->ttsize;
+		header.textBytes += lengthof(node->cur->name) + lengthof(stockOf(node->cur, stock)) + 2;
+	}
+	header.edits = count;
+	
+	sprintf(temporary, "%s.tmp", filename);
+	if((file = fopen(temporary, "wb")) == NULL) {
+		memFree(temporary);
+		return 0;
+	}
+	ok = fwrite(&header, sizeof(header), 1, file) == 1;
+	
+	for(node = db->chead; node != NULL; node = node->next) ok &= fwrite(&node->cur->id, sizeof(int64_t), 1, file) == 1;
+	for(node = db->chead, at = 0; node != NULL; at += node->cur->ttsize, node = node->next) ok &= fwrite(&at, sizeof(int64_t), 1, file) == 1;
+	ok &= fwrite(&at, sizeof(int64_t), 1, file) == 1;
+	for(node = db->chead, at = 0; node != NULL; at += lengthof(node->cur->name) + lengthof(stockOf(node->cur, stock)) + 2, node = node->next) ok &= fwrite(&at, sizeof(int64_t), 1, file) == 1;
+	for(node = db->chead, at = 0; node != NULL; at += lengthof(node->cur->name) + lengthof(stockOf(node->cur, stock)) + 2, node = node->next) {
+		value = at + lengthof(node->cur->name) + 1;
+		ok &= fwrite(&value, sizeof(int64_t), 1, file) == 1;
+	}
+	
+	for(node = db->chead; node != NULL; node = node->next) {
+		for(x = 0; x < node->cur->ttsize; x++) ok &= fwrite(&node->cur->goes_to[x]->cityid, sizeof(int64_t), 1, file) == 1;
+	}
+	for(node = db->chead; node != NULL; node = node->next) {
+		for(x = 0; x < node->cur->ttsize; x++) ok &= fwrite(&node->cur->goes_to[x]->distance, sizeof(int64_t), 1, file) == 1;
+	}
+	for(node = db->chead; node != NULL; node = node->next) {
+		for(x = 0; x < node->cur->ttsize; x++) ok &= fwrite(&node->cur->goes_to[x]->risk, sizeof(int64_t), 1, file) == 1;
+	}
+	
+	for(x = 0; x < count; x++) {
+		ok &= fwrite(&edits[x].from, sizeof(int64_t), 1, file) == 1;
+		ok &= fwrite(&edits[x].to, sizeof(int64_t), 1, file) == 1;
+		ok &= fwrite(&edits[x].distance, sizeof(int64_t), 1, file) == 1;
+		value = edits[x].closed;
+		ok &= fwrite(&value, sizeof(int64_t), 1, file) == 1;
+	}
+	
+	for(node = db->chead; node != NULL; node = node->next) {
+		ok &= fwrite(node->cur->name, 1, lengthof(node->cur->name) + 1, file) == (size_t)lengthof(node->cur->name) + 1;
+		resources = stockOf(node->cur, stock);
+		ok &= fwrite(resources, 1, lengthof(resources) + 1, file) == (size_t)lengthof(resources) + 1;
+	}
+	
+	ok &= fflush(file) == 0 && fsync(fileno(file)) == 0;
+	ok &= fclose(file) == 0;
+	ok = ok && rename(temporary, filename) == 0;
+	if(!ok) remove(temporary);
+	memFree(temporary);
+	
+	return ok;
+}
+
+/*
+ Loads a binary database file written by saveDatabaseFile into a new database, adding every
+ city to the names dictionary. Cities are stored in database order, so each is added at the end
+ of the database's list without searching it. The road edits, by city ID, are handed back through edits and count, for
+ the caller to free.
+ 
+ Returns the database, not yet linked, or NULL if the file is not a whole binary database.
+*/
+cdb* loadDatabaseFile(FILE* file, skipDict* names, redit** edits, long int* count)
+{
+	dbheader header;
+	int64_t* block;
+	int64_t* ids;
+	int64_t* roadStart;
+	int64_t* nameAt;
+	int64_t* resourcesAt;
+	int64_t* roadTo;
+	int64_t* roadDist;
+	int64_t* roadRisk;
+	int64_t* edit;
+	char* text;
+	long int words;
+	long int x;
+	long int y;
+	cdb* db;
+	cdbn* last = NULL;
+	cn* city;
+	
+	if(fread(&header, sizeof(header), 1, file) != 1 || memcmp(header.magic, DB_MAGIC, sizeof(header.magic))) return NULL;
+	if(header.cities < 0 || header.roads < 0 || header.edits < 0 || header.textBytes < 0) return NULL;
+	
+	words = 4 * header.cities + 1 + 3 * header.roads + 4 * header.edits;
+	block = (int64_t*)memAlloc(MEM_SCRATCH, sizeof(int64_t) * words + header.textBytes + 1);
+	if(fread(block, 1, sizeof(int64_t) * words + header.textBytes, file) != sizeof(int64_t) * words + header.textBytes || fgetc(file) != EOF) {
+		memFree(block);
+		return NULL;
+	}
+	ids = block;
+	roadStart = ids + header.cities;
+	nameAt = roadStart + header.cities + 1;
+	resourcesAt = nameAt + header.cities;
+	roadTo = resourcesAt + header.cities;
+	roadDist = roadTo + header.roads;
+	roadRisk = roadDist + header.roads;
+	edit = roadRisk + header.roads;
+	text = (char*)(edit + 4 * header.edits);
+	text[header.textBytes] = '\0';
+	
+	// Travel tables must follow on from each other and strings stay inside the text.
+	for(x = 0; x < header.cities; x++) {
+		if(roadStart[x] < 0 || roadStart[x] > roadStart[x + 1]) break;
+		if(nameAt[x] < 0 || nameAt[x] >= header.textBytes || resourcesAt[x] < 0 || resourcesAt[x] >= header.textBytes) break;
+	}
+	if(x < header.cities || roadStart[0] != 0 || roadStart[header.cities] != header.roads) {
+		memFree(block);
+		return NULL;
+	}
+	
+	db = newCDB("DefaultName");
+	db->ctsize = header.cities;
+	for(x = 0; x < header.cities; x++) {
+		city = newCNode(ids[x], text + nameAt[x], text + resourcesAt[x]);
+		city->ttsize = roadStart[x + 1] - roadStart[x];
+		city->goes_to = city->ttsize == 0 ? NULL : (tt**)memAlloc(MEM_GRAPH, sizeof(tt*) * city->ttsize);
+		for(y = 0; y < city->ttsize; y++) {
+			city->goes_to[y] = newTTable(roadTo[roadStart[x] + y], roadDist[roadStart[x] + y]);
+			city->goes_to[y]->risk = roadRisk[roadStart[x] + y];
+		}
+		
+		if(last == NULL) db->chead = last = newCDBNode(db, city, NULL, NULL);
+		else last = last->next = newCDBNode(db, city, last, NULL);
+		addSkipEntry(names, city->name, city);
+	}
+	
+	*count = header.edits;
+	*edits = (redit*)memAlloc(MEM_GRAPH, sizeof(redit) * (header.edits + 1));
+	for(x = 0; x < header.edits; x++) {
+		(*edits)[x].from = edit[4 * x];
+		(*edits)[x].to = edit[4 * x + 1];
+		(*edits)[x].distance = edit[4 * x + 2];
+		(*edits)[x].closed = edit[4 * x + 3] != 0;
+	}
+	memFree(block);
+	
+	return db;
+}
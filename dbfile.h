@@ -0,0 +1,36 @@
+#include <stdio.h>
+#include <stdint.h>
+#include "reliefdb.h"
+#include "search.h"
+#include "skipdict.h"
+
+#ifndef dbfile_h
+#define dbfile_h
+
+#define DB_MAGIC "RRELIEF1"		// First bytes of every binary database file.
+
+/*
+ The fixed-size start of a binary database file. Counts are in records.
+ 
+ A binary database file holds everything the text database does, plus the
+ road edits in force when it was written, so it loads without any parsing.
+ After the header come, as 8 byte integers, the ID of every city in database
+ order, where each city's travel tables start (cities + 1 of them) and where its
+ name and resources start in the text; then the far end (by ID), distance and
+ risk of every travel table; then four per road edit: the IDs of the cities
+ it leaves and arrives at, its distance (-1 to keep the travel tables') and 1
+ if it is closed. Last is the text, each string ending in a zero byte.
+*/
+typedef struct dbheader {
+	char magic[8];
+	int64_t cities;
+	int64_t roads;
+	int64_t edits;
+	int64_t textBytes;
+} dbheader;
+
+int isDatabaseFile(FILE* file);
+int saveDatabaseFile(cdb* db, cn** stock, redit* edits, long int count, char* filename);
+cdb* loadDatabaseFile(FILE* file, skipDict* names, redit** edits, long int* count);
+
+#endif
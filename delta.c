@@ -0,0 +1,312 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h> //for LONG_MAX
+#include <pthread.h>
+#include <stdatomic.h>
+#include "reliefdb.h"
+#include "search.h"
+#include "delta.h"
+#include "memacct.h"
+#include "stats.h"
+
+#define JOB_RESET 0		// Set every distance to DIST_INF and every queued flag to 0.
+#define JOB_SPLIT 1		// Move the pending cities in the current bucket to the frontier.
+#define JOB_SHORT 2		// Relax the short edges (delta or less) of the frontier.
+#define JOB_LONG 3		// Relax the long edges of every city settled in the current bucket.
+#define JOB_STOP 4		// Stop the workers.
+
+#define CHUNK 64		// Cities handed to a thread at a time.
+#define BATCH 256		// Cities a thread gathers before appending them to a shared list.
+
+/*
+ What each thread is started with, and where it reads each city's edges. The caller's
+ share of every job uses the first.
+*/
+typedef struct deltawork {
+	dstep* ds;
+	int id;
+	sedges* edges;
+} dwork;
+
+/*
+ Cities gathered by one thread for one shared list, appended in one go.
+*/
+typedef struct batch {
+	slist* list;
+	int count;
+	long int items[BATCH];
+} batch;
+
+static void flushBatch(batch* b)
+{
+	long int at;
+	
+	if(b->count == 0) return;
+	at = atomic_fetch_add_explicit(&b->list->count, b->count, memory_order_relaxed);
+	memcpy(b->list->items + at, b->items, sizeof(long int) * b->count);
+	b->count = 0;
+}
+
+static void pushBatch(batch* b, long int city)
+{
+	b->items[b->count++] = city;
+	if(b->count == BATCH) flushBatch(b);
+}
+
+/*
+ Lowers a city's distance if the new one is shorter, queuing the city unless it is queued
+ already. Any number of threads may relax the same city at once.
+*/
+static void relax(dstep* ds, long int city, dist_t distance, batch* out, long int* lowest)
+{
+	dist_t old = atomic_load_explicit(&ds->dist[city], memory_order_relaxed);
+	
+	while(distance < old) {
+		if(atomic_compare_exchange_weak_explicit(&ds->dist[city], &old, distance, memory_order_relaxed, memory_order_relaxed)) {
+			if(distance / ds->delta < *lowest) *lowest = distance / ds->delta;
+			if(!atomic_exchange_explicit(&ds->queued[city], 1, memory_order_relaxed)) pushBatch(out, city);
+			return;
+		}
+	}
+}
+
+/*
+ Does one thread's share of the current job, taking cities from a list CHUNK at a time until
+ the list is used up.
+*/
+static void runStep(dstep* ds, int id)
+{
+	sgraph* graph = ds->graph;
+	sedges* edges = ds->work[id].edges;
+	long int lowest = ds->job == JOB_SPLIT ? LONG_MAX : ds->lowest[id];
+	long int total;
+	long int* items;
+	long int from;
+	long int x;
+	long int e;
+	long int city;
+	dist_t distance;
+	batch next;
+	batch frontier;
+	batch settled;
+	
+	next.list = ds->next;
+	next.count = 0;
+	frontier.list = &ds->frontier;
+	frontier.count = 0;
+	settled.list = &ds->settled;
+	settled.count = 0;
+	
+	switch(ds->job) {
+		case JOB_RESET: total = graph->size; items = NULL; break;
+		case JOB_SPLIT: total = atomic_load_explicit(&ds->pending->count, memory_order_relaxed); items = ds->pending->items; break;
+		case JOB_SHORT: total = atomic_load_explicit(&ds->frontier.count, memory_order_relaxed); items = ds->frontier.items; break;
+		default: total = atomic_load_explicit(&ds->settled.count, memory_order_relaxed); items = ds->settled.items; break;
+	}
+	
+	while((from = atomic_fetch_add_explicit(&ds->cursor, CHUNK, memory_order_relaxed)) < total) {
+		for(x = from; x < from + CHUNK && x < total; x++) {
+			if(ds->job == JOB_RESET) {
+				atomic_store_explicit(&ds->dist[x], DIST_INF, memory_order_relaxed);
+				atomic_store_explicit(&ds->queued[x], 0, memory_order_relaxed);
+				continue;
+			}
+			
+			city = items[x];
+			distance = atomic_load_explicit(&ds->dist[city], memory_order_relaxed);
+			
+			if(ds->job == JOB_SPLIT) {
+				if(distance / ds->delta != ds->bucket) {
+					if(distance / ds->delta < lowest) lowest = distance / ds->delta;
+					pushBatch(&next, city);
+					continue;
+				}
+				atomic_store_explicit(&ds->queued[city], 0, memory_order_relaxed);
+				pushBatch(&frontier, city);
+				// Only the thread that took the city from pending can mark it.
+				if(ds->settledMark[city] != ds->epoch) {
+					ds->settledMark[city] = ds->epoch;
+					pushBatch(&settled, city);
+				}
+				continue;
+			}
+			
+			searchEdges(graph, city, ds->direction, 0, edges);
+			for(e = 0; e < edges->count; e++) {
+				if((edges->dist[e] <= ds->delta) == (ds->job == JOB_SHORT)) relax(ds, edges->to[e], distAdd(distance, edges->dist[e]), &next, &lowest);
+			}
+		}
+	}
+	
+	flushBatch(&next);
+	flushBatch(&frontier);
+	flushBatch(&settled);
+	ds->lowest[id] = lowest;
+}
+
+/*
+ Runs a job on every thread, the caller included, and returns once all of them have finished.
+*/
+static void runJob(dstep* ds, int job)
+{
+	ds->job = job;
+	atomic_store_explicit(&ds->cursor, 0, memory_order_relaxed);
+	if(ds->threads > 1) pthread_barrier_wait(&ds->start);
+	if(job != JOB_STOP) runStep(ds, 0);
+	if(ds->threads > 1 && job != JOB_STOP) pthread_barrier_wait(&ds->finish);
+}
+
+static void* deltaWorker(void* arg)
+{
+	dwork* work = (dwork*)arg;
+	dstep* ds = work->ds;
+	
+	for(;;) {
+		pthread_barrier_wait(&ds->start);
+		if(ds->job == JOB_STOP) return NULL;
+		runStep(ds, work->id);
+		pthread_barrier_wait(&ds->finish);
+	}
+}
+
+/*
+ Creates a delta stepper for a graph, searching on the given number of threads (the caller
+ and threads - 1 workers) with buckets delta hours wide. A delta of 0 picks one from the
+ graph: a quarter of the longest travel table.
+*/
+dstep* newDeltaStepper(sgraph* graph, int threads, long int delta)
+{
+	dstep* ds = (dstep*)memAlloc(MEM_SCRATCH, sizeof(dstep));
+	long int size = graph->size;
+	int x;
+	
+	if(threads < 1) threads = 1;
+	if(threads > MAX_DELTA_THREADS) threads = MAX_DELTA_THREADS;
+	if(delta <= 0) delta = graph->maxWeight / 4;
+	if(delta <= 0) delta = 1;
+	
+	ds->graph = graph;
+	ds->threads = threads;
+	ds->delta = delta;
+	ds->direction = SEARCH_FORWARD;
+	ds->job = JOB_RESET;
+	ds->bucket = 0;
+	ds->epoch = 0;
+	ds->dist = (_Atomic dist_t*)memAlloc(MEM_SCRATCH, sizeof(dist_t) * (size + 1));
+	ds->queued = (atomic_char*)memAlloc(MEM_SCRATCH, sizeof(atomic_char) * (size + 1));
+	ds->settledMark = (unsigned int*)memCalloc(MEM_SCRATCH, size + 1, sizeof(unsigned int));
+	for(x = 0; x < 2; x++) ds->lists[x].items = (long int*)memAlloc(MEM_SCRATCH, sizeof(long int) * (size + 1));
+	ds->frontier.items = (long int*)memAlloc(MEM_SCRATCH, sizeof(long int) * (size + 1));
+	ds->settled.items = (long int*)memAlloc(MEM_SCRATCH, sizeof(long int) * (size + 1));
+	ds->pending = &ds->lists[0];
+	ds->next = &ds->lists[1];
+	ds->lowest = (long int*)memAlloc(MEM_SCRATCH, sizeof(long int) * threads);
+	ds->workers = (pthread_t*)memAlloc(MEM_SCRATCH, sizeof(pthread_t) * threads);
+	ds->work = (dwork*)memAlloc(MEM_SCRATCH, sizeof(dwork) * threads);
+	
+	if(threads > 1) {
+		pthread_barrier_init(&ds->start, NULL, threads);
+		pthread_barrier_init(&ds->finish, NULL, threads);
+	}
+	for(x = 0; x < threads; x++) ds->work[x].edges = newSearchEdges();
+	for(x = 1; x < threads; x++) {
+		ds->work[x].ds = ds;
+		ds->work[x].id = x;
+		pthread_create(&ds->workers[x], NULL, deltaWorker, &ds->work[x]);
+	}
+	
+	return ds;
+}
+
+void purgeDeltaStepper(dstep* ds)
+{
+	int x;
+	
+	if(ds == NULL) return;
+	
+	if(ds->threads > 1) {
+		runJob(ds, JOB_STOP);
+		for(x = 1; x < ds->threads; x++) pthread_join(ds->workers[x], NULL);
+		pthread_barrier_destroy(&ds->start);
+		pthread_barrier_destroy(&ds->finish);
+	}
+	
+	memFree((void*)ds->dist);
+	memFree((void*)ds->queued);
+	memFree(ds->settledMark);
+	memFree(ds->lists[0].items);
+	memFree(ds->lists[1].items);
+	memFree(ds->frontier.items);
+	memFree(ds->settled.items);
+	memFree(ds->lowest);
+	for(x = 0; x < ds->threads; x++) purgeSearchEdges(ds->work[x].edges);
+	memFree(ds->workers);
+	memFree(ds->work);
+	memFree(ds);
+}
+
+/*
+ Finds the distance from a city to every other city (SEARCH_FORWARD), or from every other
+ city to it (SEARCH_BACKWARD), in the given graph, leaving them in the stepper for
+ deltaDistance. The graph can be any with as many cities as the one the stepper was made for,
+ such as a later version of it with roads closed.
+ The distances are the same as a full sequential search finds.
+*/
+void deltaSearch(dstep* ds, sgraph* graph, long int source, int direction)
+{
+	slist* swap;
+	long int lowest;
+	int x;
+	
+	ds->graph = graph;
+	ds->direction = direction;
+	runJob(ds, JOB_RESET);
+	
+	atomic_store_explicit(&ds->dist[source], 0, memory_order_relaxed);
+	atomic_store_explicit(&ds->queued[source], 1, memory_order_relaxed);
+	ds->pending->items[0] = source;
+	atomic_store_explicit(&ds->pending->count, 1, memory_order_relaxed);
+	ds->bucket = 0;
+	
+	while(atomic_load_explicit(&ds->pending->count, memory_order_relaxed) > 0) {
+		if(++ds->epoch == 0) {
+			memset(ds->settledMark, 0, sizeof(unsigned int) * (ds->graph->size + 1));
+			ds->epoch = 1;
+		}
+		atomic_store_explicit(&ds->settled.count, 0, memory_order_relaxed);
+		
+		// Relax the short edges of the bucket until no city is left in it.
+		for(;;) {
+			atomic_store_explicit(&ds->next->count, 0, memory_order_relaxed);
+			atomic_store_explicit(&ds->frontier.count, 0, memory_order_relaxed);
+			runJob(ds, JOB_SPLIT);
+			if(atomic_load_explicit(&ds->frontier.count, memory_order_relaxed) == 0) break;
+			STAT_ADD(STAT_SETTLED, atomic_load_explicit(&ds->frontier.count, memory_order_relaxed));
+			runJob(ds, JOB_SHORT);
+			swap = ds->pending;
+			ds->pending = ds->next;
+			ds->next = swap;
+		}
+		
+		// Long edges always reach a later bucket, so they are relaxed once.
+		runJob(ds, JOB_LONG);
+		swap = ds->pending;
+		ds->pending = ds->next;
+		ds->next = swap;
+		
+		lowest = LONG_MAX;
+		for(x = 0; x < ds->threads; x++) {
+			if(ds->lowest[x] < lowest) lowest = ds->lowest[x];
+		}
+		ds->bucket = lowest;
+	}
+}
+
+/*
+ Returns the distance the last deltaSearch found to (or from) a city, INF if unreachable.
+*/
+long int deltaDistance(dstep* ds, long int city)
+{
+	return distLong(atomic_load_explicit(&ds->dist[city], memory_order_relaxed));
+}
@@ -0,0 +1,78 @@
+#include <pthread.h>
+#include <stdatomic.h>
+#include "reliefdb.h"
+#include "search.h"
+#include "dist.h"
+
+#ifndef delta_h
+#define delta_h
+
+#define MAX_DELTA_THREADS 64	// Most worker threads a delta stepper will start.
+
+/*
+ A city list that many threads append to at once. Appends reserve their slots
+ with one atomic add, so a list never needs a lock.
+*/
+typedef struct sharedlist {
+	long int* items;
+	atomic_long count;
+} slist;
+
+/*
+ A delta stepper runs one full single-source search at a time on a pool of
+ threads, with the delta-stepping algorithm: cities are bucketed by distance
+ in steps of delta, and every city in the lowest bucket is relaxed at once,
+ split across the threads. Edges no longer than delta are relaxed until the
+ bucket stops changing, then the longer edges of everything it settled.
+ 
+ dist is shared by every thread and only ever lowered with a relaxed atomic
+ compare and swap; the barriers between steps order everything else. Each
+ city is queued at most once at a time, guarded by its queued flag, so every
+ list fits in one array the size of the graph and nothing is allocated while
+ a search runs.
+ 
+ - graph is the search graph being searched, one of the size the stepper
+   was made for.
+ - threads is the number of threads searching, including the caller.
+ - delta is the bucket width in hours.
+ - pending holds every queued city; next receives the cities queued during
+   a step, and the two swap after it.
+ - frontier is the part of pending in the current bucket, and settled every
+   city taken from the current bucket, whose long edges are relaxed last.
+ - settledMark stamps a city once it is in settled for the current bucket.
+ - cursor hands out the work of a step in chunks, and lowest is each
+   thread's lowest bucket queued during the step.
+ - workers/work are the threads other than the caller, which wait at the
+   start barrier for each step and at the finish barrier after it.
+*/
+typedef struct deltastepper {
+	sgraph* graph;
+	int threads;
+	long int delta;
+	int direction;
+	int job;
+	long int bucket;
+	unsigned int epoch;
+	_Atomic dist_t* dist;
+	atomic_char* queued;
+	unsigned int* settledMark;
+	slist lists[2];
+	slist* pending;
+	slist* next;
+	slist frontier;
+	slist settled;
+	atomic_long cursor;
+	long int* lowest;
+	pthread_t* workers;
+	struct deltawork* work;
+	pthread_barrier_t start;
+	pthread_barrier_t finish;
+} dstep;
+
+dstep* newDeltaStepper(sgraph* graph, int threads, long int delta);
+void purgeDeltaStepper(dstep* ds);
+
+void deltaSearch(dstep* ds, sgraph* graph, long int source, int direction);
+long int deltaDistance(dstep* ds, long int city);
+
+#endif
@@ -0,0 +1,52 @@
+#include <stdint.h>
+#include <limits.h> //for LONG_MAX
+
+#ifndef dist_h
+#define dist_h
+
+/*
+ The type the search graph and the search engines store distances in.
+ 
+ Distances are long ints by default. Building with -DRELIEF_DIST32 stores
+ edge weights, query distances and cached distance rows in 32 bits instead,
+ which halves the memory the relaxation loop streams through; a graph whose
+ routes could run past about 2 billion hours should not use it.
+ 
+ Either way DIST_INF stands for unreachable, and distances saturate there
+ rather than wrapping: adding to DIST_INF, or adding past it, gives
+ DIST_INF. Values leave the engines as long ints through distLong, which
+ turns DIST_INF into the INF (LONG_MAX) the rest of the program uses.
+*/
+#ifdef RELIEF_DIST32
+typedef int32_t dist_t;
+#define DIST_INF INT32_MAX
+#else
+typedef long int dist_t;
+#define DIST_INF LONG_MAX
+#endif
+
+/*
+ Adds a non-negative distance to another, saturating at DIST_INF.
+*/
+static inline dist_t distAdd(dist_t a, dist_t b)
+{
+	return a >= DIST_INF - b ? DIST_INF : a + b;
+}
+
+/*
+ Converts a long int distance to a dist_t, saturating at DIST_INF.
+*/
+static inline dist_t distClamp(long int distance)
+{
+	return distance >= (long int)DIST_INF ? DIST_INF : (dist_t)distance;
+}
+
+/*
+ Converts a dist_t to a long int distance, DIST_INF becoming LONG_MAX.
+*/
+static inline long int distLong(dist_t distance)
+{
+	return distance == DIST_INF ? LONG_MAX : (long int)distance;
+}
+
+#endif
@@ -0,0 +1,97 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "reliefdb.h"
+#include "search.h"
+#include "distcache.h"
+#include "memacct.h"
+
+#define MAX_CACHE_ROWS 256
+
+/*
+ Creates an empty distance cache for a graph of the given size, keeping as
+ many rows as fit in byteBudget (at least one, at most MAX_CACHE_ROWS).
+ Rows are only allocated when first filled.
+*/
+dcache* newDistanceCache(long int size, long int byteBudget)
+{
+	dcache* cache = (dcache*)memAlloc(MEM_PATHS, sizeof(dcache));
+	long int x;
+	
+	cache->size = size;
+	cache->capacity = byteBudget / (long int)(sizeof(dist_t) * (size + 1));
+	if(cache->capacity < 1) cache->capacity = 1;
+	if(cache->capacity > MAX_CACHE_ROWS) cache->capacity = MAX_CACHE_ROWS;
+	cache->rows = 0;
+	cache->tick = 0;
+	cache->row = (drow*)memAlloc(MEM_PATHS, sizeof(drow) * cache->capacity);
+	for(x = 0; x < cache->capacity; x++) cache->row[x].dist = NULL;
+	
+	return cache;
+}
+
+/*
+ Returns the distances from a city to every city (SEARCH_FORWARD), or from
+ every city to it (SEARCH_BACKWARD), searching only if the row is not cached.
+ 
+ The row belongs to the cache and may be replaced by a later call, so callers
+ should copy out what they need before asking for another row.
+*/
+dist_t* cachedDistances(dcache* cache, sgraph* graph, qctx* ctx, long int source, int direction)
+{
+	drow* row = NULL;
+	long int x;
+	
+	cache->tick++;
+	
+	for(x = 0; x < cache->rows; x++) {
+		if(cache->row[x].source == source && cache->row[x].direction == direction) {
+			cache->row[x].used = cache->tick;
+			return cache->row[x].dist;
+		}
+	}
+	
+	// Miss: take a free row, or the least recently used one.
+	if(cache->rows < cache->capacity) {
+		row = &cache->row[cache->rows++];
+		row->dist = (dist_t*)memAlloc(MEM_PATHS, sizeof(dist_t) * (cache->size + 1));
+	}
+	else {
+		row = &cache->row[0];
+		for(x = 1; x < cache->rows; x++) {
+			if(cache->row[x].used < row->used) row = &cache->row[x];
+		}
+	}
+	
+	row->source = source;
+	row->direction = direction;
+	row->used = cache->tick;
+	
+	searchBegin(ctx);
+	searchSeed(ctx, source, 0);
+	while(searchNext(ctx, graph, direction) != -1);
+	for(x = 0; x < cache->size; x++) row->dist[x] = distClamp(searchDistance(ctx, x));
+	
+	return row->dist;
+}
+
+/*
+ Forgets every cached row. Must be called whenever the graph changes.
+*/
+void flushDistanceCache(dcache* cache)
+{
+	long int x;
+	
+	cache->rows = 0;
+	for(x = 0; x < cache->capacity; x++) {
+		memFree(cache->row[x].dist);
+		cache->row[x].dist = NULL;
+	}
+}
+
+void purgeDistanceCache(dcache* cache)
+{
+	if(cache == NULL) return;
+	flushDistanceCache(cache);
+	memFree(cache->row);
+	memFree(cache);
+}
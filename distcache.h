@@ -0,0 +1,45 @@
+#include "reliefdb.h"
+#include "search.h"
+#include "dist.h"
+
+#ifndef distcache_h
+#define distcache_h
+
+/*
+ A distance row is the full result of a one-to-many search: the distance
+ from (or to, for a backward row) one city to every city in the graph.
+ 
+ - source is the index of the city searched from.
+ - direction is SEARCH_FORWARD or SEARCH_BACKWARD.
+ - used is the cache tick of the last lookup, for least recently used eviction.
+ - dist holds one distance per city index as a dist_t, DIST_INF where
+   unreachable.
+*/
+typedef struct distancerow {
+	long int source;
+	int direction;
+	unsigned long used;
+	dist_t* dist;
+} drow;
+
+/*
+ A distance cache keeps the most recently used distance rows so repeated
+ planning queries over the same cities do not search again.
+ 
+ - size is the number of cities in each row.
+ - capacity is the most rows kept; rows is how many are filled.
+*/
+typedef struct distancecache {
+	long int size;
+	long int capacity;
+	long int rows;
+	unsigned long tick;
+	drow* row;
+} dcache;
+
+dcache* newDistanceCache(long int size, long int byteBudget);
+dist_t* cachedDistances(dcache* cache, sgraph* graph, qctx* ctx, long int source, int direction);
+void flushDistanceCache(dcache* cache);
+void purgeDistanceCache(dcache* cache);
+
+#endif
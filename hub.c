@@ -0,0 +1,511 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h> //for LONG_MAX
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "reliefdb.h"
+#include "search.h"
+#include "hub.h"
+#include "memacct.h"
+
+#define INF LONG_MAX
+
+/*
+ A label while it is being built, grown as hubs are added.
+*/
+typedef struct growinglabel {
+	hentry* items;
+	long int count;
+	long int capacity;
+} glabel;
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////BUILDING///////////////////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/*
+ Compares two city indexes by importance, most important first, then by index so the order is
+ the same on every run.
+*/
+static long int* sortImportance;
+static int compareImportance(const void* a, const void* b)
+{
+	long int x = *(const long int*)a;
+	long int y = *(const long int*)b;
+	if(sortImportance[x] != sortImportance[y]) return (sortImportance[x] < sortImportance[y]) - (sortImportance[x] > sortImportance[y]);
+	return (x > y) - (x < y);
+}
+
+static void addEntry(glabel* label, long int hub, dist_t distance)
+{
+	if(label->count == label->capacity) {
+		label->capacity = label->capacity == 0 ? 4 : label->capacity * 2;
+		if(label->items == NULL) label->items = (hentry*)memAlloc(MEM_SCRATCH, sizeof(hentry) * label->capacity);
+		else label->items = (hentry*)memRealloc(label->items, sizeof(hentry) * label->capacity);
+	}
+	label->items[label->count].hub = (uint32_t)hub;
+	label->items[label->count].dist = (uint32_t)distance;
+	label->count++;
+}
+
+/*
+ Runs one pruned search from the city of the given rank, adding the rank to the labels of every
+ city it reaches that the labels so far do not already cover. known holds the source's own label
+ in the other direction, spread out by hub, so a city is covered when some hub in its label plus
+ the source's distance to or from that hub is no longer than the search's distance.
+ 
+ Returns 0 if a distance is too long to store in a label, 1 otherwise.
+*/
+static int prunedSearch(sgraph* graph, qctx* ctx, long int source, long int rank, int direction, uint32_t* known, glabel* labels)
+{
+	sedges* edges = ctx->edges;
+	glabel* label;
+	long int city;
+	long int e;
+	long int x;
+	dist_t distance;
+	
+	searchBegin(ctx);
+	searchSeed(ctx, source, 0);
+	
+	while((city = searchSettle(ctx)) != -1) {
+		distance = ctx->dist[city];
+		if((unsigned long)distance >= HUB_INF) return 0;
+		
+		label = &labels[city];
+		for(x = 0; x < label->count; x++) {
+			if(known[label->items[x].hub] != HUB_INF && (unsigned long)known[label->items[x].hub] + label->items[x].dist <= (unsigned long)distance) break;
+		}
+		if(x < label->count) continue;
+		
+		addEntry(label, rank, distance);
+		searchEdges(graph, city, direction, 0, edges);
+		for(e = 0; e < edges->count; e++) searchRelax(ctx, city, edges->to[e], distAdd(distance, edges->dist[e]));
+	}
+	
+	return 1;
+}
+
+/*
+ Builds the reverse label of one resource from the out labels of its providers, into entries.
+ 
+ Returns the number of entries.
+*/
+static long int resourceLabel(sgraph* graph, glabel* outLabels, int r, rentry* best, rentry* entries)
+{
+	long int count = 0;
+	long int slot;
+	long int hub;
+	hentry* entry;
+	glabel* label;
+	long int x;
+	
+	for(hub = 0; hub < graph->size; hub++) {
+		best[hub].dist = HUB_INF;
+		best[hub].city = HUB_INF;
+		best[hub].secondDist = HUB_INF;
+		best[hub].second = HUB_INF;
+	}
+	
+	for(slot = 0; slot < graph->size; slot++) {
+		if(!(graph->resources[graph->byID[slot]] & (1 << r))) continue;
+		label = &outLabels[graph->byID[slot]];
+		for(x = 0; x < label->count; x++) {
+			entry = &label->items[x];
+			if(entry->dist < best[entry->hub].dist) {
+				best[entry->hub].secondDist = best[entry->hub].dist;
+				best[entry->hub].second = best[entry->hub].city;
+				best[entry->hub].dist = entry->dist;
+				best[entry->hub].city = (uint32_t)slot;
+			}
+			else if(entry->dist < best[entry->hub].secondDist) {
+				best[entry->hub].secondDist = entry->dist;
+				best[entry->hub].second = (uint32_t)slot;
+			}
+		}
+	}
+	
+	for(hub = 0; hub < graph->size; hub++) {
+		if(best[hub].dist == HUB_INF) continue;
+		best[hub].hub = (uint32_t)hub;
+		entries[count++] = best[hub];
+	}
+	
+	return count;
+}
+
+/*
+ Points a labelling's arrays into its block, which must start with a header.
+*/
+static void attachBlock(hlabels* labels)
+{
+	hheader* header = (hheader*)labels->block;
+	char* at = (char*)labels->block + sizeof(hheader);
+	int r;
+	
+	labels->size = header->size;
+	labels->ids = (const int64_t*)at;
+	at += sizeof(int64_t) * header->size;
+	labels->outStart = (const int64_t*)at;
+	at += sizeof(int64_t) * (header->size + 1);
+	labels->inStart = (const int64_t*)at;
+	at += sizeof(int64_t) * (header->size + 1);
+	labels->out = (const hentry*)at;
+	at += sizeof(hentry) * header->outEntries;
+	labels->in = (const hentry*)at;
+	at += sizeof(hentry) * header->inEntries;
+	for(r = 0; r < NUM_RESOURCES; r++) {
+		labels->resource[r] = (const rentry*)at;
+		labels->resourceCount[r] = header->resourceEntries[r];
+		at += sizeof(rentry) * header->resourceEntries[r];
+	}
+}
+
+/*
+ Returns 1 if every hub and provider slot in a labelling's entries is a slot of its graph, 0 if
+ not. A second provider is only checked where there is one.
+*/
+static int entriesInRange(hlabels* labels)
+{
+	uint32_t size = (uint32_t)labels->size;
+	long int x;
+	int r;
+	
+	for(x = 0; x < labels->outStart[labels->size]; x++) {
+		if(labels->out[x].hub >= size) return 0;
+	}
+	for(x = 0; x < labels->inStart[labels->size]; x++) {
+		if(labels->in[x].hub >= size) return 0;
+	}
+	for(r = 0; r < NUM_RESOURCES; r++) {
+		for(x = 0; x < labels->resourceCount[r]; x++) {
+			if(labels->resource[r][x].hub >= size || labels->resource[r][x].city >= size) return 0;
+			if(labels->resource[r][x].secondDist != HUB_INF && labels->resource[r][x].second >= size) return 0;
+		}
+	}
+	
+	return 1;
+}
+
+/*
+ Returns the bytes a block with the counts in a header takes up.
+*/
+static size_t blockSize(hheader* header)
+{
+	size_t size = sizeof(hheader) + sizeof(int64_t) * (header->size + header->size + 1 + header->size + 1);
+	int r;
+	
+	size += sizeof(hentry) * (header->outEntries + header->inEntries);
+	for(r = 0; r < NUM_RESOURCES; r++) size += sizeof(rentry) * header->resourceEntries[r];
+	
+	return size;
+}
+
+/*
+ Fills in the tables between a labelling's slots and the graph's indexes.
+*/
+static void mapSlots(hlabels* labels, sgraph* graph)
+{
+	long int x;
+	
+	labels->slot = (long int*)memAlloc(MEM_GRAPH, sizeof(long int) * (graph->size + 1));
+	labels->index = (long int*)memAlloc(MEM_GRAPH, sizeof(long int) * (graph->size + 1));
+	for(x = 0; x < graph->size; x++) {
+		labels->slot[graph->byID[x]] = x;
+		labels->index[x] = graph->byID[x];
+	}
+}
+
+/*
+ Builds hub labels for every city of a graph by pruned landmark labelling, using the context for
+ its searches. Cities are taken in order of (in degree + 1) * (out degree + 1), so the junctions
+ most routes pass through become the hubs that cover the most pairs.
+ 
+ Returns the labels, or NULL if a distance in the graph is too long to store in a label.
+*/
+hlabels* buildHubLabels(sgraph* graph, qctx* ctx)
+{
+	long int n = graph->size;
+	long int* importance = (long int*)memAlloc(MEM_SCRATCH, sizeof(long int) * (n + 1));
+	long int* byRank = (long int*)memAlloc(MEM_SCRATCH, sizeof(long int) * (n + 1));
+	uint32_t* known = (uint32_t*)memAlloc(MEM_SCRATCH, sizeof(uint32_t) * (n + 1));
+	glabel* outLabels = (glabel*)memCalloc(MEM_SCRATCH, n + 1, sizeof(glabel));
+	glabel* inLabels = (glabel*)memCalloc(MEM_SCRATCH, n + 1, sizeof(glabel));
+	rentry* best = NULL;
+	rentry* entries[NUM_RESOURCES] = {NULL};
+	hlabels* labels = NULL;
+	hheader header;
+	int64_t* table;
+	char* at;
+	long int rank;
+	long int city;
+	long int slot;
+	long int x;
+	int ok = 1;
+	int r;
+	
+	for(city = 0; city < n; city++) {
+		importance[city] = (graph->outStart[city + 1] - graph->outStart[city] + 1) * (graph->inStart[city + 1] - graph->inStart[city] + 1);
+		byRank[city] = city;
+		known[city] = HUB_INF;
+	}
+	sortImportance = importance;
+	qsort(byRank, n, sizeof(long int), compareImportance);
+	
+	// The forward search fills in labels, the backward one out labels.
+	for(rank = 0; rank < n && ok; rank++) {
+		city = byRank[rank];
+		
+		for(x = 0; x < outLabels[city].count; x++) known[outLabels[city].items[x].hub] = outLabels[city].items[x].dist;
+		ok = prunedSearch(graph, ctx, city, rank, SEARCH_FORWARD, known, inLabels);
+		for(x = 0; x < outLabels[city].count; x++) known[outLabels[city].items[x].hub] = HUB_INF;
+		if(!ok) break;
+		
+		for(x = 0; x < inLabels[city].count; x++) known[inLabels[city].items[x].hub] = inLabels[city].items[x].dist;
+		ok = prunedSearch(graph, ctx, city, rank, SEARCH_BACKWARD, known, outLabels);
+		for(x = 0; x < inLabels[city].count; x++) known[inLabels[city].items[x].hub] = HUB_INF;
+	}
+	
+	if(ok) {
+		memcpy(header.magic, HUB_MAGIC, sizeof(header.magic));
+		header.size = n;
+		header.outEntries = 0;
+		header.inEntries = 0;
+		for(city = 0; city < n; city++) {
+			header.outEntries += outLabels[city].count;
+			header.inEntries += inLabels[city].count;
+		}
+		best = (rentry*)memAlloc(MEM_SCRATCH, sizeof(rentry) * (n + 1));
+		for(r = 0; r < NUM_RESOURCES; r++) {
+			entries[r] = (rentry*)memAlloc(MEM_SCRATCH, sizeof(rentry) * (n + 1));
+			header.resourceEntries[r] = resourceLabel(graph, outLabels, r, best, entries[r]);
+		}
+		
+		labels = (hlabels*)memAlloc(MEM_GRAPH, sizeof(hlabels));
+		labels->mapped = 0;
+		labels->blockSize = blockSize(&header);
+		labels->block = memAlloc(MEM_GRAPH, labels->blockSize);
+		memcpy(labels->block, &header, sizeof(hheader));
+		attachBlock(labels);
+		mapSlots(labels, graph);
+		
+		// Fill the block in slot order, through writable pointers to the same places attachBlock found.
+		table = (int64_t*)labels->ids;
+		for(slot = 0; slot < n; slot++) table[slot] = graph->cities[labels->index[slot]]->id;
+		
+		table = (int64_t*)labels->outStart;
+		at = (char*)labels->out;
+		for(slot = 0, table[0] = 0; slot < n; slot++) {
+			city = labels->index[slot];
+			if(outLabels[city].count > 0) memcpy(at, outLabels[city].items, sizeof(hentry) * outLabels[city].count);
+			at += sizeof(hentry) * outLabels[city].count;
+			table[slot + 1] = table[slot] + outLabels[city].count;
+		}
+		
+		table = (int64_t*)labels->inStart;
+		at = (char*)labels->in;
+		for(slot = 0, table[0] = 0; slot < n; slot++) {
+			city = labels->index[slot];
+			if(inLabels[city].count > 0) memcpy(at, inLabels[city].items, sizeof(hentry) * inLabels[city].count);
+			at += sizeof(hentry) * inLabels[city].count;
+			table[slot + 1] = table[slot] + inLabels[city].count;
+		}
+		
+		for(r = 0; r < NUM_RESOURCES; r++) {
+			if(labels->resourceCount[r] > 0) memcpy((rentry*)labels->resource[r], entries[r], sizeof(rentry) * labels->resourceCount[r]);
+			memFree(entries[r]);
+		}
+		memFree(best);
+	}
+	
+	for(city = 0; city < n; city++) {
+		if(outLabels[city].items != NULL) memFree(outLabels[city].items);
+		if(inLabels[city].items != NULL) memFree(inLabels[city].items);
+	}
+	memFree(outLabels);
+	memFree(inLabels);
+	memFree(known);
+	memFree(byRank);
+	memFree(importance);
+	
+	return labels;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////FILES//////////////////////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/*
+ Writes hub labels to a file that loadHubLabels can map.
+ 
+ Returns 1 on success, 0 if the file cannot be written.
+*/
+int saveHubLabels(hlabels* labels, char* filename)
+{
+	FILE* file = fopen(filename, "wb");
+	size_t written;
+	
+	if(file == NULL) return 0;
+	written = fwrite(labels->block, 1, labels->blockSize, file);
+	if(fclose(file) != 0) return 0;
+	
+	return written == labels->blockSize;
+}
+
+/*
+ Maps a hub label file read-only, so every process using the same file shares one copy of it.
+ The file must have been built for a graph with exactly the same city IDs.
+ 
+ Returns the labels, or NULL if the file cannot be read or does not match the graph.
+*/
+hlabels* loadHubLabels(sgraph* graph, char* filename)
+{
+	struct stat info;
+	hheader* header;
+	hlabels* labels;
+	void* block;
+	long int x;
+	int r;
+	int fd;
+	
+	if((fd = open(filename, O_RDONLY)) == -1) return NULL;
+	if(fstat(fd, &info) == -1 || (size_t)info.st_size < sizeof(hheader)) {
+		close(fd);
+		return NULL;
+	}
+	block = mmap(NULL, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if(block == MAP_FAILED) return NULL;
+	
+	header = (hheader*)block;
+	if(memcmp(header->magic, HUB_MAGIC, sizeof(header->magic)) || header->size != graph->size || header->outEntries < 0 || header->inEntries < 0) {
+		munmap(block, info.st_size);
+		return NULL;
+	}
+	for(r = 0; r < NUM_RESOURCES; r++) {
+		if(header->resourceEntries[r] < 0) {
+			munmap(block, info.st_size);
+			return NULL;
+		}
+	}
+	if(blockSize(header) != (size_t)info.st_size) {
+		munmap(block, info.st_size);
+		return NULL;
+	}
+	
+	labels = (hlabels*)memAlloc(MEM_GRAPH, sizeof(hlabels));
+	labels->mapped = 1;
+	labels->block = block;
+	labels->blockSize = info.st_size;
+	attachBlock(labels);
+	
+	// The cities must be the same, the label starts must stay inside the entries and the entries
+	// must only name slots of the graph.
+	for(x = 0; x < graph->size; x++) {
+		if(labels->ids[x] != graph->cities[graph->byID[x]]->id) break;
+		if(labels->outStart[x] > labels->outStart[x + 1] || labels->inStart[x] > labels->inStart[x + 1]) break;
+	}
+	if(x < graph->size || labels->outStart[0] != 0 || labels->inStart[0] != 0
+	   || labels->outStart[graph->size] != header->outEntries || labels->inStart[graph->size] != header->inEntries
+	   || !entriesInRange(labels)) {
+		munmap(block, info.st_size);
+		memFree(labels);
+		return NULL;
+	}
+	mapSlots(labels, graph);
+	
+	return labels;
+}
+
+void purgeHubLabels(hlabels* labels)
+{
+	if(labels == NULL) return;
+	if(labels->mapped) munmap(labels->block, labels->blockSize);
+	else memFree(labels->block);
+	memFree(labels->slot);
+	memFree(labels->index);
+	memFree(labels);
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////QUERIES////////////////////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/*
+ Returns the distance from one city to another, by graph index, or INF if there is no route.
+*/
+long int hubDistance(hlabels* labels, long int from, long int to)
+{
+	const hentry* out = labels->out + labels->outStart[labels->slot[from]];
+	const hentry* outEnd = labels->out + labels->outStart[labels->slot[from] + 1];
+	const hentry* in = labels->in + labels->inStart[labels->slot[to]];
+	const hentry* inEnd = labels->in + labels->inStart[labels->slot[to] + 1];
+	unsigned long best = INF;
+	
+	// Both labels are in hub order, so common hubs are found in one pass.
+	while(out < outEnd && in < inEnd) {
+		if(out->hub < in->hub) out++;
+		else if(out->hub > in->hub) in++;
+		else {
+			if((unsigned long)out->dist + in->dist < best) best = (unsigned long)out->dist + in->dist;
+			out++;
+			in++;
+		}
+	}
+	
+	return (long int)best;
+}
+
+/*
+ Finds the nearest provider of a resource that can reach a city, by graph index, not counting
+ the city itself. The provider's index is written to provider, or -1 if there is none.
+ 
+ Returns the provider's distance to the city, or INF if there is none.
+*/
+long int hubNearest(hlabels* labels, char resource, long int city, long int* provider)
+{
+	int r = resourceIndex(resource);
+	long int slot = labels->slot[city];
+	const hentry* in = labels->in + labels->inStart[slot];
+	const hentry* inEnd = labels->in + labels->inStart[slot + 1];
+	const rentry* hub;
+	const rentry* hubEnd;
+	unsigned long best = INF;
+	unsigned long dist;
+	long int nearest = -1;
+	long int from;
+	
+	*provider = -1;
+	if(r == -1) return INF;
+	hub = labels->resource[r];
+	hubEnd = hub + labels->resourceCount[r];
+	
+	while(hub < hubEnd && in < inEnd) {
+		if(hub->hub < in->hub) hub++;
+		else if(hub->hub > in->hub) in++;
+		else {
+			dist = hub->city != slot ? hub->dist : hub->secondDist;
+			from = hub->city != slot ? hub->city : hub->second;
+			if(dist != HUB_INF && dist + in->dist < best) {
+				best = dist + in->dist;
+				nearest = from;
+			}
+			hub++;
+			in++;
+		}
+	}
+	
+	if(nearest != -1) *provider = labels->index[nearest];
+	return (long int)best;
+}
+
+/*
+ Returns the number of entries in every city's in and out labels together.
+*/
+long int hubEntries(hlabels* labels)
+{
+	return labels->outStart[labels->size] + labels->inStart[labels->size];
+}
@@ -0,0 +1,96 @@
+#include <stdint.h>
+#include "reliefdb.h"
+#include "search.h"
+
+#ifndef hub_h
+#define hub_h
+
+#define HUB_MAGIC "RHUBLAB1"	// First bytes of every hub label file.
+#define HUB_INF UINT32_MAX		// Label distance standing for unreachable.
+
+/*
+ One entry of a hub label: a hub, by its rank in the labelling order, and
+ the distance between the city and that hub.
+*/
+typedef struct hubentry {
+	uint32_t hub;
+	uint32_t dist;
+} hentry;
+
+/*
+ One entry of a resource's reverse label: the two nearest providers of the
+ resource that have a given hub in their out label, and how far each is from
+ it. Cities are slots (see hlabels), second is HUB_INF if there is only one.
+*/
+typedef struct resourceentry {
+	uint32_t hub;
+	uint32_t dist;
+	uint32_t city;
+	uint32_t secondDist;
+	uint32_t second;
+} rentry;
+
+/*
+ The fixed-size start of a hub label file. Counts are in entries.
+*/
+typedef struct hubheader {
+	char magic[8];
+	int64_t size;
+	int64_t outEntries;
+	int64_t inEntries;
+	int64_t resourceEntries[NUM_RESOURCES];
+} hheader;
+
+/*
+ A hub labelling answers distance queries without searching.
+ 
+ Every city has an out label, the hubs it can reach and how far away they
+ are, and an in label, the hubs that can reach it. Labels are built by
+ pruned landmark labelling: cities are taken in order of importance and a
+ search runs from each (forwards for in labels, backwards for out labels),
+ which stops wherever the labels made so far already give the distance. Any
+ two cities then share a hub on a shortest route between them, so the
+ distance from a to b is the smallest out(a) + in(b) over their common hubs,
+ found by merging the two labels in hub order.
+ 
+ Each resource has a reverse label listing, for every hub, the nearest
+ providers with that hub in their out label, so the nearest provider to a
+ city is one merge with the city's in label. The second nearest is kept so
+ that a city is never its own provider, as in shortestPathsBack.
+ 
+ Everything lives in one block laid out exactly like a label file: the
+ header, then as 8 byte integers the ID of each slot and the out and in
+ label starts (size + 1 each), then the out entries, the in entries and each
+ resource's entries. A loaded file is mapped read-only and shared by every
+ process that loads it. Slots number the cities in order of ID, so a file
+ does not depend on how the graph was ordered; slot maps a graph index to its
+ slot and index maps back.
+ 
+ - mapped is 1 if block is a mapping of a file, 0 if it was allocated.
+*/
+typedef struct hublabels {
+	long int size;
+	int mapped;
+	void* block;
+	size_t blockSize;
+	const int64_t* ids;
+	const int64_t* outStart;
+	const int64_t* inStart;
+	const hentry* out;
+	const hentry* in;
+	const rentry* resource[NUM_RESOURCES];
+	long int resourceCount[NUM_RESOURCES];
+	long int* slot;
+	long int* index;
+} hlabels;
+
+hlabels* buildHubLabels(sgraph* graph, qctx* ctx);
+int saveHubLabels(hlabels* labels, char* filename);
+hlabels* loadHubLabels(sgraph* graph, char* filename);
+void purgeHubLabels(hlabels* labels);
+
+long int hubDistance(hlabels* labels, long int from, long int to);
+long int hubNearest(hlabels* labels, char resource, long int city, long int* provider);
+long int hubEntries(hlabels* labels);
+
+#endif
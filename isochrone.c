@@ -0,0 +1,88 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "reliefdb.h"
+#include "search.h"
+#include "isochrone.h"
+#include "memacct.h"
+
+/*
+ Compares two city indexes by the ID of the city, to list cities at the same distance.
+*/
+static sgraph* sortGraph;
+static int compareIDs(const void* a, const void* b)
+{
+	long int idA = sortGraph->cities[*(const long int*)a]->id;
+	long int idB = sortGraph->cities[*(const long int*)b]->id;
+	return (idA > idB) - (idA < idB);
+}
+
+/*
+ Creates an isochrone with room for every city of a graph of the given size, to be reused by
+ every query.
+*/
+iso* newIsochrone(long int size)
+{
+	iso* result = (iso*)memAlloc(MEM_PATHS, sizeof(iso));
+	
+	result->source = -1;
+	result->direction = SEARCH_BACKWARD;
+	result->limit = 0;
+	result->count = 0;
+	result->city = (long int*)memAlloc(MEM_PATHS, sizeof(long int) * (size + 1));
+	result->dist = (long int*)memAlloc(MEM_PATHS, sizeof(long int) * (size + 1));
+	
+	return result;
+}
+
+/*
+ Finds every city within limit hours of the source, in the given direction, with one search
+ bounded to that radius (see searchLimit): it settles only the cities inside and builds no paths,
+ so a small radius costs a small part of a full search. Cities the same distance away are listed
+ by ID, as the order they settle in depends on how the graph is ordered and packed.
+ 
+ Returns the number of cities found, the source included.
+*/
+long int findIsochrone(iso* result, sgraph* graph, qctx* ctx, long int source, int direction, long int limit)
+{
+	long int city;
+	long int first;
+	long int last;
+	int r;
+	
+	result->source = source;
+	result->direction = direction;
+	result->limit = limit;
+	result->count = 0;
+	for(r = 0; r < NUM_RESOURCES; r++) result->providers[r] = 0;
+	if(limit < 0) return 0;
+	
+	searchBegin(ctx);
+	searchLimit(ctx, limit);
+	searchSeed(ctx, source, 0);
+	
+	while((city = searchNext(ctx, graph, direction)) != -1) {
+		result->city[result->count] = city;
+		result->dist[result->count++] = searchDistance(ctx, city);
+		if(city == source) continue;
+		for(r = 0; r < NUM_RESOURCES; r++) {
+			if(graph->resources[city] & (1 << r)) result->providers[r]++;
+		}
+	}
+	
+	// The source stays first, even with other cities 0 hrs away.
+	sortGraph = graph;
+	for(first = 1; first < result->count; first = last) {
+		for(last = first + 1; last < result->count && result->dist[last] == result->dist[first]; last++);
+		if(last - first > 1) qsort(result->city + first, last - first, sizeof(long int), compareIDs);
+	}
+	
+	return result->count;
+}
+
+void purgeIsochrone(iso* result)
+{
+	if(result == NULL) return;
+	memFree(result->city);
+	memFree(result->dist);
+	memFree(result);
+}
@@ -0,0 +1,33 @@
+#include "reliefdb.h"
+#include "search.h"
+
+#ifndef isochrone_h
+#define isochrone_h
+
+/*
+ An isochrone holds every city within a number of hours of one city, nearest
+ first: the cities it can reach in that time (forward), or the cities that can
+ reach it (backward).
+ 
+ - source, direction and limit are the search it holds the result of.
+ - count is the number of cities within the limit, the source included; city
+   and dist hold their indexes and distances, nearest first and by city ID
+   among cities at the same distance, the source first of all.
+ - providers counts the cities within the limit, other than the source, that
+   provide each resource, by RESOURCE_LETTERS position.
+*/
+typedef struct isochrone {
+	long int source;
+	int direction;
+	long int limit;
+	long int count;
+	long int* city;
+	long int* dist;
+	long int providers[NUM_RESOURCES];
+} iso;
+
+iso* newIsochrone(long int size);
+long int findIsochrone(iso* result, sgraph* graph, qctx* ctx, long int source, int direction, long int limit);
+void purgeIsochrone(iso* result);
+
+#endif
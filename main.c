@@ -3,27 +3,683 @@
 #include <string.h>
 #include <limits.h> //FOR LONG_MAX
 #include <ctype.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
 #include "objects.h"
 #include "reliefdb.h"
 #include "strlib.h"
 #include "skipdict.h"
 #include "intlib.h"
+#include "stats.h"
+#include "memacct.h"
+#include "search.h"
+#include "routes.h"
+#include "distcache.h"
+#include "tour.h"
+#include "matrix.h"
+#include "allocate.h"
+#include "timedep.h"
+#include "pareto.h"
+#include "delta.h"
+#include "relax.h"
+#include "writer.h"
+#include "hub.h"
+#include "packed.h"
+#include "snapshot.h"
+#include "isochrone.h"
+#include "coverage.h"
+#include "dbfile.h"
 
 #define INF LONG_MAX
-#define MAX_INT_LENGTH 6
+#define MAX_INT_LENGTH 20
 #define MAX_DISTANCE (14*24)
+#define MAX_RISK 100
+#define DISTANCE_CACHE_BYTES (64L * 1024 * 1024)
+#define ALLOCATION_CANDIDATES 8
+#define BENCH_STRIDE 7919
+#define WORST_SERVED 5
 
+/*
+ Looks a city up by name, or by ID if the text is all digits.
+ 
+ Returns the city, or NULL if there is no such city.
+*/
+static cn* findCity(cdb* db, skipDict* names, char* text)
+{
+	skipDictEntry* returnCity;
+	long int index;
+	
+	if( (returnCity = skipDictSearch(names, text)) != NULL && !strcmp(returnCity->city->name, text)) {
+		// Name was found.
+		return returnCity->city;
+	}
+	
+	if(strIntegrityCheck(text, "0123456789") && (index = searchIndexOf(db->graph, strtol(text, NULL, 10))) != -1) {
+		// ID was found.
+		return db->graph->cities[index];
+	}
+	
+	return NULL;
+}
+
+/*
+ Prints the distance matrix from every provider of the given resources to each city in a comma
+ separated list, as in "!matrix BW Perth,Darwin,12". Unreachable pairs are shown as "-".
+*/
+static void printMatrix(cdb* db, skipDict* names, qctx* ctx, char* args)
+{
+	sgraph* graph = db->graph;
+	char* resources = strtok(args, " ");
+	char* cityList = strtok(NULL, "");
+	char* token;
+	long int* sources;
+	long int* targets;
+	long int rows;
+	long int cols = 0;
+	long int s;
+	long int t;
+	cn* city;
+	dmatrix* matrix;
+	
+	if(resources == NULL || cityList == NULL || !strIntegrityCheck(resources, "BFWDM")) {
+		printf("usage: !matrix resources city,city,... (eg !matrix BW Perth,Darwin,12)\n");
+		return;
+	}
+	
+	sources = (long int*)memAlloc(MEM_SCRATCH, sizeof(long int) * (graph->size + 1));
+	targets = (long int*)memAlloc(MEM_SCRATCH, sizeof(long int) * (graph->size + 1));
+	
+	for(token = strtok(cityList, ","); token != NULL; token = strtok(NULL, ",")) {
+		while(*token == ' ') token++;
+		if((city = findCity(db, names, token)) == NULL) {
+			printf("City %s not found, skipping.\n", token);
+			continue;
+		}
+		if(cols <= graph->size) targets[cols++] = city->index;
+	}
+	rows = providerCities(graph, resources, sources);
+	
+	PHASE_BEGIN(PHASE_SEARCH);
+	matrix = newDistanceMatrix(sources, rows, targets, cols);
+	fillDistanceMatrix(matrix, graph, ctx);
+	PHASE_END(PHASE_SEARCH);
+	
+	PHASE_BEGIN(PHASE_PRINT);
+	printf("\nDistance matrix (hrs) from %ld providers of %s to %ld cities:\n", rows, resources, cols);
+	printf("provider");
+	for(t = 0; t < cols; t++) printf(",%ld", graph->cities[targets[t]]->id);
+	printf("\n");
+	for(s = 0; s < rows; s++) {
+		printf("%ld", graph->cities[sources[s]]->id);
+		for(t = 0; t < cols; t++) {
+			if(matrix->dist[s * cols + t] == INF) printf(",-");
+			else printf(",%ld", matrix->dist[s * cols + t]);
+		}
+		printf("\n");
+	}
+	PHASE_END(PHASE_PRINT);
+	
+	purgeDistanceMatrix(matrix);
+	memFree(sources);
+	memFree(targets);
+}
+
+/*
+ Allocates one resource from providers' stock to several sites, as in "!allocate B Perth:20,12:5",
+ and prints who sends how much to whom.
+*/
+static void printAllocation(cdb* db, skipDict* names, qctx* ctx, char* args)
+{
+	sgraph* graph = db->graph;
+	char* resource = strtok(args, " ");
+	char* siteList = strtok(NULL, "");
+	char* token;
+	char* amount;
+	long int* sites;
+	long int* demand;
+	long int count = 0;
+	long int x;
+	cn* city;
+	alloc* plan;
+	
+	if(resource == NULL || siteList == NULL || len(resource) != 1 || resourceIndex(resource[0]) == -1) {
+		printf("usage: !allocate resource city:demand,city:demand,... (eg !allocate B Perth:20,12:5)\n");
+		return;
+	}
+	
+	sites = (long int*)memAlloc(MEM_SCRATCH, sizeof(long int) * (graph->size + 1));
+	demand = (long int*)memAlloc(MEM_SCRATCH, sizeof(long int) * (graph->size + 1));
+	
+	for(token = strtok(siteList, ","); token != NULL && count <= graph->size; token = strtok(NULL, ",")) {
+		while(*token == ' ') token++;
+		amount = strrchr(token, ':');
+		if(amount == NULL || !lengthof(amount + 1) || !strIntegrityCheck(amount + 1, "0123456789")) {
+			printf("No demand given for %s, skipping.\n", token);
+			continue;
+		}
+		*amount = '\0';
+		if((city = findCity(db, names, token)) == NULL) {
+			printf("City %s not found, skipping.\n", token);
+			continue;
+		}
+		sites[count] = city->index;
+		demand[count++] = strtol(amount + 1, NULL, 10);
+	}
+	
+	PHASE_BEGIN(PHASE_SEARCH);
+	plan = allocateResource(db, ctx, resource[0], sites, demand, count, ALLOCATION_CANDIDATES);
+	PHASE_END(PHASE_SEARCH);
+	
+	PHASE_BEGIN(PHASE_PRINT);
+	printf("\nAllocation of resource %c to %ld sites:\n", toupper(resource[0]), count);
+	for(x = 0; x < plan->count; x++) {
+		printf("%ld from city %s (%ld) to city %s (%ld) | Distance: %ld hrs\n", plan->assigned[x].amount,
+			   graph->cities[plan->assigned[x].provider]->name, graph->cities[plan->assigned[x].provider]->id,
+			   graph->cities[plan->assigned[x].site]->name, graph->cities[plan->assigned[x].site]->id, plan->assigned[x].distance);
+	}
+	printf("Total Cost: %ld unit-hrs\n", plan->totalCost);
+	if(plan->unmet > 0) printf("Unmet Demand: %ld\n", plan->unmet);
+	PHASE_END(PHASE_PRINT);
+	
+	purgeAllocation(plan);
+	memFree(sites);
+	memFree(demand);
+}
+
+/*
+ Prints the quickest route between two cities leaving at a given hour, as in "!depart 8 Perth,Darwin",
+ using any travel time profiles loaded with !traffic.
+*/
+static void printDeparture(cdb* db, skipDict* names, qctx* ctx, tdprof* profiles, rwriter* results, char* args)
+{
+	char* hour = strtok(args, " ");
+	char* fromName = strtok(NULL, ",");
+	char* toName = strtok(NULL, "");
+	long int departure;
+	cn* from;
+	cn* to;
+	cpath* path;
+	
+	if(hour == NULL || fromName == NULL || toName == NULL || !strIntegrityCheck(hour, "0123456789")) {
+		printf("usage: !depart hour from,to (eg !depart 8 Perth,Darwin)\n");
+		return;
+	}
+	while(*toName == ' ') toName++;
+	if((from = findCity(db, names, fromName)) == NULL || (to = findCity(db, names, toName)) == NULL) {
+		printf("City %s not found.\n", from == NULL ? fromName : toName);
+		return;
+	}
+	departure = strtol(hour, NULL, 10);
+	
+	PHASE_BEGIN(PHASE_SEARCH);
+	path = departAt(db->graph, profiles, ctx, from, to, departure);
+	PHASE_END(PHASE_SEARCH);
+	
+	if(path == NULL) {
+		printf("City %s (%ld) cannot be reached from city %s (%ld).\n", to->name, to->id, from->name, from->id);
+		return;
+	}
+	
+	PHASE_BEGIN(PHASE_PRINT);
+	beginRoute(results, NULL, from, to, "\nLeaving city %s (%ld) at hour %ld, arriving at city %s (%ld) at hour %ld%s:\n", from->name, from->id, departure,
+			   to->name, to->id, departure + path->totalDistance, profiles == NULL ? " (no traffic profiles loaded)" : "");
+	writePath(results, db->graph, path);
+	flushResults(results);
+	PHASE_END(PHASE_PRINT);
+}
+
+/*
+ Prints the routes to a resource on a Pareto front, with their total distance and risk.
+*/
+static void printFront(cdb* db, rwriter* results, pfront* front, char resource, cn* destination)
+{
+	char letter[2] = {toupper(resource), '\0'};
+	long int x;
+	
+	if(front->size == 0) {
+		writeMessage(results, "Resource %c is not available.\n\n", toupper(resource));
+		return;
+	}
+	for(x = 0; x < front->size; x++) {
+		beginRoute(results, letter, front->routes[x].provider, destination, "Route %ld of %ld for resource %c from city %s (%ld) to disaster zone %s (%ld), risk %ld:\n", x + 1, front->size, toupper(resource),
+				   front->routes[x].provider->name, front->routes[x].provider->id, destination->name, destination->id, front->routes[x].risk);
+		writePath(results, db->graph, front->routes[x].path);
+	}
+}
+
+/*
+ Prints every route to a resource that is not both longer and riskier than another, as in
+ "!pareto B Perth", or with weights, as in "!weighted B 1:3 Perth", the one route that minimises
+ 1 * distance + 3 * risk.
+*/
+static void printParetoRoutes(cdb* db, skipDict* names, qctx* ctx, lpool* pool, pfront* front, rwriter* results, char* args, int weighted)
+{
+	char* resource = strtok(args, " ");
+	char* weights = weighted ? strtok(NULL, " ") : NULL;
+	char* cityName = strtok(NULL, "");
+	char* riskWeight = weights == NULL ? NULL : strchr(weights, ':');
+	cn* city;
+	
+	if(resource == NULL || cityName == NULL || len(resource) != 1 || resourceIndex(resource[0]) == -1 || (weighted && riskWeight == NULL)) {
+		if(weighted) printf("usage: !weighted resource distance:risk city (eg !weighted B 1:3 Perth)\n");
+		else printf("usage: !pareto resource city (eg !pareto B Perth)\n");
+		return;
+	}
+	if((city = findCity(db, names, cityName)) == NULL) {
+		printf("City %s not found.\n", cityName);
+		return;
+	}
+	
+	clearParetoFront(front);
+	PHASE_BEGIN(PHASE_SEARCH);
+	if(weighted) weightedRoute(db->graph, ctx, city, resource[0], strtol(weights, NULL, 10), strtol(riskWeight + 1, NULL, 10), front);
+	else paretoRoutes(db->graph, ctx, pool, city, resource[0], front);
+	PHASE_END(PHASE_SEARCH);
+	
+	PHASE_BEGIN(PHASE_PRINT);
+	writeMessage(results, "\n");
+	printFront(db, results, front, resource[0], city);
+	flushResults(results);
+	PHASE_END(PHASE_PRINT);
+}
+
+/*
+ Builds hub labels, as in "!hubs build" or "!hubs build labels.hub" to save them as well, loads
+ them from a file, as in "!hubs load labels.hub", or drops them, as in "!hubs off".
+ 
+ Returns the labels to use from now on.
+*/
+static hlabels* changeHubs(sgraph* graph, qctx* ctx, hlabels* hubs, char* args)
+{
+	char* action = strtok(args, " ");
+	char* filename = strtok(NULL, "");
+	hlabels* labels;
+	struct timespec start;
+	struct timespec end;
+	
+	if(action != NULL && !strcmp(action, "off")) {
+		purgeHubLabels(hubs);
+		printf("Hub labels off.\n");
+		return NULL;
+	}
+	if(action == NULL || (strcmp(action, "build") && strcmp(action, "load")) || (!strcmp(action, "load") && filename == NULL)) {
+		printf("usage: !hubs build [file], !hubs load file or !hubs off\n");
+		return hubs;
+	}
+	
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	if(!strcmp(action, "build")) labels = buildHubLabels(graph, ctx);
+	else labels = loadHubLabels(graph, filename);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	
+	if(labels == NULL) {
+		if(!strcmp(action, "build")) printf("Some routes are too long for hub labels.\n");
+		else printf("File %s cannot be loaded as hub labels for this database.\n", filename);
+		return hubs;
+	}
+	purgeHubLabels(hubs);
+	printf("%s hub labels for %ld cities in %.3f ms (%.1f hubs per city).\n", !strcmp(action, "build") ? "Built" : "Loaded", labels->size,
+		   (end.tv_sec - start.tv_sec) * 1000.0 + (end.tv_nsec - start.tv_nsec) / 1000000.0, labels->size > 0 ? (double)hubEntries(labels) / labels->size : 0.0);
+	if(!strcmp(action, "build") && filename != NULL && !saveHubLabels(labels, filename)) printf("File %s cannot be written\n", filename);
+	
+	return labels;
+}
+
+/*
+ Prints the distance between two cities from the hub labels, as in "!hubdist Perth,Darwin".
+*/
+static void printHubDistance(cdb* db, skipDict* names, hlabels* hubs, char* args)
+{
+	char* fromName = strtok(args, ",");
+	char* toName = strtok(NULL, "");
+	long int distance;
+	cn* from;
+	cn* to;
+	
+	if(hubs == NULL) {
+		printf("No hub labels; build or load them with !hubs first.\n");
+		return;
+	}
+	if(fromName == NULL || toName == NULL) {
+		printf("usage: !hubdist from,to (eg !hubdist Perth,Darwin)\n");
+		return;
+	}
+	while(*toName == ' ') toName++;
+	if((from = findCity(db, names, fromName)) == NULL || (to = findCity(db, names, toName)) == NULL) {
+		printf("City %s not found.\n", from == NULL ? fromName : toName);
+		return;
+	}
+	
+	distance = hubDistance(hubs, from->index, to->index);
+	if(distance == INF) printf("City %s (%ld) cannot be reached from city %s (%ld).\n", to->name, to->id, from->name, from->id);
+	else printf("City %s (%ld) to city %s (%ld): %ld hrs\n", from->name, from->id, to->name, to->id, distance);
+}
+
+/*
+ Prints the nearest provider of each resource to a city from the hub labels, as in "!hubnearest BW Perth".
+*/
+static void printHubNearest(cdb* db, skipDict* names, hlabels* hubs, char* args)
+{
+	char* resources = strtok(args, " ");
+	char* cityName = strtok(NULL, "");
+	long int distance;
+	long int provider;
+	cn* city;
+	int x;
+	
+	if(hubs == NULL) {
+		printf("No hub labels; build or load them with !hubs first.\n");
+		return;
+	}
+	if(resources == NULL || cityName == NULL || !strIntegrityCheck(resources, "BFWDM")) {
+		printf("usage: !hubnearest resources city (eg !hubnearest BW Perth)\n");
+		return;
+	}
+	if((city = findCity(db, names, cityName)) == NULL) {
+		printf("City %s not found.\n", cityName);
+		return;
+	}
+	
+	for(x = 0; resources[x] != '\0'; x++) {
+		distance = hubNearest(hubs, resources[x], city->index, &provider);
+		if(provider == -1) printf("Resource %c is not available.\n", resources[x]);
+		else printf("Resource %c: city %s (%ld), %ld hrs from disaster zone %s (%ld)\n", resources[x], db->graph->cities[provider]->name,
+					db->graph->cities[provider]->id, distance, city->name, city->id);
+	}
+}
+
+/*
+ Prints every city that can reach a city within some hours, as in "!within 24 Perth", or with
+ covers, as in "!covers 48 Perth", every city it can reach in that time, nearest first, with how
+ many providers of each resource are among them.
+*/
+static void printIsochrone(cdb* db, skipDict* names, qctx* ctx, iso* reach, char* args, int covers)
+{
+	char* hours = strtok(args, " ");
+	char* cityName = strtok(NULL, "");
+	long int x;
+	cn* city;
+	cn* found;
+	
+	if(hours == NULL || cityName == NULL || !strIntegrityCheck(hours, "0123456789")) {
+		if(covers) printf("usage: !covers hours city (eg !covers 48 Perth)\n");
+		else printf("usage: !within hours city (eg !within 24 Perth)\n");
+		return;
+	}
+	if((city = findCity(db, names, cityName)) == NULL) {
+		printf("City %s not found.\n", cityName);
+		return;
+	}
+	
+	PHASE_BEGIN(PHASE_SEARCH);
+	findIsochrone(reach, db->graph, ctx, city->index, covers ? SEARCH_FORWARD : SEARCH_BACKWARD, strtol(hours, NULL, 10));
+	PHASE_END(PHASE_SEARCH);
+	
+	PHASE_BEGIN(PHASE_PRINT);
+	if(covers) printf("\nCity %s (%ld) can reach %ld other cities within %ld hrs", city->name, city->id, reach->count - 1, reach->limit);
+	else printf("\n%ld other cities can reach city %s (%ld) within %ld hrs", reach->count - 1, city->name, city->id, reach->limit);
+	printf(" (of %ld), providing", db->graph->size - 1);
+	for(x = 0; x < NUM_RESOURCES; x++) printf(" %c: %ld%s", RESOURCE_LETTERS[x], reach->providers[x], x + 1 < NUM_RESOURCES ? "," : "\n");
+	for(x = 1; x < reach->count; x++) {
+		found = db->graph->cities[reach->city[x]];
+		printf("%s (%ld) | %s | Distance: %ld hrs\n", found->name, found->id, found->resources, reach->dist[x]);
+	}
+	PHASE_END(PHASE_PRINT);
+}
+
+/*
+ Prints the number of providers, unreached cities and the average and longest distance of a
+ coverage.
+*/
+static void printCoverageSummary(cover* coverage)
+{
+	long int reached = coverage->size - coverage->unreached;
+	
+	printf("%ld providers, %ld of %ld cities cannot be reached, average %.1f hrs, worst %ld hrs\n", coverage->providers, coverage->unreached,
+		   coverage->size, reached > 0 ? (double)coverage->total / reached : 0.0, coverage->worst);
+}
+
+/*
+ Prints how well each resource serves the cities, with its worst served cities, as in
+ "!coverage" or "!coverage 10" for the ten worst.
+*/
+static void printCoverage(cdb* db, qctx* ctx, char* args)
+{
+	sgraph* graph = db->graph;
+	cover* coverage = newCoverage(graph->size);
+	long int* worst;
+	long int n = WORST_SERVED;
+	long int count;
+	long int x;
+	int r;
+	
+	if(*args != '\0') {
+		if(!strIntegrityCheck(args, "0123456789") || (n = strtol(args, NULL, 10)) <= 0) {
+			printf("usage: !coverage [n] (show the n worst served cities for each resource)\n");
+			purgeCoverage(coverage);
+			return;
+		}
+	}
+	worst = (long int*)memAlloc(MEM_SCRATCH, sizeof(long int) * (n + 1));
+	
+	for(r = 0; r < NUM_RESOURCES; r++) {
+		PHASE_BEGIN(PHASE_SEARCH);
+		measureCoverage(coverage, graph, ctx, RESOURCE_LETTERS[r]);
+		count = worstServed(coverage, graph, worst, n);
+		PHASE_END(PHASE_SEARCH);
+		
+		PHASE_BEGIN(PHASE_PRINT);
+		printf("\nCoverage of resource %c: ", RESOURCE_LETTERS[r]);
+		printCoverageSummary(coverage);
+		printf("Worst served:");
+		for(x = 0; x < count; x++) {
+			if(coverage->served[worst[x]] == DIST_INF) printf(" %s (%ld) unreachable%s", graph->cities[worst[x]]->name, graph->cities[worst[x]]->id, x + 1 < count ? "," : "");
+			else printf(" %s (%ld) %ld hrs%s", graph->cities[worst[x]]->name, graph->cities[worst[x]]->id, (long int)coverage->served[worst[x]], x + 1 < count ? "," : "");
+		}
+		printf("\n");
+		PHASE_END(PHASE_PRINT);
+	}
+	
+	memFree(worst);
+	purgeCoverage(coverage);
+}
+
+/*
+ Proposes where to put k new depots of a resource, as in "!place B 3" to bring the average
+ distance down or "!place B 3 center" to bring the longest down, and prints the coverage before
+ and after.
+*/
+static void printPlacement(cdb* db, qctx* ctx, char* args)
+{
+	sgraph* graph = db->graph;
+	char* resource = strtok(args, " ");
+	char* depots = strtok(NULL, " ");
+	char* objective = strtok(NULL, "");
+	cover* coverage;
+	long int* sites;
+	long int placed;
+	long int k;
+	long int x;
+	
+	if(resource == NULL || depots == NULL || len(resource) != 1 || resourceIndex(resource[0]) == -1 || !strIntegrityCheck(depots, "0123456789")
+	   || (k = strtol(depots, NULL, 10)) <= 0 || (objective != NULL && strcmp(objective, "median") && strcmp(objective, "center"))) {
+		printf("usage: !place resource k [median|center] (eg !place B 3)\n");
+		return;
+	}
+	if(k > graph->size) k = graph->size;
+	
+	coverage = newCoverage(graph->size);
+	sites = (long int*)memAlloc(MEM_SCRATCH, sizeof(long int) * (k + 1));
+	
+	PHASE_BEGIN(PHASE_SEARCH);
+	measureCoverage(coverage, graph, ctx, toupper(resource[0]));
+	PHASE_END(PHASE_SEARCH);
+	printf("\nCoverage of resource %c now: ", toupper(resource[0]));
+	printCoverageSummary(coverage);
+	
+	PHASE_BEGIN(PHASE_SEARCH);
+	placed = placeDepots(coverage, graph, ctx, k, objective != NULL && !strcmp(objective, "center") ? PLACE_CENTER : PLACE_MEDIAN, sites);
+	PHASE_END(PHASE_SEARCH);
+	
+	PHASE_BEGIN(PHASE_PRINT);
+	for(x = 0; x < placed; x++) printf("New depot %ld at city %s (%ld)\n", x + 1, graph->cities[sites[x]]->name, graph->cities[sites[x]]->id);
+	if(placed < k) printf("No further depot would serve any city better.\n");
+	printf("Coverage of resource %c with %ld new depots: ", toupper(resource[0]), placed);
+	printCoverageSummary(coverage);
+	PHASE_END(PHASE_PRINT);
+	
+	memFree(sites);
+	purgeCoverage(coverage);
+}
+
+/*
+ Times n full searches with each queue and each relaxation kernel, as in "!bench 100", from the
+ same spread of sources, and checks that every run found the same distances. The context and the
+ searches are left on the queue and kernel they were using, with the queue sized for travel tables
+ of up to maxWeight hrs.
+ 
+ The same searches are then timed with the delta stepper, and every distance it finds is checked
+ against a sequential search. If hub labels are in use, the distances from the same sources to
+ every city are looked up in them as well, timed, then checked the same way.
+*/
+static void printBenchmark(sgraph* graph, qctx* ctx, dstep* stepper, hlabels* hubs, long int maxWeight, long int n)
+{
+	const char* names[2] = {"binary heap", "bucket queue"};
+	int queues[2] = {QUEUE_HEAP, QUEUE_BUCKETS};
+	int kernels[2] = {KERNEL_SCALAR, KERNEL_AVX2};
+	int previous = ctx->queue;
+	int previousKernel = relaxKernelInUse();
+	long int checksum[4] = {0, 0, 0, 0};
+	long int settled;
+	long int edges;
+	long int wrong = 0;
+	long int city;
+	long int s;
+	int run;
+	int q;
+	int k;
+	struct timespec start;
+	struct timespec end;
+	double ms;
+	
+	for(run = 0; run < 4; run++) {
+		q = run / 2;
+		k = run % 2;
+		if(searchQueue(ctx, queues[q], graph->maxWeight) != queues[q]) {
+			if(k == 0) printf("%s: not available (longest travel table is %ld hrs)\n", names[q], graph->maxWeight);
+			continue;
+		}
+		if(selectRelaxKernel(kernels[k]) != kernels[k]) {
+			printf("%s, %s kernel: not available on this CPU\n", names[q], relaxKernelName(kernels[k]));
+			continue;
+		}
+		settled = 0;
+		edges = 0;
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		for(s = 0; s < n; s++) {
+			searchBegin(ctx);
+			searchSeed(ctx, (s * BENCH_STRIDE) % graph->size, 0);
+			while((city = searchNext(ctx, graph, SEARCH_FORWARD)) != -1) {
+				checksum[run] += searchDistance(ctx, city);
+				edges += graph->outStart[city + 1] - graph->outStart[city];
+				settled++;
+			}
+		}
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		ms = (end.tv_sec - start.tv_sec) * 1000.0 + (end.tv_nsec - start.tv_nsec) / 1000000.0;
+		printf("%s, %s kernel: %ld searches in %.3f ms (%.3f ms each, %.1f million cities settled and %.1f million edges relaxed per second)\n",
+			   names[q], relaxKernelName(kernels[k]), n, ms, ms / n, ms > 0 ? settled / ms / 1000.0 : 0.0, ms > 0 ? edges / ms / 1000.0 : 0.0);
+	}
+	for(run = 1; run < 4; run++) {
+		if(checksum[run] != 0 && checksum[run] != checksum[0]) wrong++;
+	}
+	if(wrong > 0) printf("WARNING: the queues and kernels disagree on distances.\n");
+	searchQueue(ctx, previous, maxWeight);
+	selectRelaxKernel(previousKernel);
+	wrong = 0;
+	
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for(s = 0; s < n; s++) deltaSearch(stepper, graph, (s * BENCH_STRIDE) % graph->size, SEARCH_FORWARD);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	ms = (end.tv_sec - start.tv_sec) * 1000.0 + (end.tv_nsec - start.tv_nsec) / 1000000.0;
+	
+	// Check every distance, outside the timing.
+	settled = 0;
+	for(s = 0; s < n; s++) {
+		deltaSearch(stepper, graph, (s * BENCH_STRIDE) % graph->size, SEARCH_FORWARD);
+		searchBegin(ctx);
+		searchSeed(ctx, (s * BENCH_STRIDE) % graph->size, 0);
+		while(searchNext(ctx, graph, SEARCH_FORWARD) != -1);
+		for(city = 0; city < graph->size; city++) {
+			if(deltaDistance(stepper, city) != searchDistance(ctx, city)) wrong++;
+			if(deltaDistance(stepper, city) != INF) settled++;
+		}
+	}
+	printf("delta-stepping (%d threads, %ld hr buckets): %ld searches in %.3f ms (%.3f ms each, %.1f million cities settled per second)\n", stepper->threads, stepper->delta, n, ms, ms / n, ms > 0 ? settled / ms / 1000.0 : 0.0);
+	if(wrong > 0) printf("WARNING: delta-stepping disagrees with the sequential search on %ld distances.\n", wrong);
+	if(hubs == NULL) return;
+	wrong = 0;
+	
+	settled = 0;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for(s = 0; s < n; s++) {
+		for(city = 0; city < graph->size; city++) settled += hubDistance(hubs, (s * BENCH_STRIDE) % graph->size, city) != INF;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	ms = (end.tv_sec - start.tv_sec) * 1000.0 + (end.tv_nsec - start.tv_nsec) / 1000000.0;
+	
+	for(s = 0; s < n; s++) {
+		searchBegin(ctx);
+		searchSeed(ctx, (s * BENCH_STRIDE) % graph->size, 0);
+		while(searchNext(ctx, graph, SEARCH_FORWARD) != -1);
+		for(city = 0; city < graph->size; city++) {
+			if(hubDistance(hubs, (s * BENCH_STRIDE) % graph->size, city) != searchDistance(ctx, city)) wrong++;
+		}
+	}
+	printf("hub labels: %ld lookups in %.3f ms (%.3f us each, %ld reachable)\n", n * graph->size, ms, n * graph->size > 0 ? ms * 1000.0 / (n * graph->size) : 0.0, settled);
+	if(wrong > 0) printf("WARNING: hub labels disagree with the sequential search on %ld distances.\n", wrong);
+}
+
+/*
+ Reads the number after a REPL command such as "!nearest 3".
+ 
+ Returns the number, or 0 if it is missing or not a positive number.
+*/
+static long int commandCount(char* buffer, char* command)
+{
+	char* arg = buffer + len(command);
+	if(*arg != ' ' || !strIntegrityCheck(arg + 1, "0123456789") || !lengthof(arg + 1)) return 0;
+	return strtol(arg + 1, NULL, 10);
+}
 
 
 int main(int argc, const char * argv[])
 {
 	if(argc < 2) {
-		printf("usage: relief filename\n");
+		printf("usage: relief filename [none|bfs|rcm] [simplify] [pack]\n");
 		exit(EXIT_FAILURE);
 	}
 	
 	const char* filename = argv[1];
 	
+	// How to order the search graph's cities in memory; database order unless asked otherwise.
+	// With simplify, nearest resource searches run on a simplified copy of the graph; with pack,
+	// travel tables are held packed and decoded as searches reach them.
+	int order = ORDER_NONE;
+	int options = 0;
+	int a;
+	for(a = 2; a < argc; a++) {
+		if(!strcmp(argv[a], "bfs")) order = ORDER_BFS;
+		else if(!strcmp(argv[a], "rcm")) order = ORDER_RCM;
+		else if(!strcmp(argv[a], "simplify")) options |= LINK_SIMPLIFY;
+		else if(!strcmp(argv[a], "pack")) options |= LINK_PACK;
+		else if(strcmp(argv[a], "none")) {
+			printf("usage: relief filename [none|bfs|rcm] [simplify] [pack]\n");
+			exit(EXIT_FAILURE);
+		}
+	}
+	
 	FILE* dbfile = fopen(filename, "r");
 	
 	if(dbfile == NULL) {
@@ -31,21 +687,60 @@ int main(int argc, const char * argv[])
 		return 0;
 	}
 	
-	// Setup database, using the number cities given in the file as the size of the database.
-	cdb* cityDatabase = newCDB("DefaultName");
-	char* temp = (char*)malloc( sizeof(char) * (MAX_INT_LENGTH+1) );
-	fgets(temp, MAX_INT_LENGTH, dbfile);
-	int numOfCities = atoi(temp);
-	cityDatabase->ctsize = numOfCities;
-	free(temp);
-	
 	// Make a new skip list dictionary for the names of the cities
 	skipDict* cityNameDict = newSkipDict();
 	
+	// Changes compacted from a text database are only in the binary database file beside it, so
+	// that file is loaded in its place: starting from the text would lose them, and the next
+	// compaction would write over them. A text file edited since then holds changes the binary
+	// one does not, so neither is loaded.
+	char* snapName = (char*)memAlloc(MEM_SCRATCH, strlen(filename) + 6);
+	struct stat textStat;
+	struct stat snapStat;
+	FILE* snapFile;
+	sprintf(snapName, "%s.snap", filename);
+	if(!isDatabaseFile(dbfile) && (snapFile = fopen(snapName, "r")) != NULL) {
+		if(fstat(fileno(dbfile), &textStat) != 0 || fstat(fileno(snapFile), &snapStat) != 0 || textStat.st_mtime > snapStat.st_mtime) {
+			printf("File %s was edited after %s was compacted from it, and starting from either would lose changes.\n", filename, snapName);
+			printf("Start from %s to keep the changes compacted into it, or remove it (and %s.journal) to start from the edited %s.\n", snapName, snapName, filename);
+			return 0;
+		}
+		printf("Loading %s, which holds the changes compacted from %s.\n", snapName, filename);
+		fclose(dbfile);
+		dbfile = snapFile;
+		filename = snapName;
+	}
+	
+	// A binary database written by !compact loads whole, with the road edits it was written with.
+	int binary = isDatabaseFile(dbfile);
+	redit* edits = NULL;
+	long int editCount = 0;
+	cdb* cityDatabase;
+	
+	if(binary) {
+		printf("\nLoading binary database...\n");
+		PHASE_BEGIN(PHASE_LOAD);
+		cityDatabase = loadDatabaseFile(dbfile, cityNameDict, &edits, &editCount);
+		PHASE_END(PHASE_LOAD);
+		if(cityDatabase == NULL) {
+			printf("File %s is not a whole binary database\n", filename);
+			return 0;
+		}
+	}
+	else {
+		// Setup database, using the number cities given in the file as the size of the database.
+		cityDatabase = newCDB("DefaultName");
+		char* temp = (char*)malloc( sizeof(char) * (MAX_INT_LENGTH+1) );
+		fgets(temp, MAX_INT_LENGTH, dbfile);
+		cityDatabase->ctsize = atoi(temp);
+		free(temp);
+	}
+	int numOfCities = cityDatabase->ctsize;
+	
 	const int ID_MAX = digits(numOfCities);
 	const int NM_MAX = 100;
 	const int RLF_MAX = 6;
-	const int TRAVEL_MAX = (numOfCities - 1) * (ID_MAX + digits(MAX_DISTANCE) + 2); // Max length of an id, plus the max length of a distance, plus 2 characters for the colon and comma.
+	const int TRAVEL_MAX = (numOfCities - 1) * (ID_MAX + digits(MAX_DISTANCE) + digits(MAX_RISK) + 3); // Max length of an id, a distance and a risk, plus 3 characters for the colon, slash and comma.
 	const int MAX_LENGTH = ID_MAX + NM_MAX + RLF_MAX + TRAVEL_MAX;
 	
 	char* buffer = (char*)calloc(sizeof(char), MAX_LENGTH + 1);
@@ -65,23 +760,38 @@ int main(int argc, const char * argv[])
 	
 	int buflen;
 	
-	skipDictEntry* returnCity;
-	cdbn* cityDBNodeInDistress;
 	cn* cityInDistress;
 	
 	int x;
-	int y;
+	long int y;
 	char currentResource;
-	rsc* curResShortestRoute;
+	rsc* curResShortestRoute = NULL;
+	
+	// Letters of the resources a route carries, as handed to the result writer.
+	char collected[NUM_RESOURCES + 1];
+	
+	// How many providers to list per resource, and how many routes to show to the best one.
+	long int nearestCount = 1;
+	long int alternativeCount = 1;
+	long int routeCount;
+	long int count;
+	plist* nearestLists[NUM_RESOURCES];
+	plist* providers = NULL;
+	cpath** routes = (cpath**)memAlloc(MEM_SCRATCH, sizeof(cpath*));
 	
-	cpath* pathToResource;
+	// Candidates per resource for tour planning; 0 when tours are off.
+	long int tourCandidates = 0;
+	rtour tour;
+	int r;
 	
-	char* currentCityName;
+	for(x = 0; x < NUM_RESOURCES; x++) nearestLists[x] = newProviderList(RESOURCE_LETTERS[x], nearestCount);
 	
-	printf("\nReading file and constructing database...\n");
+	if(!binary) printf("\nReading file and constructing database...\n");
+	
+	if(!binary) PHASE_BEGIN(PHASE_LOAD);
 	
 	// For every line in the file, add it to the database.
-	while(fgets(buffer, MAX_LENGTH, dbfile) != NULL) {
+	while(!binary && fgets(buffer, MAX_LENGTH, dbfile) != NULL) {
 		cityID = strtok(buffer, "|");
 		cityName = strtok(NULL, "|");
 		cityRelief = strtok(NULL, "|");
@@ -93,40 +803,401 @@ int main(int argc, const char * argv[])
 		addSkipEntry(cityNameDict, cityName, thisCity); //Add the city to the dictionary using the name string as the key.
 	}
 	
+	if(!binary) PHASE_END(PHASE_LOAD);
+	fclose(dbfile);
+	
+	// Resolve every travel table to the city it points at.
+	PHASE_BEGIN(PHASE_LINK);
+	linkDB(cityDatabase, order, options);
+	PHASE_END(PHASE_LINK);
+	
+	// Searches on the core graph cross whole chains in one shortcut, so the queue must allow for its longest.
+	long int maxWeight = cityDatabase->graph->maxWeight;
+	if(cityDatabase->core != NULL) {
+		printf("Simplified search graph: %ld of %ld travel tables kept, %ld chains of pass-through cities contracted.\n",
+			   cityDatabase->core->edges - cityDatabase->core->shortcuts, cityDatabase->graph->edges, cityDatabase->core->shortcuts);
+		if(cityDatabase->core->maxWeight > maxWeight) maxWeight = cityDatabase->core->maxWeight;
+	}
+	if(options & LINK_PACK) {
+		if(cityDatabase->graph->outPacked == NULL) printf("Travel tables could not be packed (negative or too many), keeping them unpacked.\n");
+		else printf("Packed travel tables: %ld bytes instead of %ld (%.1f times smaller).\n", adjacencyBytes(cityDatabase->graph),
+					plainAdjacencyBytes(cityDatabase->graph), (double)plainAdjacencyBytes(cityDatabase->graph) / adjacencyBytes(cityDatabase->graph));
+	}
+	
+	// Working space for every query, allocated once.
+	qctx* query = newQueryContext(cityDatabase->graph->size);
+	searchQueue(query, QUEUE_BUCKETS, maxWeight);
+	selectRelaxKernel(KERNEL_AVX2);
+	dcache* distances = newDistanceCache(cityDatabase->graph->size, DISTANCE_CACHE_BYTES);
+	
+	// Travel time profiles, once loaded with !traffic.
+	tdprof* profiles = NULL;
+	FILE* profileFile;
+	
+	// Working space and results for routes that trade distance against risk.
+	lpool* labels = newLabelPool(cityDatabase->graph->size);
+	pfront* front = newParetoFront();
+	
+	// Threads for full searches, one per core until changed with !threads.
+	long int cores = sysconf(_SC_NPROCESSORS_ONLN);
+	dstep* stepper = newDeltaStepper(cityDatabase->graph, cores > 0 ? (int)cores : 1, 0);
+	
+	// Routes are written through a buffered writer, as text on stdout until changed with !format.
+	rwriter* results = newResultWriter(stdout, FORMAT_TEXT);
+	
+	// Hub labels for distance lookups without searching, once built or loaded with !hubs.
+	hlabels* hubs = NULL;
+	rwriter* chosen;
+	char* target;
+	int format;
+	
+	// Cities within some hours of a city, for !within and !covers.
+	iso* reach = newIsochrone(cityDatabase->graph->size);
+	
+	// Roads closed, opened and given new distances while queries run, with !close, !open, !distance
+	// and !roads, and stock changed with !stock. Each query pins the version of the roads current
+	// when it starts and runs on that to the end.
+	sstore* roads = newSnapshotStore(cityDatabase, options);
+	int reader = joinSnapshotReaders(roads);
+	unsigned long version = 0;
+	gsnap* snap;
+	cdb* db;
+	cn* roadEnd;
+	FILE* feedFile;
+	int changed;
+	
+	// Every change is journaled beside the database file, and replayed from there on restart. The
+	// journal is compacted into a binary database file, which a restart can then load instead.
+	char* journalName = (char*)memAlloc(MEM_SCRATCH, strlen(filename) + 9);
+	char* databaseName = (char*)memAlloc(MEM_SCRATCH, strlen(filename) + 6);
+	sprintf(journalName, "%s.journal", filename);
+	sprintf(databaseName, binary ? "%s" : "%s.snap", filename);
+	PHASE_BEGIN(PHASE_LOAD);
+	count = restoreSnapshotStore(roads, edits, editCount, journalName, databaseName);
+	PHASE_END(PHASE_LOAD);
+	if(editCount > 0 || count > 0) printf("Restored %ld road edits and replayed %ld changes from %s.\n", editCount, count, journalName);
+	memFree(edits);
+	memFree(journalName);
+	memFree(databaseName);
+	memFree(snapName);
+	
 	// Now ask the user for input on disaster area and resources needed.
 	while(1) {
+		// Nothing is pinned while waiting for input, so old versions can be freed meanwhile.
+		unpinSnapshot(roads, reader);
 		printf("\nPlease input city in distress (ID or name) or type !exit to exit: ");
 		fgets(buffer, MAX_LENGTH, stdin);
 		stripstr(buffer, '\n');
 		
+		snap = pinSnapshot(roads, reader);
+		db = &snap->view;
+		if(snap->version != version) {
+			// Cached distances and hub labels were worked out on the old roads.
+			version = snap->version;
+			flushDistanceCache(distances);
+			if(db->graph->maxWeight > maxWeight || (db->core != NULL && db->core->maxWeight > maxWeight)) {
+				maxWeight = db->core != NULL && db->core->maxWeight > db->graph->maxWeight ? db->core->maxWeight : db->graph->maxWeight;
+				searchQueue(query, query->queue, maxWeight);
+			}
+			if(hubs != NULL) {
+				purgeHubLabels(hubs);
+				hubs = NULL;
+				printf("Roads have changed, hub labels dropped; rebuild them with !hubs build.\n");
+			}
+		}
 		
 		if(!strcmp(buffer, "!exit")) {
 			printf("Thank you.\n\n");
+#ifdef RELIEF_STATS
+			STATS_REPORT(stdout);
+#endif
 			break;
 		}
 		
-		if(!lengthof(buffer)) continue;
+		if(!strcmp(buffer, "!stats")) {
+			STATS_REPORT(stdout);
+			continue;
+		}
+		
+		if(!strcmp(buffer, "!mem")) {
+			printMemReport(stdout);
+			continue;
+		}
+		
+		if(!strncmp(buffer, "!close ", 7) || !strncmp(buffer, "!open ", 6)) {
+			x = buffer[1] == 'c';
+			target = strchr(buffer, ',');
+			if(target == NULL) {
+				printf("usage: !close from,to or !open from,to (eg !close Perth,Darwin)\n");
+				continue;
+			}
+			*target++ = '\0';
+			while(*target == ' ') target++;
+			if((thisCity = findCity(db, cityNameDict, buffer + (x ? 7 : 6))) == NULL || (roadEnd = findCity(db, cityNameDict, target)) == NULL) {
+				printf("City %s not found.\n", thisCity == NULL ? buffer + (x ? 7 : 6) : target);
+				continue;
+			}
+			if((changed = setRoadClosed(roads, thisCity->index, roadEnd->index, x)) == 1) printf("Road from city %s (%ld) to city %s (%ld) %s.\n", thisCity->name, thisCity->id, roadEnd->name, roadEnd->id, x ? "closed" : "opened");
+			else if(changed == 0) printf("There is no %s road from city %s (%ld) to city %s (%ld).\n", x ? "open" : "closed", thisCity->name, thisCity->id, roadEnd->name, roadEnd->id);
+			else printf("The journal cannot be written, so the road was left as it is.\n");
+			continue;
+		}
+		
+		if(!strncmp(buffer, "!distance ", 10)) {
+			target = strchr(buffer, ',');
+			cityName = strrchr(buffer, ' ');
+			if(target == NULL || cityName < target || !lengthof(cityName + 1) || !strIntegrityCheck(cityName + 1, "0123456789")) {
+				printf("usage: !distance from,to hours (eg !distance Perth,Darwin 30)\n");
+				continue;
+			}
+			*target++ = '\0';
+			*cityName++ = '\0';
+			while(*target == ' ') target++;
+			if((thisCity = findCity(db, cityNameDict, buffer + 10)) == NULL || (roadEnd = findCity(db, cityNameDict, target)) == NULL) {
+				printf("City %s not found.\n", thisCity == NULL ? buffer + 10 : target);
+				continue;
+			}
+			if((changed = setRoadDistance(roads, thisCity->index, roadEnd->index, strtol(cityName, NULL, 10))) == 1) printf("Road from city %s (%ld) to city %s (%ld) now takes %s hrs.\n", thisCity->name, thisCity->id, roadEnd->name, roadEnd->id, cityName);
+			else if(changed == 0) printf("There is no road from city %s (%ld) to city %s (%ld) that does not already take %s hrs.\n", thisCity->name, thisCity->id, roadEnd->name, roadEnd->id, cityName);
+			else printf("The journal cannot be written, so the road was left as it is.\n");
+			continue;
+		}
+		
+		if(!strncmp(buffer, "!stock ", 7)) {
+			cityRelief = strrchr(buffer, ' ');
+			if(cityRelief == buffer + 6 || !lengthof(cityRelief + 1) || !strIntegrityCheck(cityRelief + 1, "BFWDMX0123456789")) {
+				printf("usage: !stock city resources (eg !stock Perth B20W)\n");
+				continue;
+			}
+			*cityRelief++ = '\0';
+			if((thisCity = findCity(db, cityNameDict, buffer + 7)) == NULL) {
+				printf("City %s not found.\n", buffer + 7);
+				continue;
+			}
+			if((changed = setCityStock(roads, thisCity->index, cityRelief)) == 1) printf("City %s (%ld) now has resources %s.\n", thisCity->name, thisCity->id, cityRelief);
+			else if(changed == 0) printf("City %s (%ld) already has resources %s.\n", thisCity->name, thisCity->id, cityRelief);
+			else printf("The journal cannot be written, so the stock was left as it is.\n");
+			continue;
+		}
 		
+		if(!strcmp(buffer, "!compact")) {
+			if(compactJournal(roads)) printf("Database and changes written to %s; the journal is empty again.\n", roads->databaseName);
+			else printf("File %s cannot be written, or was not loaded by this run; the journal is kept\n", roads->databaseName);
+			continue;
+		}
 		
-		if( (returnCity = skipDictSearch(cityNameDict, buffer)) != NULL && !strcmp(returnCity->city->name, buffer)) {
-			// Name was found.
-			cityInDistress = returnCity->city;
+		if(!strcmp(buffer, "!roads")) {
+			printf("Roads at version %lu with %ld closed; %ld versions published, %ld freed.\n", snap->version, snap->closed,
+				   atomic_load(&roads->published), atomic_load(&roads->reclaimed));
+			count = journalStatus(roads, buffer, MAX_LENGTH);
+			printf("Journal %s holds %ld changes since the database file was written.\n", buffer, count);
+			if(roads->feeding) printf("Road feed %s: %ld updates applied, %ld lines skipped.\n", atomic_load(&roads->feedDone) ? "finished" : "running",
+									 atomic_load(&roads->feedApplied), atomic_load(&roads->feedSkipped));
+			continue;
 		}
 		
-		else if(strIntegrityCheck(buffer, "0123456789") && (cityDBNodeInDistress = CSearch(strtol(buffer, NULL, 10), cityDatabase)) != NULL && cityDBNodeInDistress->cur->id == strtol(buffer, NULL, 10)) {
-			// ID was found.
-			cityInDistress = cityDBNodeInDistress->cur;
+		if(!strncmp(buffer, "!roads ", 7)) {
+			if((feedFile = fopen(buffer + 7, "r")) == NULL) {
+				printf("File %s not found\n", buffer + 7);
+				continue;
+			}
+			if(!startRoadFeed(roads, feedFile)) {
+				fclose(feedFile);
+				printf("A road feed is still running.\n");
+				continue;
+			}
+			printf("Applying road updates from %s as queries run.\n", buffer + 7);
+			continue;
+		}
+		
+		if(!strncmp(buffer, "!matrix", 7)) {
+			printMatrix(db, cityNameDict, query, buffer[7] == ' ' ? buffer + 8 : buffer + 7);
+			continue;
+		}
+		
+		if(!strncmp(buffer, "!allocate", 9)) {
+			printAllocation(db, cityNameDict, query, buffer[9] == ' ' ? buffer + 10 : buffer + 9);
+			continue;
+		}
+		
+		if(!strcmp(buffer, "!queue heap") || !strcmp(buffer, "!queue buckets")) {
+			if(searchQueue(query, buffer[7] == 'h' ? QUEUE_HEAP : QUEUE_BUCKETS, maxWeight) == QUEUE_HEAP) printf("Searching with a binary heap.\n");
+			else printf("Searching with a bucket queue.\n");
+			continue;
 		}
 		
-		else {
+		if(!strcmp(buffer, "!kernel scalar") || !strcmp(buffer, "!kernel avx2")) {
+			printf("Relaxing edges with the %s kernel.\n", relaxKernelName(selectRelaxKernel(buffer[8] == 's' ? KERNEL_SCALAR : KERNEL_AVX2)));
+			continue;
+		}
+		
+		if(!strncmp(buffer, "!bench", 6)) {
+			if(!(count = commandCount(buffer, "!bench"))) {
+				printf("usage: !bench n (time n searches with each queue and kernel)\n");
+				continue;
+			}
+			printBenchmark(db->graph, query, stepper, hubs, maxWeight, count);
+			continue;
+		}
+		
+		if(!strncmp(buffer, "!threads", 8)) {
+			if(!(count = commandCount(buffer, "!threads"))) {
+				printf("usage: !threads n (run delta-stepping searches on n threads)\n");
+				continue;
+			}
+			purgeDeltaStepper(stepper);
+			stepper = newDeltaStepper(db->graph, count > MAX_DELTA_THREADS ? MAX_DELTA_THREADS : (int)count, 0);
+			printf("Delta-stepping on %d threads with %ld hr buckets.\n", stepper->threads, stepper->delta);
+			continue;
+		}
+		
+		if(!strncmp(buffer, "!hubs", 5)) {
+			hubs = changeHubs(db->graph, query, hubs, buffer[5] == ' ' ? buffer + 6 : buffer + 5);
+			continue;
+		}
+		
+		if(!strncmp(buffer, "!hubdist", 8)) {
+			printHubDistance(db, cityNameDict, hubs, buffer[8] == ' ' ? buffer + 9 : buffer + 8);
+			continue;
+		}
+		
+		if(!strncmp(buffer, "!hubnearest", 11)) {
+			printHubNearest(db, cityNameDict, hubs, buffer[11] == ' ' ? buffer + 12 : buffer + 11);
+			continue;
+		}
+		
+		if(!strncmp(buffer, "!format ", 8)) {
+			target = strchr(buffer + 8, ' ');
+			if(target != NULL) *target++ = '\0';
+			if(!strcmp(buffer + 8, "text")) format = FORMAT_TEXT;
+			else if(!strcmp(buffer + 8, "jsonl")) format = FORMAT_JSONL;
+			else if(!strcmp(buffer + 8, "binary")) format = FORMAT_BINARY;
+			else {
+				printf("usage: !format text|jsonl|binary [file]\n");
+				continue;
+			}
+			chosen = target == NULL || *target == '\0' ? newResultWriter(stdout, format) : openResultWriter(target, format);
+			if(chosen == NULL) {
+				printf("File %s cannot be written\n", target);
+				continue;
+			}
+			purgeResultWriter(results);
+			results = chosen;
+			printf("Writing results as %s to %s.\n", buffer + 8, target == NULL || *target == '\0' ? "the screen" : target);
+			continue;
+		}
+		
+		if(!strncmp(buffer, "!traffic ", 9)) {
+			if((profileFile = fopen(buffer + 9, "r")) == NULL) {
+				printf("File %s not found\n", buffer + 9);
+				continue;
+			}
+			purgeProfiles(profiles);
+			profiles = loadProfiles(db->graph, profileFile);
+			fclose(profileFile);
+			printf("Loaded travel time profiles for %ld travel tables.\n", profiles->profiles);
+			continue;
+		}
+		
+		if(!strncmp(buffer, "!depart", 7)) {
+			printDeparture(db, cityNameDict, query, profiles, results, buffer[7] == ' ' ? buffer + 8 : buffer + 7);
+			continue;
+		}
+		
+		if(!strncmp(buffer, "!pareto", 7)) {
+			printParetoRoutes(db, cityNameDict, query, labels, front, results, buffer[7] == ' ' ? buffer + 8 : buffer + 7, 0);
+			continue;
+		}
+		
+		if(!strncmp(buffer, "!weighted", 9)) {
+			printParetoRoutes(db, cityNameDict, query, labels, front, results, buffer[9] == ' ' ? buffer + 10 : buffer + 9, 1);
+			continue;
+		}
+		
+		if(!strncmp(buffer, "!within", 7)) {
+			printIsochrone(db, cityNameDict, query, reach, buffer[7] == ' ' ? buffer + 8 : buffer + 7, 0);
+			continue;
+		}
+		
+		if(!strncmp(buffer, "!covers", 7)) {
+			printIsochrone(db, cityNameDict, query, reach, buffer[7] == ' ' ? buffer + 8 : buffer + 7, 1);
+			continue;
+		}
+		
+		if(!strncmp(buffer, "!coverage", 9)) {
+			printCoverage(db, query, buffer[9] == ' ' ? buffer + 10 : buffer + 9);
+			continue;
+		}
+		
+		if(!strncmp(buffer, "!place", 6)) {
+			printPlacement(db, query, buffer[6] == ' ' ? buffer + 7 : buffer + 6);
+			continue;
+		}
+		
+		if(!strncmp(buffer, "!nearest", 8)) {
+			if(!(count = commandCount(buffer, "!nearest"))) {
+				printf("usage: !nearest k (list the k nearest providers of each resource)\n");
+				continue;
+			}
+			nearestCount = count;
+			for(x = 0; x < NUM_RESOURCES; x++) {
+				purgeProviderList(nearestLists[x]);
+				nearestLists[x] = newProviderList(RESOURCE_LETTERS[x], nearestCount);
+			}
+			printf("Listing the %ld nearest providers of each resource.\n", nearestCount);
+			continue;
+		}
+		
+		if(!strcmp(buffer, "!tour off")) {
+			tourCandidates = 0;
+			printf("Tour planning off.\n");
+			continue;
+		}
+		
+		if(!strncmp(buffer, "!tour", 5)) {
+			if(!(count = commandCount(buffer, "!tour"))) {
+				printf("usage: !tour k (plan one route collecting every resource, from the k nearest providers of each) or !tour off\n");
+				continue;
+			}
+			tourCandidates = count;
+			printf("Planning pickup tours over the %ld nearest providers of each resource.\n", tourCandidates);
+			continue;
+		}
+		
+		if(!strncmp(buffer, "!alternatives", 13)) {
+			if(!(count = commandCount(buffer, "!alternatives"))) {
+				printf("usage: !alternatives k (show k routes to the nearest provider)\n");
+				continue;
+			}
+			alternativeCount = count;
+			routes = (cpath**)memRealloc(routes, sizeof(cpath*) * alternativeCount);
+			printf("Showing up to %ld routes to the nearest provider of each resource.\n", alternativeCount);
+			continue;
+		}
+		
+		if(!lengthof(buffer)) continue;
+		
+		
+		if((cityInDistress = findCity(db, cityNameDict, buffer)) == NULL) {
 			printf("City not found. Please try again.\n");
 			continue;
 		}
 		
 		printf("\nCity Found: %s (ID %ld)\n", cityInDistress->name, cityInDistress->id);
 		
-		// Build path map.
-		shortestPathsBack(cityDatabase, cityInDistress, resB, resF, resW, resD, resM);
+		// Forget the results of the previous query.
+		clearResource(resB);
+		clearResource(resF);
+		clearResource(resW);
+		clearResource(resD);
+		clearResource(resM);
+		
+		// Build path map. Provider lists are searched once the resources wanted are known.
+		if(nearestCount == 1 && !tourCandidates) {
+			PHASE_BEGIN(PHASE_SEARCH);
+			shortestPathsBack(db, query, cityInDistress, resB, resF, resW, resD, resM);
+			PHASE_END(PHASE_SEARCH);
+		}
 		
 		while(1) {
 			printf("\nPlease input resources required with no spaces (B, F, W, D, or M) eg 'BFW': ");
@@ -153,7 +1224,41 @@ int main(int argc, const char * argv[])
 		}
 		
 		printf("\nFinding shortest paths to resources...\n-----------------------------\n\n");
-
+		
+		if(tourCandidates) {
+			PHASE_BEGIN(PHASE_SEARCH);
+			count = planTour(db, query, distances, cityInDistress, buffer, tourCandidates, &tour);
+			PHASE_END(PHASE_SEARCH);
+			
+			if(!count) {
+				writeMessage(results, "No tour can collect every resource requested.\n\n");
+			}
+			else {
+				writeMessage(results, "Pickup tour for resources %s ending at disaster zone %s (%ld)%s:\n\n", buffer, cityInDistress->name, cityInDistress->id, tour.exact ? "" : " (heuristic)");
+				for(y = 0; y < tour.stops; y++) {
+					count = 0;
+					for(r = 0; r < NUM_RESOURCES; r++) {
+						if(tour.collect[y] & (1 << r)) collected[count++] = RESOURCE_LETTERS[r];
+					}
+					collected[count] = '\0';
+					beginRoute(results, collected, tour.stop[y], y + 1 < tour.stops ? tour.stop[y + 1] : cityInDistress, "Leg %ld from city %s (%ld) collecting %s:\n", y + 1, tour.stop[y]->name, tour.stop[y]->id, collected);
+					writePath(results, db->graph, tourLeg(db, query, &tour, y, cityInDistress));
+				}
+				writeMessage(results, "Total Tour Distance: %ld hrs\n\n", tour.totalDistance);
+			}
+			flushResults(results);
+			printf("-----------------------------\n");
+			continue;
+		}
+		
+		if(nearestCount > 1) {
+			PHASE_BEGIN(PHASE_SEARCH);
+			nearestProviders(db, query, cityInDistress, buffer, nearestLists);
+			PHASE_END(PHASE_SEARCH);
+		}
+		
+		PHASE_BEGIN(PHASE_PRINT);
+		
 		// Print out the shortest paths to the resources
 		for(x = 0; x < buflen; x++) {
 			currentResource = buffer[x];
@@ -184,37 +1289,80 @@ int main(int argc, const char * argv[])
 					break;
 			}
 			
-			if(curResShortestRoute->city == NULL) {
-				printf("Resource %c is not available.\n\n", currentResource);
+			if(nearestCount > 1) {
+				providers = nearestLists[resourceIndex(currentResource)];
+				curResShortestRoute = providers->size > 0 ? providers->providers[0] : NULL;
+			}
+			
+			collected[0] = currentResource;
+			collected[1] = '\0';
+			
+			if(curResShortestRoute == NULL || curResShortestRoute->city == NULL) {
+				writeMessage(results, "Resource %c is not available.\n\n", currentResource);
 				continue;
 			}
 			
-			pathToResource = curResShortestRoute->path;
+			if(nearestCount > 1) {
+				for(y = 0; y < providers->size; y++) {
+					beginRoute(results, collected, providers->providers[y]->city, cityInDistress, "Path for resource %c from city %s (%ld) to disaster zone %s (%ld) [provider %ld of %ld]:\n", currentResource, providers->providers[y]->city->name, providers->providers[y]->city->id, cityInDistress->name, cityInDistress->id, y + 1, providers->size);
+					writePath(results, db->graph, providers->providers[y]->path);
+				}
+			}
+			else {
+				beginRoute(results, collected, curResShortestRoute->city, cityInDistress, "Path for resource %c from city %s (%ld) to disaster zone %s (%ld):\n", currentResource, curResShortestRoute->city->name, curResShortestRoute->city->id, cityInDistress->name, cityInDistress->id);
+				// The search behind shortestPathsBack is still in the query context until alternatives reuse it,
+				// but on a core graph its predecessors skip the contracted cities that the path has unpacked.
+				if(alternativeCount == 1 && db->core == NULL) writeSearchPath(results, db->graph, query, curResShortestRoute->city->index, SEARCH_BACKWARD);
+				else writePath(results, db->graph, curResShortestRoute->path);
+			}
 			
-			printf("Path for resource %c from city %s (%ld) to disaster zone %s (%ld):\n", currentResource, curResShortestRoute->city->name, curResShortestRoute->city->id, cityInDistress->name, cityInDistress->id);
-
-			for(y = 0; y < pathToResource->length; y++) {
-				if(pathToResource->path[y]->citypntr == NULL) {
-					currentCityName = CSearch(pathToResource->path[y]->cityid, cityDatabase)->cur->name;
+			if(alternativeCount > 1) {
+				PHASE_END(PHASE_PRINT);
+				PHASE_BEGIN(PHASE_SEARCH);
+				routeCount = alternativeRoutes(db, query, curResShortestRoute->city, cityInDistress, alternativeCount, routes);
+				PHASE_END(PHASE_SEARCH);
+				PHASE_BEGIN(PHASE_PRINT);
+				
+				for(y = 1; y < routeCount; y++) {
+					beginRoute(results, collected, curResShortestRoute->city, cityInDistress, "Alternative route %ld for resource %c from city %s (%ld) to disaster zone %s (%ld):\n", y + 1, currentResource, curResShortestRoute->city->name, curResShortestRoute->city->id, cityInDistress->name, cityInDistress->id);
+					writePath(results, db->graph, routes[y]);
 				}
-				else currentCityName = pathToResource->path[y]->citypntr->name;
-				printf("%d - City: %s (%lu) | Distance: %lu hrs\n", y + 1, currentCityName, pathToResource->path[y]->cityid, pathToResource->path[y]->distance);
+				if(routeCount < alternativeCount) writeMessage(results, "No further loop-free routes for resource %c.\n\n", currentResource);
+				for(y = 0; y < routeCount; y++) purgePath(routes[y]);
 			}
-			printf("Total Distance: %ld hrs\n\n", pathToResource->totalDistance);
 		}
+		flushResults(results);
 		printf("-----------------------------\n");
+		PHASE_END(PHASE_PRINT);
 		
 	}
-
+	
 	// Free all memory.
-	purgeSkipDict(cityNameDict);
-	free(cityNameDict);
+	freeSkipDict(cityNameDict);
 	free(buffer);
-	free(resB);
-	free(resF);
-	free(resW);
-	free(resD);
-	free(resM);
+	clearResource(resB);
+	clearResource(resF);
+	clearResource(resW);
+	clearResource(resD);
+	clearResource(resM);
+	memFree(resB);
+	memFree(resF);
+	memFree(resW);
+	memFree(resD);
+	memFree(resM);
+	for(x = 0; x < NUM_RESOURCES; x++) purgeProviderList(nearestLists[x]);
+	memFree(routes);
+	purgeProfiles(profiles);
+	purgeDeltaStepper(stepper);
+	purgeResultWriter(results);
+	purgeHubLabels(hubs);
+	purgeParetoFront(front);
+	purgeLabelPool(labels);
+	purgeIsochrone(reach);
+	purgeDistanceCache(distances);
+	purgeQueryContext(query);
+	unpinSnapshot(roads, reader);
+	purgeSnapshotStore(roads);
 	purgeDB(cityDatabase);
 	
     return 0;
@@ -0,0 +1,108 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h> //for LONG_MAX
+#include "reliefdb.h"
+#include "search.h"
+#include "matrix.h"
+#include "memacct.h"
+
+#define INF LONG_MAX
+
+/*
+ Creates a distance matrix for the given source and target city indexes.
+ The index lists are copied; the distances are left for fillDistanceMatrix.
+*/
+dmatrix* newDistanceMatrix(long int* sources, long int rows, long int* targets, long int cols)
+{
+	dmatrix* matrix = (dmatrix*)memAlloc(MEM_PATHS, sizeof(dmatrix));
+	
+	matrix->rows = rows;
+	matrix->cols = cols;
+	matrix->source = (long int*)memAlloc(MEM_PATHS, sizeof(long int) * (rows + 1));
+	matrix->target = (long int*)memAlloc(MEM_PATHS, sizeof(long int) * (cols + 1));
+	matrix->dist = (long int*)memAlloc(MEM_PATHS, sizeof(long int) * (rows * cols + 1));
+	memcpy(matrix->source, sources, sizeof(long int) * rows);
+	memcpy(matrix->target, targets, sizeof(long int) * cols);
+	
+	return matrix;
+}
+
+/*
+ Fills a distance matrix with one search per row or per column, whichever is fewer: forward from
+ each source when there are fewer sources, otherwise backward from each target.
+ 
+ Every search shares the one query context and stops as soon as it has settled every city on the
+ other side of the matrix, so a search only covers the part of the graph the batch needs.
+*/
+void fillDistanceMatrix(dmatrix* matrix, sgraph* graph, qctx* ctx)
+{
+	int forward = matrix->rows <= matrix->cols;
+	long int searches = forward ? matrix->rows : matrix->cols;
+	long int others = forward ? matrix->cols : matrix->rows;
+	long int* from = forward ? matrix->source : matrix->target;
+	long int* to = forward ? matrix->target : matrix->source;
+	char* wanted = (char*)memCalloc(MEM_SCRATCH, graph->size + 1, sizeof(char));
+	long int distinct = 0;
+	long int remaining;
+	long int city;
+	long int s;
+	long int t;
+	
+	// Mark the cities each search is looking for, counting each city once.
+	for(t = 0; t < others; t++) {
+		if(!wanted[to[t]]) distinct++;
+		wanted[to[t]] = 1;
+	}
+	
+	for(s = 0; s < searches; s++) {
+		remaining = distinct;
+		searchBegin(ctx);
+		searchSeed(ctx, from[s], 0);
+		
+		while(remaining > 0 && (city = searchNext(ctx, graph, forward ? SEARCH_FORWARD : SEARCH_BACKWARD)) != -1) {
+			if(wanted[city]) remaining--;
+		}
+		
+		for(t = 0; t < others; t++) {
+			if(forward) matrix->dist[s * matrix->cols + t] = searchDistance(ctx, to[t]);
+			else matrix->dist[t * matrix->cols + s] = searchDistance(ctx, to[t]);
+		}
+	}
+	
+	memFree(wanted);
+}
+
+/*
+ Writes the index of every city that has at least one of the given resources into cities, which
+ must have room for every city in the graph. Cities are listed in database order, whatever order
+ the graph keeps them in.
+ 
+ Returns the number of cities written.
+*/
+long int providerCities(sgraph* graph, char* resources, long int* cities)
+{
+	unsigned char wanted = 0;
+	long int count = 0;
+	long int x;
+	int y;
+	
+	for(y = 0; resources[y] != '\0'; y++) {
+		if(resourceIndex(resources[y]) != -1) wanted |= 1 << resourceIndex(resources[y]);
+	}
+	
+	for(x = 0; x < graph->size; x++) {
+		if(graph->resources[graph->loadOrder[x]] & wanted) cities[count++] = graph->loadOrder[x];
+	}
+	
+	return count;
+}
+
+void purgeDistanceMatrix(dmatrix* matrix)
+{
+	if(matrix == NULL) return;
+	memFree(matrix->source);
+	memFree(matrix->target);
+	memFree(matrix->dist);
+	memFree(matrix);
+}
@@ -0,0 +1,30 @@
+#include "reliefdb.h"
+#include "search.h"
+
+#ifndef matrix_h
+#define matrix_h
+
+/*
+ A distance matrix holds the distance from each of a set of source cities
+ (usually providers) to each of a set of target cities (usually cities in
+ distress).
+ 
+ - rows and cols are the number of sources and targets.
+ - source and target hold their city indexes.
+ - dist is dense and row-major: dist[s * cols + t] is the distance from
+   source s to target t, or INF if it cannot be reached.
+*/
+typedef struct distancematrix {
+	long int rows;
+	long int cols;
+	long int* source;
+	long int* target;
+	long int* dist;
+} dmatrix;
+
+dmatrix* newDistanceMatrix(long int* sources, long int rows, long int* targets, long int cols);
+void fillDistanceMatrix(dmatrix* matrix, sgraph* graph, qctx* ctx);
+long int providerCities(sgraph* graph, char* resources, long int* cities);
+void purgeDistanceMatrix(dmatrix* matrix);
+
+#endif
@@ -0,0 +1,163 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include "memacct.h"
+#include "strlib.h"
+#include "stats.h"
+
+/*
+ The header sits in front of every tracked block. The union pads it out so
+ the block handed back to the caller keeps malloc's alignment.
+*/
+typedef union memheader {
+	struct {
+		size_t size;
+		int domain;
+	} info;
+	max_align_t align;
+} memheader;
+
+static const char* domainNames[MEM_DOMAINS] = {
+	"graph", "names", "paths", "scratch"
+};
+
+/*
+ The counts are atomic as a road update thread allocates while queries run.
+*/
+static atomic_long liveBytes[MEM_DOMAINS];
+static atomic_long peakBytes[MEM_DOMAINS];
+static atomic_long liveBlocks[MEM_DOMAINS];
+
+/*
+ Adds size bytes to a domain and updates its peak.
+*/
+static void charge(int domain, size_t size)
+{
+	long int live = atomic_fetch_add_explicit(&liveBytes[domain], (long int)size, memory_order_relaxed) + (long int)size;
+	long int peak = atomic_load_explicit(&peakBytes[domain], memory_order_relaxed);
+	
+	atomic_fetch_add_explicit(&liveBlocks[domain], 1, memory_order_relaxed);
+	while(live > peak && !atomic_compare_exchange_weak_explicit(&peakBytes[domain], &peak, live, memory_order_relaxed, memory_order_relaxed));
+	STAT_ADD(STAT_BYTES, size);
+}
+
+/*
+ Gives size bytes of one block back to a domain.
+*/
+static void discharge(int domain, size_t size)
+{
+	atomic_fetch_sub_explicit(&liveBytes[domain], (long int)size, memory_order_relaxed);
+	atomic_fetch_sub_explicit(&liveBlocks[domain], 1, memory_order_relaxed);
+}
+
+/*
+ Allocates size bytes charged to the given domain.
+ 
+ Returns the new block, or NULL if the allocation failed.
+*/
+void* memAlloc(int domain, size_t size)
+{
+	memheader* head = (memheader*)malloc(sizeof(memheader) + size);
+	if(head == NULL) return NULL;
+	
+	head->info.size = size;
+	head->info.domain = domain;
+	charge(domain, size);
+	
+	return head + 1;
+}
+
+/*
+ Allocates a zeroed array of count elements charged to the given domain.
+*/
+void* memCalloc(int domain, size_t count, size_t size)
+{
+	void* block = memAlloc(domain, count * size);
+	if(block != NULL) memset(block, 0, count * size);
+	return block;
+}
+
+/*
+ Resizes a tracked block, keeping its domain.
+ A NULL block is not allowed here as it has no domain; use memAlloc first.
+*/
+void* memRealloc(void* ptr, size_t size)
+{
+	memheader* head = (memheader*)ptr - 1;
+	int domain = head->info.domain;
+	size_t old = head->info.size;
+	
+	head = (memheader*)realloc(head, sizeof(memheader) + size);
+	if(head == NULL) return NULL;
+	
+	discharge(domain, old);
+	head->info.size = size;
+	charge(domain, size);
+	
+	return head + 1;
+}
+
+/*
+ Frees a tracked block and gives its bytes back to its domain.
+*/
+void memFree(void* ptr)
+{
+	if(ptr == NULL) return;
+	
+	memheader* head = (memheader*)ptr - 1;
+	discharge(head->info.domain, head->info.size);
+	free(head);
+}
+
+/*
+ Tracked equivalent of cpystr.
+ 
+ Returns the new copied string, or NULL if the string pointer is NULL.
+*/
+char* memStrdup(int domain, char* str)
+{
+	if(str == NULL) return NULL;
+	
+	int ln = lengthof(str);
+	char* retstr = (char*)memAlloc(domain, ln + 1);
+	
+	memcpy(retstr, str, ln);
+	retstr[ln] = '\0';
+	
+	return retstr;
+}
+
+/*
+ Returns the number of bytes currently allocated in a domain.
+*/
+long int memLive(int domain)
+{
+	return atomic_load_explicit(&liveBytes[domain], memory_order_relaxed);
+}
+
+/*
+ Returns the largest number of bytes a domain has held at once.
+*/
+long int memPeak(int domain)
+{
+	return atomic_load_explicit(&peakBytes[domain], memory_order_relaxed);
+}
+
+/*
+ Prints the live and peak usage of every domain.
+*/
+void printMemReport(FILE* out)
+{
+	int x;
+	long int live = 0;
+	long int peak = 0;
+	
+	fprintf(out, "%-8s %12s %12s %8s\n", "domain", "live", "peak", "blocks");
+	for(x = 0; x < MEM_DOMAINS; x++) {
+		fprintf(out, "%-8s %12ld %12ld %8ld\n", domainNames[x], memLive(x), memPeak(x), atomic_load_explicit(&liveBlocks[x], memory_order_relaxed));
+		live += memLive(x);
+		peak += memPeak(x);
+	}
+	fprintf(out, "%-8s %12ld %12ld\n", "total", live, peak);
+}
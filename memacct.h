@@ -0,0 +1,34 @@
+#include <stdio.h>
+#include <stddef.h>
+
+#ifndef memacct_h
+#define memacct_h
+
+/*
+ Tracked allocation domains.
+ 
+ Every long-lived structure is allocated through memAlloc with the domain it
+ belongs to, so the live and peak byte counts of each subsystem can be
+ reported at any time. Each block carries a small header recording its size
+ and domain, which lets memFree give the bytes back to the right domain.
+*/
+
+enum memDomain {
+	MEM_GRAPH,		// Cities, travel tables and the database itself.
+	MEM_NAMES,		// The city name dictionary.
+	MEM_PATHS,		// Resource paths kept between queries.
+	MEM_SCRATCH,	// Per-query working space.
+	MEM_DOMAINS
+};
+
+void* memAlloc(int domain, size_t size);
+void* memCalloc(int domain, size_t count, size_t size);
+void* memRealloc(void* ptr, size_t size);
+void memFree(void* ptr);
+char* memStrdup(int domain, char* str);
+
+long int memLive(int domain);
+long int memPeak(int domain);
+void printMemReport(FILE* out);
+
+#endif
@@ -1,8 +1,15 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <limits.h> //for LONG_MAX
 #include "strlib.h"
 #include "reliefdb.h"
 #include "objects.h"
+#include "memacct.h"
+#include "stats.h"
+
+#define INF LONG_MAX
 
 //////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 ///////////////////////////////////////////////////////////////////////////CONSTRUCTORS///////////////////////////////////////////////////////////////////////////////////
@@ -16,11 +23,13 @@
  */
 cdb* newCDB(char* name)
 {
-	cdb* cityDB = (cdb*)malloc(sizeof(cdb));
+	cdb* cityDB = (cdb*)memAlloc(MEM_GRAPH, sizeof(cdb));
 	
-	cityDB->groupname = cpystr(name);
+	cityDB->groupname = memStrdup(MEM_GRAPH, name);
 	cityDB->ctsize = 0;
 	cityDB->chead = NULL;
+	cityDB->graph = NULL;
+	cityDB->core = NULL;
 	
 	return cityDB;
 }
@@ -31,7 +40,7 @@ cdb* newCDB(char* name)
 */
 cdbn* newCDBNode(cdb* db, cn* cur, cdbn* prev, cdbn* next)
 {
-	cdbn* newNode = (cdbn*)malloc(sizeof(cdbn));
+	cdbn* newNode = (cdbn*)memAlloc(MEM_GRAPH, sizeof(cdbn));
 	
 	newNode->cur = cur;
 	newNode->prev = prev;
@@ -47,17 +56,54 @@ cdbn* newCDBNode(cdb* db, cn* cur, cdbn* prev, cdbn* next)
 */
 cn* newCNode(long int id, char* nm, char* resources)
 {
-	cn* node = (cn*)malloc(sizeof(cn));
+	cn* node = (cn*)memAlloc(MEM_GRAPH, sizeof(cn));
 	
 	node->id = id;
-	node->name = cpystr(nm);
-	node->resources = cpystr(resources);
+	node->index = -1;
+	node->name = memStrdup(MEM_GRAPH, nm);
+	node->resources = NULL;
 	node->ttsize = 0;
 	node->goes_to = NULL;
+	setCityResources(node, resources);
 	
 	return node;
 }
 
+/*
+ Replaces a city's resources string, and reads the stock level after each resource letter, if
+ there is one.
+*/
+void setCityResources(cn* node, char* resources)
+{
+	int x;
+	int r;
+	
+	memFree(node->resources);
+	node->resources = memStrdup(MEM_GRAPH, resources);
+	for(r = 0; r < NUM_RESOURCES; r++) node->stock[r] = 0;
+	for(x = 0; node->resources != NULL && node->resources[x] != '\0'; x++) {
+		if((r = resourceIndex(node->resources[x])) == -1) continue;
+		node->stock[r] = isdigit(node->resources[x + 1]) ? atol(node->resources + x + 1) : STOCK_UNLIMITED;
+	}
+}
+
+/*
+ Returns a bit per RESOURCE_LETTERS position for every resource a city can supply. A letter
+ with a stock level of 0 ("B0") is listed but has run out, so it is left out: searches never
+ route to it as a provider, as the allocator would give nothing from it.
+*/
+unsigned char cityOffers(cn* node)
+{
+	unsigned char offers = 0;
+	int r;
+	
+	for(r = 0; r < NUM_RESOURCES; r++) {
+		if(node->stock[r] != 0) offers |= 1 << r;
+	}
+	
+	return offers;
+}
+
 /*
  Constructs a new travel table node with the information given.
  The citypntr is not allocated here, instead being allocated elsewhere
@@ -65,38 +111,43 @@ cn* newCNode(long int id, char* nm, char* resources)
 */
 tt* newTTable(long int cityid, long int distance)
 {
-	tt* table = (tt*)malloc(sizeof(tt));
+	tt* table = (tt*)memAlloc(MEM_GRAPH, sizeof(tt));
 	
 	table->citypntr = NULL;
 	table->cityid = cityid;
 	table->distance = distance;
+	table->risk = 0;
 	
 	return table;
 }
 
 /*
- Constructs a new empty map.
+ Constructs a new cpath with the information given.
+ The running totals are left for whoever fills in the travel tables.
 */
-map* newMap()
+cpath* newPath(long int id, long int tdist, long int length, tt** travelTable)
 {
-	map* newMap = (map*)malloc(sizeof(map));
+	cpath* path = (cpath*)memAlloc(MEM_PATHS, sizeof(cpath));
 	
-	newMap->directions = NULL;
+	path->endID = id;
+	path->totalDistance = tdist;
+	path->length = length;
+	path->capacity = length;
+	path->path = travelTable;
+	path->prefix = (long int*)memAlloc(MEM_PATHS, sizeof(long int) * (length + 1));
 	
-	return newMap;
+	return path;
 }
 
 /*
- Constructs a new cpath with the information given.
+ Constructs an empty cpath with room for capacity hops, to be grown with pathPush.
 */
-cpath* newPath(long int id, long int tdist, long int length, tt** travelTable)
+cpath* newEmptyPath(long int capacity)
 {
-	cpath* path = (cpath*)malloc(sizeof(cpath));
+	cpath* path = newPath(-1, 0, 0, (tt**)memCalloc(MEM_PATHS, capacity + 1, sizeof(tt*)));
 	
-	path->endID = id;
-	path->totalDistance = tdist;
-	path->length = length;
-	path->path = travelTable;
+	path->capacity = capacity;
+	path->prefix = (long int*)memRealloc(path->prefix, sizeof(long int) * (capacity + 1));
 	
 	return path;
 }
@@ -108,7 +159,7 @@ cpath* newPath(long int id, long int tdist, long int length, tt** travelTable)
 */
 rsc* newResource(cn* city, long int dist, cpath* path)
 {
-	rsc* res = (rsc*)malloc(sizeof(rsc));
+	rsc* res = (rsc*)memAlloc(MEM_PATHS, sizeof(rsc));
 	
 	res->city = city;
 	res->totalDistance = dist;
@@ -121,15 +172,31 @@ rsc* newResource(cn* city, long int dist, cpath* path)
 ///////////////////////////////////////////////////////////////////////////COPY METHODS//////////////////////////////////////////////////////////////////////////////////
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
+/*
+ Returns a copy of a city node with its own resources string and stock, sharing its name and
+ travel tables with the node copied, so one version of the database can have other stock
+ levels than another. Free it by freeing its resources string and then the copy itself.
+*/
+cn* copyCNode(cn* node)
+{
+	cn* newNode = (cn*)memAlloc(MEM_GRAPH, sizeof(cn));
+	
+	*newNode = *node;
+	newNode->resources = memStrdup(MEM_GRAPH, node->resources);
+	
+	return newNode;
+}
+
 /*
  Returns a deep copy of a traveltable
 */
 tt* copyTT(tt* ttToCopy)
 {
-	tt* newTT = (tt*)malloc(sizeof(tt));
+	tt* newTT = (tt*)memAlloc(MEM_PATHS, sizeof(tt));
 	newTT->citypntr = ttToCopy->citypntr;
 	newTT->cityid = ttToCopy->cityid;
 	newTT->distance = ttToCopy->distance;
+	newTT->risk = ttToCopy->risk;
 	
 	return newTT;
 }
@@ -140,12 +207,16 @@ tt* copyTT(tt* ttToCopy)
 */
 cpath* copyPath(cpath* pathToCopy)
 {
-	cpath* newPath = (cpath*)malloc(sizeof(cpath));
+	cpath* newPath = (cpath*)memAlloc(MEM_PATHS, sizeof(cpath));
+	STAT_INC(STAT_PATHCOPIES);
 	
 	newPath->endID = pathToCopy->endID;
 	newPath->totalDistance = pathToCopy->totalDistance;
 	newPath->length = pathToCopy->length;
-	newPath->path = (tt**)malloc(sizeof(tt*) * newPath->length);
+	newPath->capacity = pathToCopy->length;
+	newPath->path = (tt**)memAlloc(MEM_PATHS, sizeof(tt*) * newPath->length);
+	newPath->prefix = (long int*)memAlloc(MEM_PATHS, sizeof(long int) * (newPath->length + 1));
+	memcpy(newPath->prefix, pathToCopy->prefix, sizeof(long int) * newPath->length);
 	
 	
 	int x;
@@ -162,13 +233,21 @@ cpath* copyPath(cpath* pathToCopy)
 
 
 /*
- Initialises a path's travel table array to default.
+ Initialises a path's travel table array to default, giving it room for length hops.
+ These travel tables are working space for a search, so they are charged
+ to the scratch domain.
 */
 void initPathTT(cpath* path, long int length)
 {
 	long int x;
+	path->capacity = length;
+	path->prefix = (long int*)memRealloc(path->prefix, sizeof(long int) * (length + 1));
 	for (x = 0; x < length; x++) {
-		path->path[x] = newTTable(-1, 0);
+		path->path[x] = (tt*)memAlloc(MEM_SCRATCH, sizeof(tt));
+		path->path[x]->citypntr = NULL;
+		path->path[x]->cityid = -1;
+		path->path[x]->distance = 0;
+		path->path[x]->risk = 0;
 	}
 }
 
@@ -180,6 +259,44 @@ void setTravelTable(tt* tt, cn* city, long int dist)
 	tt->cityid = city->id;
 	tt->citypntr = city;
 	tt->distance = dist;
+	tt->risk = 0;
+}
+
+/*
+ Extends a path by one hop to the given city, the travel table taken there being distance long.
+ The running totals are carried forward, so this is O(1) however long the path is; the arrays
+ double when full, and travel tables left behind by pathPop are reused.
+*/
+void pathPush(cpath* path, cn* city, long int distance)
+{
+	long int x;
+	
+	if(path->length == path->capacity) {
+		path->capacity = path->capacity * 2 + 1;
+		path->path = (tt**)memRealloc(path->path, sizeof(tt*) * (path->capacity + 1));
+		path->prefix = (long int*)memRealloc(path->prefix, sizeof(long int) * (path->capacity + 1));
+		for(x = path->length; x < path->capacity; x++) path->path[x] = NULL;
+	}
+	if(path->path[path->length] == NULL) path->path[path->length] = (tt*)memAlloc(MEM_PATHS, sizeof(tt));
+	
+	setTravelTable(path->path[path->length], city, distance);
+	if(path->length == 0) path->totalDistance = distance;
+	else if(path->prefix[path->length - 1] >= INF - distance) path->totalDistance = INF;
+	else path->totalDistance = path->prefix[path->length - 1] + distance;
+	path->prefix[path->length] = path->totalDistance;
+	path->endID = city->id;
+	path->length++;
+}
+
+/*
+ Takes the last hop off a path in O(1), keeping its travel table for the next push.
+*/
+void pathPop(cpath* path)
+{
+	if(path->length == 0) return;
+	path->length--;
+	path->totalDistance = path->length == 0 ? 0 : path->prefix[path->length - 1];
+	path->endID = path->length == 0 ? -1 : path->path[path->length - 1]->cityid;
 }
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
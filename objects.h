@@ -6,16 +6,21 @@
 cdb* newCDB(char* name);
 cdbn* newCDBNode(cdb* db, cn* cur, cdbn* prev, cdbn* next);
 cn* newCNode(long int id, char* nm, char* resources);
+void setCityResources(cn* node, char* resources);
+unsigned char cityOffers(cn* node);
 tt* newTTable(long int cityid, long int distance);
-map* newMap();
 cpath* newPath(long int id, long int tdist, long int length, tt** travelTable);
+cpath* newEmptyPath(long int capacity);
 rsc* newResource(cn* city, long int dist, cpath* path);
 
+cn* copyCNode(cn* node);
 tt* copyTT(tt* ttToCopy);
 cpath* copyPath(cpath* pathToCopy);
 
 void initPathTT(cpath* path, long int length);
 void setTravelTable(tt* tt, cn* city, long int dist);
+void pathPush(cpath* path, cn* city, long int distance);
+void pathPop(cpath* path);
 
 void cdbAdd(cdb* db, cn* node);
 
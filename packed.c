@@ -0,0 +1,299 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "reliefdb.h"
+#include "search.h"
+#include "packed.h"
+#include "memacct.h"
+
+/*
+ Compares two edges by the city at their far end, then by edge number so the order is the same on every run.
+*/
+static long int* sortTargets;
+static int compareTargets(const void* a, const void* b)
+{
+	long int x = *(const long int*)a;
+	long int y = *(const long int*)b;
+	if(sortTargets[x] != sortTargets[y]) return (sortTargets[x] > sortTargets[y]) - (sortTargets[x] < sortTargets[y]);
+	return (x > y) - (x < y);
+}
+
+/*
+ Returns the number of bits needed to hold every value up to and including the given one.
+*/
+static int bitsFor(dist_t largest)
+{
+	int bits = 0;
+	
+	while(bits < 63 && ((uint64_t)largest >> bits) != 0) bits++;
+	
+	return bits;
+}
+
+/*
+ Works out the width of a packed weight field from its largest finite weight, and the value
+ standing for DIST_INF if there are any (see padj).
+*/
+static int fieldFor(dist_t largest, int infinite, uint64_t* inf)
+{
+	int bits = bitsFor(infinite ? largest + 1 : largest);
+	
+	*inf = infinite ? (1ULL << bits) - 1 : UINT64_MAX;
+	
+	return bits;
+}
+
+/*
+ Stores a value of the given width at a bit offset into zeroed words.
+*/
+static void writeBits(uint64_t* words, uint64_t bit, int width, uint64_t value)
+{
+	uint64_t word = bit >> 6;
+	int shift = bit & 63;
+	
+	if(width == 0) return;
+	words[word] |= value << shift;
+	if(shift + width > 64) words[word + 1] |= value >> (64 - shift);
+}
+
+/*
+ Returns the value of the given width at a bit offset.
+*/
+static inline uint64_t readBits(const uint64_t* words, uint64_t bit, int width)
+{
+	uint64_t word = bit >> 6;
+	int shift = bit & 63;
+	uint64_t value = words[word] >> shift;
+	
+	if(shift + width > 64) value |= words[word + 1] << (64 - shift);
+	
+	return value & ((1ULL << width) - 1);
+}
+
+/*
+ Writes a value as a LEB128 varint, seven bits to a byte, low bits first.
+ 
+ Returns the number of bytes written.
+*/
+static long int putVarint(unsigned char* at, unsigned long value)
+{
+	long int length = 0;
+	
+	while(value >= 0x80) {
+		at[length++] = (unsigned char)(value | 0x80);
+		value >>= 7;
+	}
+	at[length++] = (unsigned char)value;
+	
+	return length;
+}
+
+/*
+ Sorts every city's run of edges by the city at their far end, moving the weights, risks and
+ chains (if any) along with them.
+*/
+static void sortRuns(long int size, long int* start, long int* to, dist_t* dist, dist_t* risk, long int* via)
+{
+	long int* order = (long int*)memAlloc(MEM_SCRATCH, sizeof(long int) * (start[size] + 1));
+	long int* toCopy = (long int*)memAlloc(MEM_SCRATCH, sizeof(long int) * (start[size] + 1));
+	dist_t* distCopy = (dist_t*)memAlloc(MEM_SCRATCH, sizeof(dist_t) * (start[size] + 1));
+	dist_t* riskCopy = (dist_t*)memAlloc(MEM_SCRATCH, sizeof(dist_t) * (start[size] + 1));
+	long int* viaCopy = (long int*)memAlloc(MEM_SCRATCH, sizeof(long int) * (start[size] + 1));
+	long int city;
+	long int e;
+	
+	for(e = 0; e < start[size]; e++) order[e] = e;
+	sortTargets = to;
+	for(city = 0; city < size; city++) {
+		if(start[city + 1] - start[city] > 1) qsort(order + start[city], start[city + 1] - start[city], sizeof(long int), compareTargets);
+	}
+	
+	for(e = 0; e < start[size]; e++) {
+		toCopy[e] = to[order[e]];
+		distCopy[e] = dist[order[e]];
+		riskCopy[e] = risk[order[e]];
+		if(via != NULL) viaCopy[e] = via[order[e]];
+	}
+	memcpy(to, toCopy, sizeof(long int) * start[size]);
+	memcpy(dist, distCopy, sizeof(dist_t) * start[size]);
+	memcpy(risk, riskCopy, sizeof(dist_t) * start[size]);
+	if(via != NULL) memcpy(via, viaCopy, sizeof(long int) * start[size]);
+	
+	memFree(order);
+	memFree(toCopy);
+	memFree(distCopy);
+	memFree(riskCopy);
+	memFree(viaCopy);
+}
+
+/*
+ Packs one direction of a graph's travel tables, which must already be sorted by sortRuns.
+ 
+ Returns the packed travel tables, or NULL if they cannot be packed: a weight is negative, or
+ the ids would not fit the 32 bit offsets.
+*/
+static padj* packRuns(long int size, long int* start, long int* to, dist_t* dist, dist_t* risk)
+{
+	long int edges = start[size];
+	dist_t largestDist = 0;
+	dist_t largestRisk = 0;
+	int infiniteDist = 0;
+	int infiniteRisk = 0;
+	long int distWords;
+	long int bytes = 0;
+	long int city;
+	long int prev;
+	long int gap;
+	long int e;
+	padj* packed;
+	
+	for(e = 0; e < edges; e++) {
+		if(dist[e] < 0 || risk[e] < 0) return NULL;
+		if(dist[e] == DIST_INF) infiniteDist = 1;
+		else if(dist[e] > largestDist) largestDist = dist[e];
+		if(risk[e] == DIST_INF) infiniteRisk = 1;
+		else if(risk[e] > largestRisk) largestRisk = risk[e];
+	}
+	
+	packed = (padj*)memAlloc(MEM_GRAPH, sizeof(padj));
+	packed->distBits = fieldFor(largestDist, infiniteDist, &packed->distInf);
+	packed->riskBits = fieldFor(largestRisk, infiniteRisk, &packed->riskInf);
+	distWords = (edges * packed->distBits + 63) / 64 + 1;
+	packed->words = distWords + (edges * packed->riskBits + 63) / 64 + 1;
+	packed->offset = (uint32_t*)memAlloc(MEM_GRAPH, sizeof(uint32_t) * (size + 1));
+	packed->ids = (unsigned char*)memAlloc(MEM_GRAPH, 10 * edges + 1);
+	packed->dist = (uint64_t*)memCalloc(MEM_GRAPH, packed->words, sizeof(uint64_t));
+	packed->risk = packed->dist + distWords;
+	
+	for(city = 0; city < size; city++) {
+		if(bytes > UINT32_MAX) break;
+		packed->offset[city] = (uint32_t)bytes;
+		for(e = start[city], prev = city; e < start[city + 1]; prev = to[e], e++) {
+			gap = to[e] - prev;
+			// The first gap may be negative, so it is zigzagged; sorting keeps the others positive.
+			bytes += putVarint(packed->ids + bytes, e == start[city] ? ((unsigned long)gap << 1) ^ (unsigned long)(gap >> 63) : (unsigned long)gap);
+			writeBits(packed->dist, e * packed->distBits, packed->distBits, dist[e] == DIST_INF ? packed->distInf : (uint64_t)dist[e]);
+			writeBits(packed->risk, e * packed->riskBits, packed->riskBits, risk[e] == DIST_INF ? packed->riskInf : (uint64_t)risk[e]);
+		}
+	}
+	if(bytes > UINT32_MAX) {
+		purgePackedAdjacency(packed);
+		return NULL;
+	}
+	packed->offset[size] = (uint32_t)bytes;
+	packed->bytes = bytes;
+	packed->ids = (unsigned char*)memRealloc(packed->ids, bytes + 1);
+	
+	return packed;
+}
+
+/*
+ Packs a search graph's travel tables in place to save memory (see padj), freeing the plain
+ arrays. Each city's edges are sorted by the city at their far end first, so edge numbers
+ change; anything keyed by edge number, such as travel time profiles, must be made afterwards.
+ Shortcuts in a simplified graph keep their chains. A graph that is already packed is left as
+ it is.
+ 
+ Searches then decode each city's edges as they reach it, through searchEdges.
+ 
+ Returns 1 if the graph is packed, 0 if it could not be and was left plain.
+*/
+int packSearchGraph(sgraph* graph)
+{
+	if(graph->outPacked != NULL) return 1;
+	
+	sortRuns(graph->size, graph->outStart, graph->outTo, graph->outDist, graph->outRisk, graph->outVia);
+	sortRuns(graph->size, graph->inStart, graph->inFrom, graph->inDist, graph->inRisk, graph->inVia);
+	
+	graph->outPacked = packRuns(graph->size, graph->outStart, graph->outTo, graph->outDist, graph->outRisk);
+	graph->inPacked = graph->outPacked == NULL ? NULL : packRuns(graph->size, graph->inStart, graph->inFrom, graph->inDist, graph->inRisk);
+	if(graph->inPacked == NULL) {
+		purgePackedAdjacency(graph->outPacked);
+		graph->outPacked = NULL;
+		return 0;
+	}
+	
+	memFree(graph->outTo);
+	memFree(graph->outDist);
+	memFree(graph->outRisk);
+	memFree(graph->inFrom);
+	memFree(graph->inDist);
+	memFree(graph->inRisk);
+	graph->outTo = NULL;
+	graph->outDist = NULL;
+	graph->outRisk = NULL;
+	graph->inFrom = NULL;
+	graph->inDist = NULL;
+	graph->inRisk = NULL;
+	
+	return 1;
+}
+
+void purgePackedAdjacency(padj* packed)
+{
+	if(packed == NULL) return;
+	memFree(packed->ids);
+	memFree(packed->offset);
+	memFree(packed->dist);
+	memFree(packed);
+}
+
+/*
+ Decodes the count edges of a city, numbered from first, into to and dist, and into risk too if
+ risks is 1. Single byte gaps, the usual case, skip the varint loop.
+*/
+void unpackEdges(padj* packed, long int city, long int first, long int count, int risks, long int* to, dist_t* dist, dist_t* risk)
+{
+	const unsigned char* at = packed->ids + packed->offset[city];
+	unsigned long value;
+	long int prev = city;
+	int shift;
+	long int k;
+	
+	for(k = 0; k < count; k++) {
+		value = *at++;
+		if(value >= 0x80) {
+			value &= 0x7f;
+			shift = 7;
+			do {
+				value |= (unsigned long)(*at & 0x7f) << shift;
+				shift += 7;
+			} while(*at++ >= 0x80);
+		}
+		prev += k == 0 ? (long int)(value >> 1) ^ -(long int)(value & 1) : (long int)value;
+		to[k] = prev;
+	}
+	
+	for(k = 0; k < count; k++) {
+		value = readBits(packed->dist, (first + k) * packed->distBits, packed->distBits);
+		dist[k] = value == packed->distInf ? DIST_INF : (dist_t)value;
+	}
+	if(!risks) return;
+	for(k = 0; k < count; k++) {
+		value = readBits(packed->risk, (first + k) * packed->riskBits, packed->riskBits);
+		risk[k] = value == packed->riskInf ? DIST_INF : (dist_t)value;
+	}
+}
+
+/*
+ Returns the bytes a graph's travel tables take in both directions, as they are held now.
+ Chains of shortcuts are not counted.
+*/
+long int adjacencyBytes(sgraph* graph)
+{
+	if(graph->outPacked == NULL) return plainAdjacencyBytes(graph);
+	
+	return 2 * (long int)sizeof(long int) * (graph->size + 1)
+		+ 2 * (long int)sizeof(uint32_t) * (graph->size + 1)
+		+ graph->outPacked->bytes + graph->inPacked->bytes
+		+ (long int)sizeof(uint64_t) * (graph->outPacked->words + graph->inPacked->words);
+}
+
+/*
+ Returns the bytes a graph's travel tables take, or would take, unpacked.
+*/
+long int plainAdjacencyBytes(sgraph* graph)
+{
+	return 2 * (long int)sizeof(long int) * (graph->size + 1)
+		+ 2 * ((long int)sizeof(long int) + 2 * (long int)sizeof(dist_t)) * graph->edges;
+}
@@ -0,0 +1,48 @@
+#include <stdint.h>
+#include "reliefdb.h"
+#include "search.h"
+
+#ifndef packed_h
+#define packed_h
+
+/*
+ One direction of a packed search graph's travel tables.
+ 
+ Each city's edges are sorted by the city at their far end, and those cities
+ are stored as LEB128 varints in ids: the first as the zigzagged difference
+ from the city itself, every other as the gap from the one before, so on a
+ well ordered graph most take a single byte. The run for city i starts at
+ byte offset[i].
+ 
+ Distances and risks are bit-packed at a fixed width each, distBits and
+ riskBits, just wide enough for the largest; edge e's distance is the
+ distBits bits starting at bit e * distBits of dist. Edges are numbered by
+ the graph's outStart and inStart as usual, so no offsets are needed here.
+ Weights of DIST_INF (closed roads) do not widen the fields: if there are
+ any, the all-ones value one bit wider than the largest needs, held in
+ distInf or riskInf, stands for them. Otherwise those are UINT64_MAX, which
+ no field can hold.
+ 
+ - bytes is the length of ids, words the length of dist and risk together.
+*/
+typedef struct packedadjacency {
+	unsigned char* ids;
+	uint32_t* offset;
+	uint64_t* dist;
+	uint64_t* risk;
+	int distBits;
+	int riskBits;
+	uint64_t distInf;
+	uint64_t riskInf;
+	long int bytes;
+	long int words;
+} padj;
+
+int packSearchGraph(sgraph* graph);
+void purgePackedAdjacency(padj* packed);
+void unpackEdges(padj* packed, long int city, long int first, long int count, int risks, long int* to, dist_t* dist, dist_t* risk);
+
+long int adjacencyBytes(sgraph* graph);
+long int plainAdjacencyBytes(sgraph* graph);
+
+#endif
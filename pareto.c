@@ -0,0 +1,362 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h> //for LONG_MAX
+#include "reliefdb.h"
+#include "objects.h"
+#include "search.h"
+#include "pareto.h"
+#include "memacct.h"
+#include "stats.h"
+
+#define INF LONG_MAX
+#define MIN_LABELS 1024
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////LABEL POOL/////////////////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/*
+ Creates a label pool for a graph of the given size, with room for MIN_LABELS labels to start.
+*/
+lpool* newLabelPool(long int size)
+{
+	lpool* pool = (lpool*)memAlloc(MEM_SCRATCH, sizeof(lpool));
+	
+	pool->size = size;
+	pool->count = 0;
+	pool->capacity = MIN_LABELS;
+	pool->labels = (label*)memAlloc(MEM_SCRATCH, sizeof(label) * pool->capacity);
+	pool->heapSize = 0;
+	pool->heapCapacity = MIN_LABELS;
+	pool->heap = (long int*)memAlloc(MEM_SCRATCH, sizeof(long int) * pool->heapCapacity);
+	pool->version = 0;
+	pool->stamp = (unsigned int*)memCalloc(MEM_SCRATCH, size + 1, sizeof(unsigned int));
+	pool->bestRisk = (dist_t*)memAlloc(MEM_SCRATCH, sizeof(dist_t) * (size + 1));
+	pool->lowDist = (dist_t*)memAlloc(MEM_SCRATCH, sizeof(dist_t) * (size + 1));
+	pool->lowRisk = (dist_t*)memAlloc(MEM_SCRATCH, sizeof(dist_t) * (size + 1));
+	
+	return pool;
+}
+
+void purgeLabelPool(lpool* pool)
+{
+	if(pool == NULL) return;
+	memFree(pool->labels);
+	memFree(pool->heap);
+	memFree(pool->stamp);
+	memFree(pool->bestRisk);
+	memFree(pool->lowDist);
+	memFree(pool->lowRisk);
+	memFree(pool);
+}
+
+/*
+ Returns the lowest risk settled at a city by the current query, or DIST_INF if none has been.
+*/
+static dist_t bestRisk(lpool* pool, long int city)
+{
+	return pool->stamp[city] == pool->version ? pool->bestRisk[city] : DIST_INF;
+}
+
+/*
+ Returns 1 if label a comes before label b: counting the distance still to go, it is shorter,
+ or as short and safer.
+*/
+static int labelBefore(lpool* pool, long int a, long int b)
+{
+	dist_t distA = distAdd(pool->labels[a].dist, pool->lowDist[pool->labels[a].city]);
+	dist_t distB = distAdd(pool->labels[b].dist, pool->lowDist[pool->labels[b].city]);
+	
+	if(distA != distB) return distA < distB;
+	return distAdd(pool->labels[a].risk, pool->lowRisk[pool->labels[a].city]) < distAdd(pool->labels[b].risk, pool->lowRisk[pool->labels[b].city]);
+}
+
+/*
+ Takes a new label from the pool and puts it on the heap.
+*/
+static void pushLabel(lpool* pool, long int city, dist_t dist, dist_t risk, long int parent)
+{
+	long int slot;
+	long int up;
+	long int n;
+	
+	if(pool->count == pool->capacity) {
+		pool->capacity *= 2;
+		pool->labels = (label*)memRealloc(pool->labels, sizeof(label) * pool->capacity);
+	}
+	if(pool->heapSize == pool->heapCapacity) {
+		pool->heapCapacity *= 2;
+		pool->heap = (long int*)memRealloc(pool->heap, sizeof(long int) * pool->heapCapacity);
+	}
+	
+	n = pool->count++;
+	pool->labels[n].city = city;
+	pool->labels[n].dist = dist;
+	pool->labels[n].risk = risk;
+	pool->labels[n].parent = parent;
+	
+	STAT_INC(STAT_HEAPOPS);
+	for(slot = pool->heapSize++; slot > 0; slot = up) {
+		up = (slot - 1) / 2;
+		if(!labelBefore(pool, n, pool->heap[up])) break;
+		pool->heap[slot] = pool->heap[up];
+	}
+	pool->heap[slot] = n;
+}
+
+/*
+ Removes and returns the first label on the heap.
+*/
+static long int popLabel(lpool* pool)
+{
+	long int first = pool->heap[0];
+	long int last = pool->heap[--pool->heapSize];
+	long int slot = 0;
+	long int child;
+	
+	STAT_INC(STAT_HEAPOPS);
+	while((child = slot * 2 + 1) < pool->heapSize) {
+		if(child + 1 < pool->heapSize && labelBefore(pool, pool->heap[child + 1], pool->heap[child])) child++;
+		if(!labelBefore(pool, pool->heap[child], last)) break;
+		pool->heap[slot] = pool->heap[child];
+		slot = child;
+	}
+	pool->heap[slot] = last;
+	
+	return first;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////PARETO FRONTS///////////////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+pfront* newParetoFront(void)
+{
+	pfront* front = (pfront*)memAlloc(MEM_PATHS, sizeof(pfront));
+	
+	front->size = 0;
+	front->capacity = 4;
+	front->routes = (proute*)memAlloc(MEM_PATHS, sizeof(proute) * front->capacity);
+	
+	return front;
+}
+
+/*
+ Empties a Pareto front so it can be reused for the next query.
+*/
+void clearParetoFront(pfront* front)
+{
+	long int x;
+	
+	for(x = 0; x < front->size; x++) purgePath(front->routes[x].path);
+	front->size = 0;
+}
+
+void purgeParetoFront(pfront* front)
+{
+	if(front == NULL) return;
+	clearParetoFront(front);
+	memFree(front->routes);
+	memFree(front);
+}
+
+/*
+ Adds a route to the front with an empty path, with room for length hops, to push them onto.
+ 
+ Returns the new route.
+*/
+static proute* addRoute(pfront* front, cn* provider, long int distance, long int risk, long int length)
+{
+	proute* route;
+	
+	if(front->size == front->capacity) {
+		front->capacity *= 2;
+		front->routes = (proute*)memRealloc(front->routes, sizeof(proute) * front->capacity);
+	}
+	
+	route = &front->routes[front->size++];
+	route->provider = provider;
+	route->distance = distance;
+	route->risk = risk;
+	route->path = newEmptyPath(length);
+	
+	return route;
+}
+
+/*
+ Returns 1 if the city with the given index holds the resource with the given index, 0 if not.
+*/
+static int provides(sgraph* graph, long int city, int resource)
+{
+	return resource != -1 && (graph->resources[city] >> resource & 1);
+}
+
+/*
+ Fills bound with the shortest distance, or the lowest risk if byRisk is 1, from any provider of
+ a resource to every city, with one search from all the providers at once.
+ The destination is not a provider here, as paretoRoutes never stops there.
+*/
+static void providerBounds(sgraph* graph, qctx* ctx, cn* destination, int r, int byRisk, dist_t* bound)
+{
+	sedges* edges = ctx->edges;
+	long int city;
+	long int e;
+	
+	searchBegin(ctx);
+	for(city = 0; city < graph->size; city++) {
+		if(city != destination->index && provides(graph, city, r)) searchSeed(ctx, city, 0);
+	}
+	while((city = searchSettle(ctx)) != -1) {
+		searchEdges(graph, city, SEARCH_FORWARD, byRisk, edges);
+		for(e = 0; e < edges->count; e++) {
+			searchRelax(ctx, city, edges->to[e], distAdd(ctx->dist[city], byRisk ? edges->risk[e] : edges->dist[e]));
+		}
+	}
+	for(city = 0; city < graph->size; city++) bound[city] = distClamp(searchDistance(ctx, city));
+}
+
+/*
+ Finds every Pareto-optimal route, trading distance against risk, from a provider of the given
+ resource to the destination, and adds them to the front shortest first.
+ 
+ This is a bi-criteria label-setting search run backwards from the destination. Labels come off
+ the heap shortest first, so a label is only worth keeping if it is safer than every label
+ already settled at its city; anything else is dominated and dropped, both when it is created
+ and when it is taken off the heap. The same test against the safest route found so far prunes
+ everything that could only lead to dominated routes. A route never passes through a provider
+ to reach another, as stopping at the first is both shorter and safer.
+ 
+ Two searches out from the providers first give a lower bound on the distance and on the risk
+ still to go from each city, as in bi-objective A*. Labels are ordered by distance plus its
+ bound, and a label whose risk plus its bound cannot beat the safest route found so far is
+ never created, so the search is drawn towards the providers and stays small.
+ 
+ Returns the number of routes found.
+*/
+long int paretoRoutes(sgraph* graph, qctx* ctx, lpool* pool, cn* destination, char resource, pfront* front)
+{
+	int r = resourceIndex(resource);
+	sedges* edges = ctx->edges;
+	dist_t solutionRisk = DIST_INF;
+	dist_t risk;
+	long int found = 0;
+	long int length;
+	long int n;
+	long int e;
+	long int x;
+	long int hop;
+	long int next;
+	long int prev = -1;
+	label cur;
+	proute* route;
+	
+	if(r == -1 || !(searchReachers(graph, destination->index) & (1 << r))) return 0;
+	
+	pool->count = 0;
+	pool->heapSize = 0;
+	if(++pool->version == 0) {
+		memset(pool->stamp, 0, sizeof(unsigned int) * (pool->size + 1));
+		pool->version = 1;
+	}
+	
+	providerBounds(graph, ctx, destination, r, 0, pool->lowDist);
+	providerBounds(graph, ctx, destination, r, 1, pool->lowRisk);
+	if(pool->lowDist[destination->index] == DIST_INF) return 0;
+	
+	pushLabel(pool, destination->index, 0, 0, -1);
+	
+	while(pool->heapSize > 0) {
+		n = popLabel(pool);
+		cur = pool->labels[n];
+		if(cur.risk >= bestRisk(pool, cur.city) || distAdd(cur.risk, pool->lowRisk[cur.city]) >= solutionRisk) continue;
+		
+		pool->stamp[cur.city] = pool->version;
+		pool->bestRisk[cur.city] = cur.risk;
+		STAT_INC(STAT_SETTLED);
+		
+		if(cur.city != destination->index && provides(graph, cur.city, r)) {
+			// A new point on the front: the path follows parents from the provider to the destination.
+			for(length = 0, x = n; x != -1; x = pool->labels[x].parent) length++;
+			route = addRoute(front, graph->cities[cur.city], cur.dist, cur.risk, length);
+			for(hop = n; hop != -1; prev = hop, hop = pool->labels[hop].parent) {
+				pathPush(route->path, graph->cities[pool->labels[hop].city], hop == n ? 0 : pool->labels[prev].dist - pool->labels[hop].dist);
+				if(hop != n) route->path->path[route->path->length - 1]->risk = pool->labels[prev].risk - pool->labels[hop].risk;
+			}
+			solutionRisk = cur.risk;
+			found++;
+			continue;
+		}
+		
+		searchEdges(graph, cur.city, SEARCH_BACKWARD, 1, edges);
+		for(e = 0; e < edges->count; e++) {
+			STAT_INC(STAT_RELAXED);
+			next = edges->to[e];
+			risk = distAdd(cur.risk, edges->risk[e]);
+			if(pool->lowDist[next] == DIST_INF || risk >= bestRisk(pool, next)) continue;
+			if(distAdd(risk, pool->lowRisk[next]) >= solutionRisk) continue;
+			pushLabel(pool, next, distAdd(cur.dist, edges->dist[e]), risk, n);
+		}
+	}
+	
+	return found;
+}
+
+/*
+ The weighted-sum fast path: finds the one route from a provider of the given resource to the
+ destination that minimises distWeight * distance + riskWeight * risk, with a single ordinary
+ search on the query context. The route is always on the Pareto front, so this is a cheap way
+ to pick a single compromise when the whole front is not needed.
+ 
+ Returns 1 and adds the route to the front if a provider can be reached, 0 if not.
+*/
+long int weightedRoute(sgraph* graph, qctx* ctx, cn* destination, char resource, long int distWeight, long int riskWeight, pfront* front)
+{
+	int r = resourceIndex(resource);
+	sedges* edges = ctx->edges;
+	long int city;
+	long int next;
+	long int length;
+	long int risk = 0;
+	long int best;
+	long int e;
+	long int x;
+	proute* route;
+	
+	if(r == -1 || !(searchReachers(graph, destination->index) & (1 << r))) return 0;
+	
+	searchBegin(ctx);
+	searchSeed(ctx, destination->index, 0);
+	
+	while((city = searchSettle(ctx)) != -1) {
+		if(city != destination->index && provides(graph, city, r)) break;
+		searchEdges(graph, city, SEARCH_BACKWARD, 1, edges);
+		for(e = 0; e < edges->count; e++) {
+			if(edges->dist[e] == DIST_INF || edges->risk[e] == DIST_INF) continue;
+			searchRelax(ctx, city, edges->to[e], distAdd(ctx->dist[city], distClamp(distWeight * edges->dist[e] + riskWeight * edges->risk[e])));
+		}
+	}
+	if(city == -1) return 0;
+	
+	for(length = 0, x = city; x != -1; x = ctx->pred[x]) length++;
+	route = addRoute(front, graph->cities[city], 0, 0, length);
+	
+	// Walk towards the destination, taking the cheapest edge between each pair of cities.
+	pathPush(route->path, graph->cities[city], 0);
+	for(next = ctx->pred[city]; next != -1; next = ctx->pred[next]) {
+		best = -1;
+		searchEdges(graph, next, SEARCH_BACKWARD, 1, edges);
+		for(e = 0; e < edges->count; e++) {
+			if(edges->to[e] != route->path->path[route->path->length - 1]->citypntr->index || edges->dist[e] == DIST_INF) continue;
+			if(best == -1 || distWeight * edges->dist[e] + riskWeight * edges->risk[e] < distWeight * edges->dist[best] + riskWeight * edges->risk[best]) best = e;
+		}
+		pathPush(route->path, graph->cities[next], edges->dist[best]);
+		route->path->path[route->path->length - 1]->risk = edges->risk[best];
+		risk += edges->risk[best];
+	}
+	
+	route->distance = route->path->totalDistance;
+	route->risk = risk;
+	
+	return 1;
+}
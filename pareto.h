@@ -0,0 +1,79 @@
+#include "reliefdb.h"
+#include "search.h"
+
+#ifndef pareto_h
+#define pareto_h
+
+/*
+ A label is one partial route in a bi-criteria search: it reaches city with
+ the given distance and risk, and parent is the label it was extended from
+ (-1 for the destination the search starts at).
+*/
+typedef struct label {
+	long int city;
+	dist_t dist;
+	dist_t risk;
+	long int parent;
+} label;
+
+/*
+ A label pool is the working space for bi-criteria searches, the Pareto
+ counterpart of a query context. Labels and the heap are taken from arrays
+ that only ever grow, so once a few queries have run no further allocation
+ is needed; each query just starts again from the front.
+ 
+ - size is the number of cities in the graph.
+ - labels/count/capacity hold every label created by the current query.
+ - heap/heapSize/heapCapacity form a binary heap of label numbers ordered
+   by distance, then risk.
+ - bestRisk is the lowest risk of any route settled at each city, valid
+   while the city's stamp equals the current version.
+ - lowDist/lowRisk are lower bounds on the distance and risk still to go
+   from each city to the nearest provider, which order and prune labels.
+*/
+typedef struct labelpool {
+	long int size;
+	label* labels;
+	long int count;
+	long int capacity;
+	long int* heap;
+	long int heapSize;
+	long int heapCapacity;
+	unsigned int version;
+	unsigned int* stamp;
+	dist_t* bestRisk;
+	dist_t* lowDist;
+	dist_t* lowRisk;
+} lpool;
+
+/*
+ One Pareto-optimal route: no other route is both shorter and safer.
+ The path runs from the provider to the destination and is owned by the route.
+*/
+typedef struct paretoroute {
+	cn* provider;
+	long int distance;
+	long int risk;
+	cpath* path;
+} proute;
+
+/*
+ The Pareto front of routes to a destination, shortest (and so riskiest) first.
+*/
+typedef struct paretofront {
+	long int size;
+	long int capacity;
+	proute* routes;
+} pfront;
+
+lpool* newLabelPool(long int size);
+void purgeLabelPool(lpool* pool);
+
+pfront* newParetoFront(void);
+void clearParetoFront(pfront* front);
+void purgeParetoFront(pfront* front);
+
+long int paretoRoutes(sgraph* graph, qctx* ctx, lpool* pool, cn* destination, char resource, pfront* front);
+long int weightedRoute(sgraph* graph, qctx* ctx, cn* destination, char resource, long int distWeight, long int riskWeight, pfront* front);
+
+#endif
@@ -0,0 +1,127 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "relax.h"
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#include <immintrin.h>
+#define HAVE_AVX2_KERNEL
+#endif
+
+static long int scalarKernel(const long int* to, const dist_t* weight, long int count, dist_t base,
+							 const dist_t* dist, const unsigned int* stamp, unsigned int version, long int* improved);
+
+/*
+ The kernel searches use. Starts on the scalar kernel; selectRelaxKernel(KERNEL_AVX2)
+ moves it to the vector one once the CPU is known to support it.
+*/
+rkernel relaxKernel = scalarKernel;
+static int kernelInUse = KERNEL_SCALAR;
+
+/*
+ Edge by edge. Comparing weight against the gap (dist - base) rather than base + weight
+ against dist means the sum can never overflow, even at DIST_INF.
+*/
+static long int scalarKernel(const long int* to, const dist_t* weight, long int count, dist_t base,
+							 const dist_t* dist, const unsigned int* stamp, unsigned int version, long int* improved)
+{
+	long int found = 0;
+	long int k;
+	dist_t known;
+	
+	for(k = 0; k < count; k++) {
+		known = stamp[to[k]] == version ? dist[to[k]] : DIST_INF;
+		if(weight[k] < known - base) improved[found++] = k;
+	}
+	
+	return found;
+}
+
+#ifdef HAVE_AVX2_KERNEL
+
+/*
+ Four edges at a time: the targets' distances and stamps are gathered, stale distances are
+ replaced by DIST_INF, and one compare gives a bit per improving edge. The last few edges
+ go through the scalar kernel.
+*/
+__attribute__((target("avx2")))
+static long int avx2Kernel(const long int* to, const dist_t* weight, long int count, dist_t base,
+						   const dist_t* dist, const unsigned int* stamp, unsigned int version, long int* improved)
+{
+	const __m128i wanted = _mm_set1_epi32((int)version);
+	long int found = 0;
+	long int tail;
+	long int k;
+	int mask;
+	
+#ifdef RELIEF_DIST32
+	const __m128i inf = _mm_set1_epi32(DIST_INF);
+	const __m128i from = _mm_set1_epi32(base);
+	__m128i known;
+	__m128i fresh;
+	__m128i gain;
+#else
+	const __m256i inf = _mm256_set1_epi64x(DIST_INF);
+	const __m256i from = _mm256_set1_epi64x(base);
+	__m256i known;
+	__m256i fresh;
+	__m256i gain;
+#endif
+	__m256i index;
+	
+	for(k = 0; k + 4 <= count; k += 4) {
+		index = _mm256_loadu_si256((const __m256i*)(to + k));
+#ifdef RELIEF_DIST32
+		fresh = _mm_cmpeq_epi32(_mm256_i64gather_epi32((const int*)stamp, index, 4), wanted);
+		known = _mm_blendv_epi8(inf, _mm256_i64gather_epi32((const int*)dist, index, 4), fresh);
+		gain = _mm_cmpgt_epi32(_mm_sub_epi32(known, from), _mm_loadu_si128((const __m128i*)(weight + k)));
+		mask = _mm_movemask_ps(_mm_castsi128_ps(gain));
+#else
+		fresh = _mm256_cvtepi32_epi64(_mm_cmpeq_epi32(_mm256_i64gather_epi32((const int*)stamp, index, 4), wanted));
+		known = _mm256_blendv_epi8(inf, _mm256_i64gather_epi64((const long long*)dist, index, 8), fresh);
+		gain = _mm256_cmpgt_epi64(_mm256_sub_epi64(known, from), _mm256_loadu_si256((const __m256i*)(weight + k)));
+		mask = _mm256_movemask_pd(_mm256_castsi256_pd(gain));
+#endif
+		while(mask) {
+			improved[found++] = k + __builtin_ctz(mask);
+			mask &= mask - 1;
+		}
+	}
+	
+	tail = scalarKernel(to + k, weight + k, count - k, base, dist, stamp, version, improved + found);
+	while(tail-- > 0) improved[found++] += k;
+	
+	return found;
+}
+
+#endif
+
+/*
+ Switches every search to the given kernel, if this build and CPU have it; otherwise the
+ scalar kernel is used.
+ 
+ Returns the kernel now in use.
+*/
+int selectRelaxKernel(int kernel)
+{
+	relaxKernel = scalarKernel;
+	kernelInUse = KERNEL_SCALAR;
+	
+#ifdef HAVE_AVX2_KERNEL
+	if(kernel == KERNEL_AVX2 && __builtin_cpu_supports("avx2")) {
+		relaxKernel = avx2Kernel;
+		kernelInUse = KERNEL_AVX2;
+	}
+#endif
+	
+	return kernelInUse;
+}
+
+int relaxKernelInUse(void)
+{
+	return kernelInUse;
+}
+
+const char* relaxKernelName(int kernel)
+{
+	return kernel == KERNEL_AVX2 ? "AVX2" : "scalar";
+}
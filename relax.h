@@ -0,0 +1,34 @@
+#include "dist.h"
+
+#ifndef relax_h
+#define relax_h
+
+#define KERNEL_SCALAR 0		// Plain C, one edge at a time.
+#define KERNEL_AVX2 1		// Four edges at a time with AVX2 gathers, where the CPU has them.
+#define RELAX_BATCH 64		// Most edges handed to a kernel in one call.
+
+/*
+ A relaxation kernel is the filter at the heart of a search: given a batch of
+ count edges leaving a city at distance base, their targets and weights packed
+ side by side, it finds which edges lead somewhere shorter than the distance
+ already known there.
+ 
+ A target's distance in dist counts only while its stamp equals version, and
+ is DIST_INF otherwise, as in a query context. The offsets (0 to count - 1) of
+ the edges that improve on it are written to improved, in order.
+ 
+ Returns the number of offsets written.
+ 
+ The kernel does not change anything, so when an edge shows up twice in a
+ batch the caller's update still has to compare again.
+*/
+typedef long int (*rkernel)(const long int* to, const dist_t* weight, long int count, dist_t base,
+							const dist_t* dist, const unsigned int* stamp, unsigned int version, long int* improved);
+
+extern rkernel relaxKernel;
+
+int selectRelaxKernel(int kernel);
+int relaxKernelInUse(void);
+const char* relaxKernelName(int kernel);
+
+#endif
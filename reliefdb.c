@@ -2,14 +2,18 @@
 #include <stdlib.h>
 #include <limits.h> //for LONG_MAX
 #include <string.h>
+#include <ctype.h>
 #include "reliefdb.h"
 #include "strlib.h"
 #include "objects.h"
-#include "intlib.h"
+#include "stats.h"
+#include "memacct.h"
+#include "search.h"
+#include "simplify.h"
+#include "packed.h"
 
 #define MINCITIES 8
 #define INF LONG_MAX
-#define ZERO_LENGTH 0
 
 
 //////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -31,6 +35,7 @@
 cdbn* CSearch(long int id, cdb* db)
 {
 	if(db == NULL || db->chead == NULL) return NULL;
+	STAT_INC(STAT_LOOKUPS);
 	cdbn* curNode = db->chead;
 	while(1) {
 		if(curNode->cur->id == id || curNode->next == NULL) break;
@@ -43,120 +48,31 @@ cdbn* CSearch(long int id, cdb* db)
 
 
 /*
- Checks a path for a given city.
- 
- Returns 0 if the city is in the path.
- Returns 1 if it isn't.
- */
-int checkPath(cpath* path, long int id)
-{
-	int x;
-	
-	for(x = 0; x < path->length; x++) {
-		if(path->path[x]->cityid == id) return 0;
-	}
-	
-	return 1;
-}
-
-/*
- Returns the closest city to a city, that isn't in the skip array.
- 
- Returns NULL if the travel table is empty or the node provided is NULL.
- Returns NULL if there is no nearest city (skip array contains all adjacent cities).
+ Returns the position of a resource letter in RESOURCE_LETTERS (0 for B up to 4 for M).
+ Returns -1 if the letter is not a resource, including 'X' for none.
 */
-cn* findNearestCity(cdb* db, cn* city, cpath* path, long int* skip, long int skipsize, long int* distance)
+int resourceIndex(char resource)
 {
-	if(city == NULL || city->ttsize == 0) return NULL;
-	
-	int x;
-	cn* nearestCity = NULL;
-	long int dist = INF;
-	
-	for(x = 0; x < city->ttsize; x++) {
-		// If this city is nearer and isn't in the skip array and isnt in the current path:
-		if(
-		   city->goes_to[x]->distance < dist
-		   && intSearch(skip, skipsize, city->goes_to[x]->cityid) == -1
-		   && checkPath(path, city->goes_to[x]->cityid))
-		{
-			dist = city->goes_to[x]->distance;
-			if(city->goes_to[x]->citypntr == NULL) nearestCity = CSearch(city->goes_to[x]->cityid, db)->cur;
-			else nearestCity = city->goes_to[x]->citypntr;
-		}
+	switch (toupper(resource)) {
+		case 'B': return 0;
+		case 'F': return 1;
+		case 'W': return 2;
+		case 'D': return 3;
+		case 'M': return 4;
+		default: return -1;
 	}
-	*distance = dist;
-	return nearestCity;
 }
 
-/*
- Searches the given map's paths for the given city and updates the distance field 
- for that path ONLY if the distance is shorter than the currently stored distance.
-*/
-void updateDistance(map* map, long int cityID, long int distance)
-{
-	long int x;
-	cpath** dir = map->directions;
-	
-	for(x = 0; x < map->size; x++) {
-		if(dir[x]->endID == cityID) {
-			if(distance < dir[x]->totalDistance) dir[x]->totalDistance = distance;
-			break;
-		}
-	}
-}
-
-/*
- Finds the index for the given city's path inside a map's pathmap array.
- 
- Returns the index, or -1 if not found.
-*/
-long int findPathForCity(map* map, cn* city)
-{
-	long int x;
-	
-	for(x = 0; x < map->size; x++) {
-		if(map->directions[x]->endID == city->id) return x;
-	}
-	
-	return -1;
-}
 
-/*
- Fills a map with infinite distance, NULL paths for every city ID in the database. 
- This is to initialise and allocate memory for the map's path array.
-*/
-void fillMap(cdb* db, map* map, cn* begin)
-{
-	//Start by filling up the map with infinite distance, NULL paths for every ID
-	//Remember we don't care what the path is, as long as it's shortest
-	int x = 0;
-	cdbn* curNode = db->chead;
-	map->directions = (cpath**)malloc(sizeof(cpath*) * db->ctsize);
-	while(curNode->next != NULL) {
-		map->directions[x] = newPath(curNode->cur->id, INF, 0, NULL);
-		curNode = curNode->next;
-		x++;
-	}
-	//one more for the last node
-	map->directions[x] = newPath(curNode->cur->id, INF, 0, NULL);
-}
 
 /*
- Calculates the total distance currently travelled in a path.
- Returns the total distance.
+ Returns the total distance currently travelled in a path, read from its running totals
+ rather than summed again.
 */
-int getTotalDistance(cpath* path, int debug)
+long int getTotalDistance(cpath* path, int debug)
 {
-	int x;
-	int totalDistance = 0;
-	
-	// Calculate the distance travelled by traversing the path and adding up all the distances.
-	for(x = 0; x < path->length; x++) {
-		totalDistance += path->path[x]->distance;
-	}
-	
-	return totalDistance;
+	if(path->length == 0) return 0;
+	return path->prefix[path->length - 1];
 }
 
 
@@ -183,7 +99,7 @@ void updateShortestPathsToResources(cn* city, long int distance, cpath* path, rs
 	rsc* curres;
 	
 	while (city->resources[x] != '\0') {
-
+		
 		switch (city->resources[x]) {
 			case 'B':
 				curres = resB;
@@ -209,19 +125,27 @@ void updateShortestPathsToResources(cn* city, long int distance, cpath* path, rs
 				curres = NULL;
 				break;
 				
+			case '0': case '1': case '2': case '3': case '4':
+			case '5': case '6': case '7': case '8': case '9':
+				// Stock level of the resource before it.
+				curres = NULL;
+				break;
+				
 			default:
 				printf("WARNING: Invalid resource (%c) found in city with ID %ld. Skipping.\n", city->resources[x], city->id);
 				curres = NULL;
 				break;
 		}
 		
-		if(curres == NULL) {
+		// A resource listed with no stock left is not supplied.
+		if(curres == NULL || city->stock[resourceIndex(city->resources[x])] == 0) {
 			x++;
 			continue;
 		}
 		
 		if(distance < curres->totalDistance) {
 			curres->city = city;
+			purgePath(curres->path);
 			curres->path = copyPath(path);
 			curres->totalDistance = distance;
 		}
@@ -232,43 +156,9 @@ void updateShortestPathsToResources(cn* city, long int distance, cpath* path, rs
 
 
 
-/*
- Searches the database for the given city in the path.
- 
- Returns a pointer to the city (could be NULL if city doesn't exist).
-*/
-cn* moveToCity(cdb* db, cpath* path, long int pathIndex)
-{
-	return CSearch(path->path[pathIndex]->cityid, db)->cur;
-}
-
-/*
- Adds or updates the given map with the path.
- Adds it if it isn't already in the map.
- Updates it if it is already in the map.
- 
- Returns 1 if the city was added.
- Returns 0 if the city was not added or if it was just updated.
-*/
-int updateMapWithPath(map* map, long int mapIndex, cpath* path, long int pathIndex, cn* currentCity, long int totalDistance)
-{
-	long int i = findPathForCity(map, currentCity);
-	
-	// Add this city's path into the map it if it isn't there.
-	if(i == -1) {
-		map->directions[mapIndex] = copyPath(path);
-		map->size++;
-		return 1;
-	}
-	// Otherwise if the current path is shorter than the stored one, update the stored path.
-	else if(map->directions[i]->totalDistance > totalDistance) {
-		map->directions[i] = copyPath(path);
-	}
-	return 0;
-}
-
 /*
  Takes the travel string and makes a travel table array out of it.
+ Each entry is "id:distance", or "id:distance/risk" for a road with a known risk.
  
  Returns the newly created travel table array.
 */
@@ -276,11 +166,12 @@ tt** constructTravelTable(char* travelString, cn* city)
 {
 	city->ttsize = countchar(travelString, ':');
 	
-	tt** newtt = (tt**)malloc(sizeof(tt*) * city->ttsize);
+	tt** newtt = (tt**)memAlloc(MEM_GRAPH, sizeof(tt*) * city->ttsize);
 	int index = 0;
 	char* tempString;
 	long int id;
 	long int dist;
+	char* risk;
 	int a = 0;
 	
 	tempString = strtok(travelString, ":");
@@ -288,8 +179,10 @@ tt** constructTravelTable(char* travelString, cn* city)
 	do {
 		a++;
 		id = atol(tempString);
-		dist = atol(strtok(NULL, ","));
+		tempString = strtok(NULL, ",");
+		dist = atol(tempString);
 		newtt[index] = newTTable(id, dist);
+		if((risk = strchr(tempString, '/')) != NULL) newtt[index]->risk = atol(risk + 1);
 		index++;
 	}
 	
@@ -298,161 +191,114 @@ tt** constructTravelTable(char* travelString, cn* city)
 }
 
 /*
- Finds all the paths from the initial city (begin) to all other cities and places them in a map, assigned to the initial node.
- Also finds the shortest paths to available resources to the destination city.
+ Compares two cities by ID, for linkDB's lookup table.
+*/
+static int compareCities(const void* a, const void* b)
+{
+	long int idA = (*(cn* const*)a)->id;
+	long int idB = (*(cn* const*)b)->id;
+	return (idA > idB) - (idA < idB);
+}
+
+/*
+ Resolves the citypntr of every travel table in the database so that searches
+ and printing never need to fall back on CSearch, then builds the search graph
+ with the given ORDER_ ordering of its cities. options holds LINK_ flags:
+ LINK_SIMPLIFY builds the simplified core graph as well, and LINK_PACK packs
+ the travel tables of both graphs (a graph that cannot be packed stays plain).
+ Travel tables pointing at cities that are not in the database are left NULL.
  
- See project report for detailed information on how this function works
+ Cities are looked up in a table sorted by ID, so linking is O(m log n).
+ 
+ Should be called once, after every city has been added.
 */
-void shortestPaths(cdb* db, cn* begin, cn* destination, rsc* resB, rsc* resF, rsc* resW, rsc* resD, rsc* resM)
+void linkDB(cdb* db, int order, int options)
 {
-	long int completedBranches[begin->ttsize];
-	long int completedBranchesIndex = 0;
-	long int doNotEnter[db->ctsize];
-	long int doNotEnterIndex = 0;
-	
-	long int currentPathIndex = 0;
-	long int pathMapIndex = 0;
-	long int distanceToNextCity = 0;
-	long int totalDistanceT = 0;
-	
-	int stopExplore = 0;
-	
-	cn* currentCity = begin;
-	
-	zeroOut(doNotEnter, db->ctsize);
-	zeroOut(completedBranches, begin->ttsize);
-	
-	cpath* currentPath = newPath(begin->id, ZERO_LENGTH, 0, (tt**)malloc(sizeof(tt*) * db->ctsize));
-	initPathTT(currentPath, db->ctsize);
-	
-	map* pathmap = newMap("");
-	fillMap(db, pathmap, begin);
-	
-	
-	setTravelTable(currentPath->path[0], begin, 0);
-	currentPath->length = 1;
-	pathMapIndex += updateMapWithPath(pathmap, pathMapIndex, currentPath, currentPathIndex, currentCity, totalDistanceT);
-	currentPath->endID = begin->id;
-	currentPathIndex = 1;
-	
+	if(db == NULL) return;
+	
+	cdbn* node;
+	cn** byID;
+	long int count = 0;
+	long int low;
+	long int high;
+	long int mid;
+	long int id;
+	long int x;
 	
-	while(completedBranchesIndex < begin->ttsize) {
-		
-		currentCity = findNearestCity(db, begin, currentPath, completedBranches, completedBranchesIndex, &distanceToNextCity);
-
-		if(currentCity == NULL) {
-			// Empty path, nowhere to go.
-			break;
-		}
-		
-		setTravelTable(currentPath->path[currentPathIndex], currentCity, distanceToNextCity);
-		currentPath->length++;
-		currentPath->endID = currentCity->id;
-		
-		totalDistanceT = getTotalDistance(currentPath,1);
-		currentPath->totalDistance = totalDistanceT;
-		
-		if(currentCity == destination) updateShortestPathsToResources(begin, totalDistanceT, currentPath, resB, resF, resW, resD, resM);
-		pathMapIndex += updateMapWithPath(pathmap, pathMapIndex, currentPath, currentPathIndex, currentCity, totalDistanceT);
-		
-		completedBranches[completedBranchesIndex] = currentCity->id;
-		completedBranchesIndex++;
-		
-		
-		while(1) {
-			
-			if(currentCity == begin) {
-				break;
-			}
-			
-			currentCity = findNearestCity(db, currentCity, currentPath, NULL, 0, &distanceToNextCity);
-			
-			
-			while(currentCity == NULL) {
-				
-				currentCity = moveToCity(db, currentPath, currentPathIndex);
-
-				doNotEnter[doNotEnterIndex] = currentCity->id;
-				doNotEnterIndex++;
-				
-				if(currentCity == begin) {
-					stopExplore = 1;
-					break;
-				}
-				
-				
-				
-				currentPathIndex--;
-				currentPath->length--;
-				
-				currentCity = moveToCity(db, currentPath, currentPathIndex);
-				
-				if(currentCity == begin) {
-					stopExplore = 1;
+	for(node = db->chead; node != NULL; node = node->next) count++;
+	byID = (cn**)memAlloc(MEM_SCRATCH, sizeof(cn*) * (count + 1));
+	count = 0;
+	for(node = db->chead; node != NULL; node = node->next) byID[count++] = node->cur;
+	qsort(byID, count, sizeof(cn*), compareCities);
+	
+	for(node = db->chead; node != NULL; node = node->next) {
+		for(x = 0; x < node->cur->ttsize; x++) {
+			id = node->cur->goes_to[x]->cityid;
+			low = 0;
+			high = count - 1;
+			while(low <= high) {
+				mid = low + (high - low) / 2;
+				if(byID[mid]->id == id) {
+					node->cur->goes_to[x]->citypntr = byID[mid];
 					break;
 				}
-				
-				currentCity = findNearestCity(db, currentCity, currentPath, doNotEnter, doNotEnterIndex, &distanceToNextCity);
-			}
-			
-			if(stopExplore) {
-				stopExplore = 0;
-				break;
+				if(byID[mid]->id < id) low = mid + 1;
+				else high = mid - 1;
 			}
-			
-			currentPathIndex++;
-			
-			setTravelTable(currentPath->path[currentPathIndex], currentCity, distanceToNextCity);
-			currentPath->length++;
-			currentPath->endID = currentCity->id;
-
-			totalDistanceT = getTotalDistance(currentPath,1);
-			currentPath->totalDistance = totalDistanceT;
-			
-			if(currentCity == destination) updateShortestPathsToResources(begin, totalDistanceT, currentPath, resB, resF, resW, resD, resM);
-			
-			pathMapIndex += updateMapWithPath(pathmap, pathMapIndex, currentPath, currentPathIndex, currentCity, totalDistanceT);
 		}
-		
-		
-		zeroOut(doNotEnter, db->ctsize);
-		doNotEnterIndex = 0;
-		
-		free(currentPath);
-		currentPath = newPath(-1, 0, ZERO_LENGTH, (tt**)malloc(sizeof(tt*) * db->ctsize));
-		initPathTT(currentPath, db->ctsize);
-		setTravelTable(currentPath->path[0], begin, 0);
-		currentPath->length = 1;
-		currentPathIndex = 1;
-		
 	}
-	
-	begin->pathmap = pathmap;
-	free(currentPath);
-}
-
-
-cdbn* nextNode(cdb* db, cdbn* node) {
-	if(node == NULL) return db->chead;
-	else return node->next;
+	memFree(byID);
+	
+	purgeSearchGraph(db->graph);
+	purgeSearchGraph(db->core);
+	db->graph = buildSearchGraph(db, order);
+	db->core = options & LINK_SIMPLIFY ? simplifyGraph(db->graph) : NULL;
+	if(options & LINK_PACK) {
+		packSearchGraph(db->graph);
+		if(db->core != NULL) packSearchGraph(db->core);
+	}
 }
 
 /*
- Runs the shortest paths algorithm for every city in the database
+ Finds the nearest city with each resource that can reach the destination, and the shortest path from it.
+ 
+ A single search runs backwards from the destination, so cities are settled in order of their distance
+ to it and the first city found with a resource is the nearest one. The search stops early once every
+ resource has been found that some city able to reach the destination provides, so a resource with no
+ such provider never costs a sweep of the whole graph. The destination's own resources are not counted.
+ The search runs on the simplified core graph when there is one.
 */
-void shortestPathsBack(cdb* db, cn* destination, rsc* resB, rsc* resF, rsc* resW, rsc* resD, rsc* resM)
+void shortestPathsBack(cdb* db, qctx* ctx, cn* destination, rsc* resB, rsc* resF, rsc* resW, rsc* resD, rsc* resM)
 {
-	if(db == NULL || db->ctsize == 0 || db->chead == NULL ||db->chead->cur == NULL) {
+	if(db == NULL || db->ctsize == 0 || db->chead == NULL ||db->chead->cur == NULL || db->graph == NULL) {
 		printf("EMPTY DATABASE ERROR\n");
+		return;
 	}
 	
-	cdbn* node = NULL;
-	
-	int x;
-	
-	for(x = 0; x < db->ctsize; x++) {
-		node = nextNode(db, node);
-		shortestPaths(db, node->cur, destination, resB, resF, resW, resD, resM);
+	sgraph* graph = db->core != NULL ? db->core : db->graph;
+	rsc* found[NUM_RESOURCES] = {resB, resF, resW, resD, resM};
+	unsigned char reachable = searchReachers(graph, destination->index);
+	unsigned char missing = reachable;
+	cn* city;
+	cpath* path;
+	long int index;
+	int r;
+	
+	searchBegin(ctx);
+	searchSeed(ctx, destination->index, 0);
+	
+	// Only cities with a resource still missing come out of the search, so only they have paths built.
+	while(missing && (index = searchNextProvider(ctx, graph, SEARCH_BACKWARD, missing)) != -1) {
+		city = graph->cities[index];
+		if(index == destination->index) continue;
+		
+		path = buildSearchPath(ctx, graph, index, SEARCH_BACKWARD);
+		updateShortestPathsToResources(city, path->totalDistance, path, resB, resF, resW, resD, resM);
+		
+		for(r = 0, missing = 0; r < NUM_RESOURCES; r++) {
+			if(found[r]->city == NULL) missing |= 1 << r;
+		}
+		missing &= reachable;
 	}
 }
 
@@ -468,28 +314,15 @@ void purgePath(cpath* path)
 	if(path == NULL) return;
 	int x;
 	
-	for(x = 0; x < path->length; x++) {
+	for(x = 0; x < path->capacity; x++) {
 		if(path->path[x] == NULL) continue;
-		free(path->path[x]);
-	}
-	free(path->path);
-	free(path);
-}
-
-void purgeMap(map* map)
-{
-	if(map == NULL) return;
-	int x;
-	
-	for(x = 0; x < map->size; x++) {
-		if(map->directions[x] == NULL) continue;
-		purgePath(map->directions[x]);
+		memFree(path->path[x]);
 	}
-	free(map->directions);
-	free(map);
+	memFree(path->path);
+	memFree(path->prefix);
+	memFree(path);
 }
 
-
 void purgeCNode(cn* node)
 {
 	if(node == NULL) return;
@@ -498,24 +331,42 @@ void purgeCNode(cn* node)
 	
 	for(x = 0; x < node->ttsize; x++) {
 		if(node->goes_to[x] == NULL) continue;
-		free(node->goes_to[x]);
+		memFree(node->goes_to[x]);
 	}
-	purgeMap(node->pathmap);
-	free(node->name);
-	free(node->resources);
-	free(node);
+	memFree(node->goes_to);
+	memFree(node->name);
+	memFree(node->resources);
+	memFree(node);
 }
 
 void purgeCDBNode(cdbn* node)
 {
 	purgeCNode(node->cur);
+	memFree(node);
+}
+
+/*
+ Empties a resource so it can be reused for the next query.
+*/
+void clearResource(rsc* res)
+{
+	purgePath(res->path);
+	res->path = NULL;
+	res->city = NULL;
+	res->totalDistance = INF;
 }
 
 
 
 void purgeDB(cdb* db)
 {
-	if(db->chead == NULL) return;
+	if(db->chead == NULL) {
+		purgeSearchGraph(db->graph);
+		purgeSearchGraph(db->core);
+		memFree(db->groupname);
+		memFree(db);
+		return;
+	}
 	
 	cdbn* node = db->chead;
 	cdbn* next = node->next;
@@ -529,7 +380,10 @@ void purgeDB(cdb* db)
 		node = next;
 		next = node->next;
 	}
-
 	
-	free(db);
+	
+	purgeSearchGraph(db->graph);
+	purgeSearchGraph(db->core);
+	memFree(db->groupname);
+	memFree(db);
 }
\ No newline at end of file
@@ -1,13 +1,20 @@
 #ifndef reliefdb_h
 #define reliefdb_h
 
+#define NUM_RESOURCES 5
+#define RESOURCE_LETTERS "BFWDM"
+#define STOCK_UNLIMITED -1
+#define LINK_SIMPLIFY 1		// linkDB also builds the simplified core graph.
+#define LINK_PACK 2			// linkDB packs the search graphs' travel tables.
+
 //////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 ///////////////////////////////////////////////////////////////////////////STRUCTURES/////////////////////////////////////////////////////////////////////////////////////
 //////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
 /*
  A travel table is a node for the list of cities that link to a certain city.
- The city's ID and the distance to that city are stored.
+ The city's ID and the distance to that city are stored, along with the risk of
+ the road (0 unless the data gives one), for routes that trade hours for safety.
  A placeholder for the actual pointer to that city is stored as well in order
  to speed up the application.
  */
@@ -15,6 +22,7 @@ typedef struct traveltable {
 	struct citynode* citypntr;
 	long int cityid;
 	long int distance;
+	long int risk;
 } tt;
 
 /*
@@ -22,14 +30,20 @@ typedef struct traveltable {
  information about that city, including a travel table of the cities
  that link to it.
  The size of the travel table is stored in ttsize.
+ The index is the city's position in the database's search graph.
+ A resource letter may be followed by a stock level (eg "B20W5"); stock holds
+ it per RESOURCE_LETTERS position, STOCK_UNLIMITED for a letter with no level
+ and 0 for resources the city does not have or has run out of. A city is
+ never a provider of a resource it has no stock of (see cityOffers).
  */
 typedef struct citynode {
 	long int id;
+	long int index;
 	char* name;
 	long int ttsize;
 	tt** goes_to;
 	char* resources;
-	struct map* pathmap;
+	long int stock[NUM_RESOURCES];
 } cn;
 
 /*
@@ -50,11 +64,16 @@ typedef struct cdbnode {
  The groupname is an optional use name for the group of cities used for printing
  eg "Australia", or "West Africa".
  The size of the city table is stored in ctsize.
+ The search graph is built by linkDB once every city has been added, along
+ with the simplified core graph if one was asked for (NULL otherwise), which
+ the searches for the nearest resources use in its place.
  */
 typedef struct citydb {
 	char* groupname;
 	long int ctsize;
 	cdbn* chead;
+	struct searchgraph* graph;
+	struct searchgraph* core;
 } cdb;
 
 /*
@@ -63,33 +82,22 @@ typedef struct citydb {
  - endID is the destination of this path.
  - totalDistance is the total number of hours involved in this journey.
  - length is the number of cities in the path (including the start and end).
+ - capacity is the number of travel tables path has room for; slots past
+   length are either NULL or spare travel tables kept for reuse.
  - path is a list of travel tables set in the order of the journey.
+ - prefix holds running totals: prefix[x] is the hours travelled on
+   arriving at hop x, so prefix[length - 1] is the total distance. Paths
+   grown with pathPush keep it (and totalDistance) up to date in O(1).
 */
 typedef struct citypath {
 	long int endID;
 	long int totalDistance;
 	long int length;
+	long int capacity;
 	tt** path;
+	long int* prefix;
 } cpath;
 
-/*
- A map is stored in a citynode and contains all the shortest path from 
- that city to all other accessible cities.
- 
- - resources is a string representing the resources available to the city. This
-   string can be checked in order to determine which resource list should 
-   be searched prior to finding the shortest distance to that resource 
-   (saves a lot of time).
- - size is the number of paths in the directions array, aka the number of cities
-   accessible from the city with this map.
- - directions is a list of shortest paths to all cities accessible from this city
-*/
-typedef struct map {
-	char* resources;
-	long int size;
-	cpath** directions;
-} map;
-
 /*
  A resource is a wrapper for a distance to a resource and the city that the resource is at.
  
@@ -104,25 +112,24 @@ typedef struct resource {
 	cpath* path;
 } rsc;
 
+struct searchgraph;
+struct querycontext;
+
 
 //////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 ///////////////////////////////////////////////////////////////////////////FUNCTIONS//////////////////////////////////////////////////////////////////////////////////////
 //////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
 cdbn* CSearch(long int id, cdb* db);
-int checkPath(cpath* path, long int id);
-cn* findNearestCity(cdb* db, cn* city, cpath* path, long int* skip, long int skipsize, long int* distance);
-void updateDistance(map* map, long int cityID, long int distance);
-long int findPathForCity(map* map, cn* city);
-void fillMap(cdb* db, map* map, cn* begin);
-int getTotalDistance(cpath* path, int debug);
+int resourceIndex(char resource);
+long int getTotalDistance(cpath* path, int debug);
 void updateShortestPathsToResources(cn* city, long int distance, cpath* path, rsc* resB, rsc* resF, rsc* resW, rsc* resD, rsc* resM);
-cn* moveToCity(cdb* db, cpath* path, long int pathIndex);
-int updateMapWithPath(map* map, long int mapIndex, cpath* path, long int pathIndex, cn* currentCity, long int totalDistance);
 tt** constructTravelTable(char* travelString, cn* city);
-void shortestPaths(cdb* db, cn* begin, cn* destination, rsc* resB, rsc* resF, rsc* resW, rsc* resD, rsc* resM);
-void shortestPathsBack(cdb* db, cn* destination, rsc* resB, rsc* resF, rsc* resW, rsc* resD, rsc* resM);
+void linkDB(cdb* db, int order, int options);
+void shortestPathsBack(cdb* db, struct querycontext* ctx, cn* destination, rsc* resB, rsc* resF, rsc* resW, rsc* resD, rsc* resM);
 void printPath(cpath* path);
+void purgePath(cpath* path);
+void clearResource(rsc* res);
 void purgeDB(cdb* db);
 
 #endif
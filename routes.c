@@ -0,0 +1,285 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <limits.h> //for LONG_MAX
+#include "reliefdb.h"
+#include "objects.h"
+#include "search.h"
+#include "routes.h"
+#include "memacct.h"
+
+#define INF LONG_MAX
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////PROVIDER LISTS/////////////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/*
+ Creates a new, empty provider list for the given resource with room for capacity providers.
+*/
+plist* newProviderList(char resource, long int capacity)
+{
+	plist* list = (plist*)memAlloc(MEM_PATHS, sizeof(plist));
+	long int x;
+	
+	list->resource = resource;
+	list->size = 0;
+	list->capacity = capacity;
+	list->providers = (rsc**)memAlloc(MEM_PATHS, sizeof(rsc*) * capacity);
+	for(x = 0; x < capacity; x++) {
+		list->providers[x] = newResource(NULL, INF, NULL);
+	}
+	
+	return list;
+}
+
+/*
+ Empties a provider list so it can be reused for the next query.
+*/
+void clearProviderList(plist* list)
+{
+	long int x;
+	
+	for(x = 0; x < list->size; x++) {
+		clearResource(list->providers[x]);
+	}
+	list->size = 0;
+}
+
+void purgeProviderList(plist* list)
+{
+	if(list == NULL) return;
+	long int x;
+	
+	clearProviderList(list);
+	for(x = 0; x < list->capacity; x++) {
+		memFree(list->providers[x]);
+	}
+	memFree(list->providers);
+	memFree(list);
+}
+
+/*
+ Finds the nearest providers of each wanted resource that can reach the destination.
+ 
+ lists holds one provider list per resource, in RESOURCE_LETTERS order; only the lists for the
+ letters in wanted are filled, each with up to its capacity of distinct providers, nearest first.
+ One search runs backwards from the destination and stops as soon as every wanted list is full;
+ a resource that no city able to reach the destination provides is never waited for.
+ The destination's own resources are not counted. The search runs on the simplified core graph
+ when there is one.
+ 
+ Returns the total number of providers found.
+*/
+long int nearestProviders(cdb* db, qctx* ctx, cn* destination, char* wanted, plist** lists)
+{
+	sgraph* graph = db->core != NULL ? db->core : db->graph;
+	int want[NUM_RESOURCES] = {0};
+	unsigned char wantBits = 0;
+	int open = 0;
+	long int found = 0;
+	long int index;
+	cn* city;
+	plist* list;
+	rsc* res;
+	int r;
+	int x;
+	
+	for(x = 0; wanted[x] != '\0'; x++) {
+		r = resourceIndex(wanted[x]);
+		if(r == -1 || want[r]) continue;
+		want[r] = 1;
+		wantBits |= 1 << r;
+		clearProviderList(lists[r]);
+		if(lists[r]->capacity > 0 && (searchReachers(graph, destination->index) & (1 << r))) open++;
+	}
+	
+	searchBegin(ctx);
+	searchSeed(ctx, destination->index, 0);
+	
+	while(open > 0 && (index = searchNextProvider(ctx, graph, SEARCH_BACKWARD, wantBits)) != -1) {
+		city = graph->cities[index];
+		if(index == destination->index) continue;
+		
+		for(x = 0; city->resources[x] != '\0'; x++) {
+			r = resourceIndex(city->resources[x]);
+			if(r == -1 || !want[r] || city->stock[r] == 0) continue;
+			
+			list = lists[r];
+			if(list->size == list->capacity) continue;
+			
+			// A city listing the same letter twice is still one provider.
+			if(list->size > 0 && list->providers[list->size - 1]->city == city) continue;
+			
+			res = list->providers[list->size++];
+			res->city = city;
+			res->totalDistance = searchDistance(ctx, index);
+			res->path = copyPath(buildSearchPath(ctx, graph, index, SEARCH_BACKWARD));
+			found++;
+			
+			if(list->size == list->capacity) open--;
+		}
+	}
+	
+	return found;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////ALTERNATIVE ROUTES/////////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/*
+ Returns 1 if the first count cities of two paths are the same, 0 if not.
+*/
+static int samePrefix(cpath* a, cpath* b, long int count)
+{
+	long int x;
+	
+	if(a->length < count || b->length < count) return 0;
+	for(x = 0; x < count; x++) {
+		if(a->path[x]->cityid != b->path[x]->cityid) return 0;
+	}
+	return 1;
+}
+
+/*
+ Returns 1 if a path visits the same cities as any of the paths given, 0 if not.
+*/
+static int knownPath(cpath* path, cpath** paths, long int count)
+{
+	long int x;
+	
+	for(x = 0; x < count; x++) {
+		if(paths[x]->length == path->length && samePrefix(paths[x], path, path->length)) return 1;
+	}
+	return 0;
+}
+
+/*
+ Joins the first rootLength hops of root, the travel table from the last of them to spur's first
+ city, and spur itself into a new path.
+*/
+static cpath* joinPath(cpath* root, long int rootLength, long int spurDistance, cpath* spur)
+{
+	cpath* path = newEmptyPath(rootLength + spur->length);
+	long int x;
+	
+	for(x = 0; x < rootLength; x++) {
+		pathPush(path, root->path[x]->citypntr, root->path[x]->distance);
+	}
+	for(x = 0; x < spur->length; x++) {
+		pathPush(path, spur->path[x]->citypntr, x == 0 ? spurDistance : spur->path[x]->distance);
+	}
+	
+	return path;
+}
+
+/*
+ Finds up to k loop-free routes from one city to another, shortest first, using Yen's algorithm.
+ 
+ Each new route leaves an earlier one at some city (the spur) and must not revisit the cities before
+ it, nor leave the spur the same way as any route already found with the same beginning. The
+ rest of the route comes from a search run backwards from the destination with those cities
+ blocked, so the travel tables out of the spur can be tried against it directly.
+ 
+ routes must have room for k paths. The caller owns the paths returned and frees them with purgePath.
+ 
+ Returns the number of routes found (0 if the destination cannot be reached at all).
+*/
+long int alternativeRoutes(cdb* db, qctx* ctx, cn* from, cn* to, long int k, cpath** routes)
+{
+	sgraph* graph = db->graph;
+	sedges* edges = ctx->edges;
+	long int found = 0;
+	long int candidates = 0;
+	long int candidateCapacity = 8;
+	cpath** candidate = (cpath**)memAlloc(MEM_SCRATCH, sizeof(cpath*) * candidateCapacity);
+	cpath* prev;
+	cpath* path;
+	long int spur;
+	long int spurCity;
+	long int e;
+	long int x;
+	long int best;
+	long int bestTo;
+	dist_t bestDist = 0;
+	long int distance;
+	int banned;
+	
+	if(k < 1 || from == to || !searchMayReach(graph, from->index, to->index)) {
+		memFree(candidate);
+		return 0;
+	}
+	
+	// The shortest route comes first.
+	searchBegin(ctx);
+	searchSeed(ctx, to->index, 0);
+	while(searchNext(ctx, graph, SEARCH_BACKWARD) != -1);
+	if(searchDistance(ctx, from->index) == INF) {
+		memFree(candidate);
+		return 0;
+	}
+	routes[found++] = copyPath(buildSearchPath(ctx, graph, from->index, SEARCH_BACKWARD));
+	
+	while(found < k) {
+		prev = routes[found - 1];
+		
+		for(spur = 0; spur < prev->length - 1; spur++) {
+			spurCity = prev->path[spur]->citypntr->index;
+			
+			searchBegin(ctx);
+			for(x = 0; x <= spur; x++) searchBlock(ctx, prev->path[x]->citypntr->index);
+			searchSeed(ctx, to->index, 0);
+			while(searchNext(ctx, graph, SEARCH_BACKWARD) != -1);
+			
+			// Pick the best way out of the spur that no earlier route with this beginning took.
+			best = INF;
+			bestTo = -1;
+			searchEdges(graph, spurCity, SEARCH_FORWARD, 0, edges);
+			for(e = 0; e < edges->count; e++) {
+				distance = searchDistance(ctx, edges->to[e]);
+				if(distance == INF || edges->dist[e] == DIST_INF) continue;
+				
+				banned = 0;
+				for(x = 0; x < found && !banned; x++) {
+					if(samePrefix(routes[x], prev, spur + 1) && routes[x]->length > spur + 1
+					   && routes[x]->path[spur + 1]->citypntr->index == edges->to[e]) banned = 1;
+				}
+				if(banned) continue;
+				
+				if(edges->dist[e] + distance < best) {
+					best = edges->dist[e] + distance;
+					bestTo = edges->to[e];
+					bestDist = edges->dist[e];
+				}
+			}
+			if(bestTo == -1) continue;
+			
+			path = joinPath(prev, spur + 1, bestDist, buildSearchPath(ctx, graph, bestTo, SEARCH_BACKWARD));
+			if(knownPath(path, candidate, candidates) || knownPath(path, routes, found)) {
+				purgePath(path);
+				continue;
+			}
+			
+			if(candidates == candidateCapacity) {
+				candidateCapacity *= 2;
+				candidate = (cpath**)memRealloc(candidate, sizeof(cpath*) * candidateCapacity);
+			}
+			candidate[candidates++] = path;
+		}
+		
+		if(candidates == 0) break;
+		
+		// The shortest candidate becomes the next route.
+		best = 0;
+		for(x = 1; x < candidates; x++) {
+			if(candidate[x]->totalDistance < candidate[best]->totalDistance) best = x;
+		}
+		routes[found++] = candidate[best];
+		candidate[best] = candidate[--candidates];
+	}
+	
+	for(x = 0; x < candidates; x++) purgePath(candidate[x]);
+	memFree(candidate);
+	
+	return found;
+}
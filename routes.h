@@ -0,0 +1,29 @@
+#include "reliefdb.h"
+#include "search.h"
+
+#ifndef routes_h
+#define routes_h
+
+/*
+ A provider list holds the nearest providers of one resource, nearest first.
+ 
+ - resource is the resource letter.
+ - size is the number of providers found so far.
+ - capacity is the most providers the list will hold (k).
+ - providers is the list itself; each entry owns its path.
+*/
+typedef struct providerlist {
+	char resource;
+	long int size;
+	long int capacity;
+	rsc** providers;
+} plist;
+
+plist* newProviderList(char resource, long int capacity);
+void clearProviderList(plist* list);
+void purgeProviderList(plist* list);
+
+long int nearestProviders(cdb* db, qctx* ctx, cn* destination, char* wanted, plist** lists);
+long int alternativeRoutes(cdb* db, qctx* ctx, cn* from, cn* to, long int k, cpath** routes);
+
+#endif
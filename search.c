@@ -0,0 +1,1254 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <limits.h> //for LONG_MAX
+#include <string.h>
+#include "reliefdb.h"
+#include "objects.h"
+#include "search.h"
+#include "packed.h"
+#include "relax.h"
+#include "memacct.h"
+#include "stats.h"
+
+#define INF LONG_MAX
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////SEARCH GRAPH///////////////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/*
+ Compares two city indexes by the ID of the city, for the ID table.
+*/
+static sgraph* sortGraph;
+static int compareIDs(const void* a, const void* b)
+{
+	long int idA = sortGraph->cities[*(const long int*)a]->id;
+	long int idB = sortGraph->cities[*(const long int*)b]->id;
+	return (idA > idB) - (idA < idB);
+}
+
+/*
+ Compares two city indexes by their degree, then by index so the order is the same on every run.
+*/
+static long int* sortDegree;
+static int compareDegrees(const void* a, const void* b)
+{
+	long int x = *(const long int*)a;
+	long int y = *(const long int*)b;
+	if(sortDegree[x] != sortDegree[y]) return (sortDegree[x] > sortDegree[y]) - (sortDegree[x] < sortDegree[y]);
+	return (x > y) - (x < y);
+}
+
+/*
+ Works out a locality-preserving order for the cities of a graph, treating every travel table
+ as a two-way road. Each connected part is walked breadth first; for ORDER_RCM the walk starts
+ at a city of lowest degree, visits each city's neighbours by increasing degree, and the whole
+ order is reversed at the end (reverse Cuthill-McKee), which keeps the edges of the graph close
+ to the diagonal of its adjacency matrix.
+ 
+ Returns the order, the index of the city to put in each place, to be freed by the caller.
+*/
+static long int* localOrder(sgraph* graph, int order)
+{
+	long int n = graph->size;
+	long int* result = (long int*)memAlloc(MEM_SCRATCH, sizeof(long int) * (n + 1));
+	long int* starts = (long int*)memAlloc(MEM_SCRATCH, sizeof(long int) * (n + 1));
+	long int* degree = (long int*)memAlloc(MEM_SCRATCH, sizeof(long int) * (n + 1));
+	char* seen = (char*)memCalloc(MEM_SCRATCH, n + 1, sizeof(char));
+	long int* neighbours;
+	long int maxDegree = 0;
+	long int head = 0;
+	long int tail = 0;
+	long int next = 0;
+	long int count;
+	long int city;
+	long int e;
+	long int x;
+	
+	for(x = 0; x < n; x++) {
+		degree[x] = graph->outStart[x + 1] - graph->outStart[x] + graph->inStart[x + 1] - graph->inStart[x];
+		if(degree[x] > maxDegree) maxDegree = degree[x];
+		starts[x] = x;
+	}
+	neighbours = (long int*)memAlloc(MEM_SCRATCH, sizeof(long int) * (maxDegree + 1));
+	sortDegree = degree;
+	if(order == ORDER_RCM) qsort(starts, n, sizeof(long int), compareDegrees);
+	
+	while(tail < n) {
+		// Each connected part starts from the first unvisited city in start order.
+		while(seen[starts[next]]) next++;
+		seen[starts[next]] = 1;
+		result[tail++] = starts[next];
+		
+		while(head < tail) {
+			city = result[head++];
+			count = 0;
+			for(e = graph->outStart[city]; e < graph->outStart[city + 1]; e++) {
+				if(!seen[graph->outTo[e]]) neighbours[count++] = graph->outTo[e];
+				seen[graph->outTo[e]] = 1;
+			}
+			for(e = graph->inStart[city]; e < graph->inStart[city + 1]; e++) {
+				if(!seen[graph->inFrom[e]]) neighbours[count++] = graph->inFrom[e];
+				seen[graph->inFrom[e]] = 1;
+			}
+			if(order == ORDER_RCM) qsort(neighbours, count, sizeof(long int), compareDegrees);
+			for(x = 0; x < count; x++) result[tail++] = neighbours[x];
+		}
+	}
+	
+	for(x = 0; order == ORDER_RCM && x < n / 2; x++) {
+		city = result[x];
+		result[x] = result[n - 1 - x];
+		result[n - 1 - x] = city;
+	}
+	
+	memFree(starts);
+	memFree(degree);
+	memFree(seen);
+	memFree(neighbours);
+	
+	return result;
+}
+
+/*
+ Renumbers the cities of a graph so that the city at place i of order takes index i, moving
+ each city's edges, weights and risks along with it. Edges keep their order within a city.
+*/
+static void renumberGraph(sgraph* graph, long int* order)
+{
+	long int n = graph->size;
+	long int m = graph->edges;
+	long int* newIndex = (long int*)memAlloc(MEM_SCRATCH, sizeof(long int) * (n + 1));
+	cn** cities = (cn**)memAlloc(MEM_GRAPH, sizeof(cn*) * (n + 1));
+	long int* outStart = (long int*)memAlloc(MEM_GRAPH, sizeof(long int) * (n + 1));
+	long int* outTo = (long int*)memAlloc(MEM_GRAPH, sizeof(long int) * (m + 1));
+	dist_t* outDist = (dist_t*)memAlloc(MEM_GRAPH, sizeof(dist_t) * (m + 1));
+	dist_t* outRisk = (dist_t*)memAlloc(MEM_GRAPH, sizeof(dist_t) * (m + 1));
+	long int* inStart = (long int*)memAlloc(MEM_GRAPH, sizeof(long int) * (n + 1));
+	long int* inFrom = (long int*)memAlloc(MEM_GRAPH, sizeof(long int) * (m + 1));
+	dist_t* inDist = (dist_t*)memAlloc(MEM_GRAPH, sizeof(dist_t) * (m + 1));
+	dist_t* inRisk = (dist_t*)memAlloc(MEM_GRAPH, sizeof(dist_t) * (m + 1));
+	long int out = 0;
+	long int in = 0;
+	long int old;
+	long int e;
+	long int i;
+	
+	for(i = 0; i < n; i++) newIndex[order[i]] = i;
+	
+	for(i = 0; i < n; i++) {
+		old = order[i];
+		cities[i] = graph->cities[old];
+		cities[i]->index = i;
+		outStart[i] = out;
+		for(e = graph->outStart[old]; e < graph->outStart[old + 1]; e++, out++) {
+			outTo[out] = newIndex[graph->outTo[e]];
+			outDist[out] = graph->outDist[e];
+			outRisk[out] = graph->outRisk[e];
+		}
+		inStart[i] = in;
+		for(e = graph->inStart[old]; e < graph->inStart[old + 1]; e++, in++) {
+			inFrom[in] = newIndex[graph->inFrom[e]];
+			inDist[in] = graph->inDist[e];
+			inRisk[in] = graph->inRisk[e];
+		}
+	}
+	outStart[n] = out;
+	inStart[n] = in;
+	
+	memFree(graph->cities);
+	memFree(graph->outStart);
+	memFree(graph->outTo);
+	memFree(graph->outDist);
+	memFree(graph->outRisk);
+	memFree(graph->inStart);
+	memFree(graph->inFrom);
+	memFree(graph->inDist);
+	memFree(graph->inRisk);
+	graph->cities = cities;
+	graph->outStart = outStart;
+	graph->outTo = outTo;
+	graph->outDist = outDist;
+	graph->outRisk = outRisk;
+	graph->inStart = inStart;
+	graph->inFrom = inFrom;
+	graph->inDist = inDist;
+	graph->inRisk = inRisk;
+	
+	for(i = 0; i < n; i++) graph->loadOrder[i] = newIndex[graph->loadOrder[i]];
+	memFree(newIndex);
+}
+
+/*
+ Splits a graph into strongly connected components with Tarjan's algorithm, run with an explicit
+ stack instead of recursion so a long chain of cities cannot overflow the call stack. Tarjan's
+ algorithm finishes a component only after every component it leads to, so components come out
+ numbered in reverse topological order, and a city can only reach cities whose component number
+ is no higher than its own. Edges of DIST_INF, such as closed roads, lead nowhere and are skipped.
+ 
+ The resource bits of each component are then carried along every edge between components, in
+ topological order, so each component ends up with the bits of every city that can reach it.
+*/
+static void findComponents(sgraph* graph)
+{
+	long int n = graph->size;
+	long int* found = (long int*)memAlloc(MEM_SCRATCH, sizeof(long int) * (n + 1));
+	long int* low = (long int*)memAlloc(MEM_SCRATCH, sizeof(long int) * (n + 1));
+	long int* stack = (long int*)memAlloc(MEM_SCRATCH, sizeof(long int) * (n + 1));
+	long int* members = (long int*)memAlloc(MEM_SCRATCH, sizeof(long int) * (n + 1));
+	long int* memberStart = (long int*)memAlloc(MEM_SCRATCH, sizeof(long int) * (n + 2));
+	long int* callCity = (long int*)memAlloc(MEM_SCRATCH, sizeof(long int) * (n + 1));
+	long int* callEdge = (long int*)memAlloc(MEM_SCRATCH, sizeof(long int) * (n + 1));
+	char* onStack = (char*)memCalloc(MEM_SCRATCH, n + 1, sizeof(char));
+	long int stackSize = 0;
+	long int memberCount = 0;
+	long int depth;
+	long int counter = 0;
+	long int root;
+	long int city;
+	long int next;
+	long int c;
+	long int e;
+	long int x;
+	
+	graph->components = 0;
+	graph->component = (long int*)memAlloc(MEM_GRAPH, sizeof(long int) * (n + 1));
+	graph->reachers = (unsigned char*)memCalloc(MEM_GRAPH, n + 1, sizeof(unsigned char));
+	for(city = 0; city < n; city++) found[city] = -1;
+	
+	for(root = 0; root < n; root++) {
+		if(found[root] != -1) continue;
+		
+		found[root] = low[root] = counter++;
+		stack[stackSize++] = root;
+		onStack[root] = 1;
+		callCity[0] = root;
+		callEdge[0] = graph->outStart[root];
+		depth = 1;
+		
+		while(depth > 0) {
+			city = callCity[depth - 1];
+			
+			// Step along the next edge, descending into a city not seen yet.
+			if(callEdge[depth - 1] < graph->outStart[city + 1]) {
+				e = callEdge[depth - 1]++;
+				next = graph->outTo[e];
+				if(graph->outDist[e] == DIST_INF) continue;
+				if(found[next] == -1) {
+					found[next] = low[next] = counter++;
+					stack[stackSize++] = next;
+					onStack[next] = 1;
+					callCity[depth] = next;
+					callEdge[depth] = graph->outStart[next];
+					depth++;
+				}
+				else if(onStack[next] && found[next] < low[city]) low[city] = found[next];
+				continue;
+			}
+			
+			// Every edge is done: a city that reached nothing above it closes a component.
+			if(low[city] == found[city]) {
+				memberStart[graph->components] = memberCount;
+				do {
+					next = stack[--stackSize];
+					onStack[next] = 0;
+					graph->component[next] = graph->components;
+					members[memberCount++] = next;
+				} while(next != city);
+				graph->components++;
+			}
+			depth--;
+			if(depth > 0 && low[city] < low[callCity[depth - 1]]) low[callCity[depth - 1]] = low[city];
+		}
+	}
+	memberStart[graph->components] = memberCount;
+	
+	for(city = 0; city < n; city++) graph->reachers[graph->component[city]] |= graph->resources[city];
+	for(c = graph->components - 1; c >= 0; c--) {
+		for(x = memberStart[c]; x < memberStart[c + 1]; x++) {
+			for(e = graph->outStart[members[x]]; e < graph->outStart[members[x] + 1]; e++) {
+				if(graph->outDist[e] != DIST_INF && graph->component[graph->outTo[e]] != c) graph->reachers[graph->component[graph->outTo[e]]] |= graph->reachers[c];
+			}
+		}
+	}
+	
+	memFree(found);
+	memFree(low);
+	memFree(stack);
+	memFree(members);
+	memFree(memberStart);
+	memFree(callCity);
+	memFree(callEdge);
+	memFree(onStack);
+}
+
+/*
+ Builds the search graph for a linked database.
+ Every city is given its index, and every travel table that points at a
+ city in the database becomes an edge. Travel tables to unknown cities are
+ dropped. Cities are indexed in database order, or renumbered afterwards by
+ the given ORDER_ ordering.
+ 
+ Returns the new search graph.
+*/
+sgraph* buildSearchGraph(cdb* db, int order)
+{
+	sgraph* graph = (sgraph*)memAlloc(MEM_GRAPH, sizeof(sgraph));
+	cdbn* node;
+	cn* city;
+	long int n = 0;
+	long int m = 0;
+	long int x;
+	long int e;
+	long int i;
+	
+	for(node = db->chead; node != NULL; node = node->next) {
+		node->cur->index = n++;
+		for(x = 0; x < node->cur->ttsize; x++) {
+			if(node->cur->goes_to[x]->citypntr != NULL) m++;
+		}
+	}
+	
+	graph->size = n;
+	graph->edges = m;
+	graph->maxWeight = 0;
+	graph->shortcuts = 0;
+	graph->outVia = NULL;
+	graph->inVia = NULL;
+	graph->viaStart = NULL;
+	graph->viaCity = NULL;
+	graph->viaDist = NULL;
+	graph->outPacked = NULL;
+	graph->inPacked = NULL;
+	graph->cities = (cn**)memAlloc(MEM_GRAPH, sizeof(cn*) * (n + 1));
+	graph->outStart = (long int*)memAlloc(MEM_GRAPH, sizeof(long int) * (n + 1));
+	graph->outTo = (long int*)memAlloc(MEM_GRAPH, sizeof(long int) * (m + 1));
+	graph->outDist = (dist_t*)memAlloc(MEM_GRAPH, sizeof(dist_t) * (m + 1));
+	graph->outRisk = (dist_t*)memAlloc(MEM_GRAPH, sizeof(dist_t) * (m + 1));
+	graph->inStart = (long int*)memCalloc(MEM_GRAPH, n + 1, sizeof(long int));
+	graph->inFrom = (long int*)memAlloc(MEM_GRAPH, sizeof(long int) * (m + 1));
+	graph->inDist = (dist_t*)memAlloc(MEM_GRAPH, sizeof(dist_t) * (m + 1));
+	graph->inRisk = (dist_t*)memAlloc(MEM_GRAPH, sizeof(dist_t) * (m + 1));
+	
+	// Forward edges, in travel table order.
+	e = 0;
+	for(node = db->chead; node != NULL; node = node->next) {
+		city = node->cur;
+		graph->cities[city->index] = city;
+		graph->outStart[city->index] = e;
+		for(x = 0; x < city->ttsize; x++) {
+			if(city->goes_to[x]->citypntr == NULL) continue;
+			graph->outTo[e] = city->goes_to[x]->citypntr->index;
+			graph->outDist[e] = distClamp(city->goes_to[x]->distance);
+			graph->outRisk[e] = distClamp(city->goes_to[x]->risk);
+			if(graph->outDist[e] > graph->maxWeight) graph->maxWeight = graph->outDist[e];
+			graph->inStart[graph->outTo[e] + 1]++;
+			e++;
+		}
+	}
+	graph->outStart[n] = e;
+	
+	// Reverse edges, counted above and placed with a prefix sum.
+	for(i = 0; i < n; i++) graph->inStart[i + 1] += graph->inStart[i];
+	long int* fill = (long int*)memAlloc(MEM_SCRATCH, sizeof(long int) * (n + 1));
+	memcpy(fill, graph->inStart, sizeof(long int) * (n + 1));
+	for(i = 0; i < n; i++) {
+		for(e = graph->outStart[i]; e < graph->outStart[i + 1]; e++) {
+			graph->inFrom[fill[graph->outTo[e]]] = i;
+			graph->inDist[fill[graph->outTo[e]]] = graph->outDist[e];
+			graph->inRisk[fill[graph->outTo[e]]] = graph->outRisk[e];
+			fill[graph->outTo[e]]++;
+		}
+	}
+	memFree(fill);
+	
+	graph->loadOrder = (long int*)memAlloc(MEM_GRAPH, sizeof(long int) * (n + 1));
+	for(i = 0; i < n; i++) graph->loadOrder[i] = i;
+	if(order != ORDER_NONE && n > 0) {
+		long int* places = localOrder(graph, order);
+		renumberGraph(graph, places);
+		memFree(places);
+	}
+	
+	// Resource bits and the ID table, laid out in the final order.
+	graph->resources = (unsigned char*)memCalloc(MEM_GRAPH, n + 1, sizeof(unsigned char));
+	graph->byID = (long int*)memAlloc(MEM_GRAPH, sizeof(long int) * (n + 1));
+	for(i = 0; i < n; i++) {
+		graph->resources[i] = cityOffers(graph->cities[i]);
+		graph->byID[i] = i;
+	}
+	sortGraph = graph;
+	qsort(graph->byID, n, sizeof(long int), compareIDs);
+	
+	findComponents(graph);
+	
+	return graph;
+}
+
+/*
+ Copies a search graph, plain or packed, into a new plain one with some roads edited: every
+ edge from edits[k].from to edits[k].to, for k up to count - 1, gets a distance and risk of
+ DIST_INF in both directions if the edit closes it, so no search ever takes it, or else the
+ edit's distance if it has one. Cities and edges keep their indexes, so anything keyed by edge
+ number still applies. If stock is not NULL, a city with an entry there is replaced by it, and
+ takes its resource bits, so the copy can offer other resources than the graph copied. The
+ components are found again with the edits and the stock; shortcuts are not copied.
+ 
+ Returns the new search graph.
+*/
+sgraph* copySearchGraph(sgraph* graph, cn** stock, redit* edits, long int count)
+{
+	sgraph* copy = (sgraph*)memAlloc(MEM_GRAPH, sizeof(sgraph));
+	sedges* edges = newSearchEdges();
+	long int n = graph->size;
+	long int m = graph->edges;
+	long int city;
+	long int e;
+	long int k;
+	
+	copy->size = n;
+	copy->edges = m;
+	copy->maxWeight = graph->maxWeight;
+	copy->shortcuts = 0;
+	copy->outVia = NULL;
+	copy->inVia = NULL;
+	copy->viaStart = NULL;
+	copy->viaCity = NULL;
+	copy->viaDist = NULL;
+	copy->outPacked = NULL;
+	copy->inPacked = NULL;
+	copy->cities = (cn**)memAlloc(MEM_GRAPH, sizeof(cn*) * (n + 1));
+	copy->outStart = (long int*)memAlloc(MEM_GRAPH, sizeof(long int) * (n + 1));
+	copy->outTo = (long int*)memAlloc(MEM_GRAPH, sizeof(long int) * (m + 1));
+	copy->outDist = (dist_t*)memAlloc(MEM_GRAPH, sizeof(dist_t) * (m + 1));
+	copy->outRisk = (dist_t*)memAlloc(MEM_GRAPH, sizeof(dist_t) * (m + 1));
+	copy->inStart = (long int*)memAlloc(MEM_GRAPH, sizeof(long int) * (n + 1));
+	copy->inFrom = (long int*)memAlloc(MEM_GRAPH, sizeof(long int) * (m + 1));
+	copy->inDist = (dist_t*)memAlloc(MEM_GRAPH, sizeof(dist_t) * (m + 1));
+	copy->inRisk = (dist_t*)memAlloc(MEM_GRAPH, sizeof(dist_t) * (m + 1));
+	copy->resources = (unsigned char*)memAlloc(MEM_GRAPH, sizeof(unsigned char) * (n + 1));
+	copy->byID = (long int*)memAlloc(MEM_GRAPH, sizeof(long int) * (n + 1));
+	copy->loadOrder = (long int*)memAlloc(MEM_GRAPH, sizeof(long int) * (n + 1));
+	memcpy(copy->cities, graph->cities, sizeof(cn*) * n);
+	memcpy(copy->outStart, graph->outStart, sizeof(long int) * (n + 1));
+	memcpy(copy->inStart, graph->inStart, sizeof(long int) * (n + 1));
+	memcpy(copy->resources, graph->resources, sizeof(unsigned char) * n);
+	memcpy(copy->byID, graph->byID, sizeof(long int) * n);
+	memcpy(copy->loadOrder, graph->loadOrder, sizeof(long int) * n);
+	for(city = 0; stock != NULL && city < n; city++) {
+		if(stock[city] == NULL) continue;
+		copy->cities[city] = stock[city];
+		copy->resources[city] = cityOffers(stock[city]);
+	}
+	
+	for(city = 0; city < n; city++) {
+		searchEdges(graph, city, SEARCH_FORWARD, 1, edges);
+		memcpy(copy->outTo + edges->first, edges->to, sizeof(long int) * edges->count);
+		memcpy(copy->outDist + edges->first, edges->dist, sizeof(dist_t) * edges->count);
+		memcpy(copy->outRisk + edges->first, edges->risk, sizeof(dist_t) * edges->count);
+		searchEdges(graph, city, SEARCH_BACKWARD, 1, edges);
+		memcpy(copy->inFrom + edges->first, edges->to, sizeof(long int) * edges->count);
+		memcpy(copy->inDist + edges->first, edges->dist, sizeof(dist_t) * edges->count);
+		memcpy(copy->inRisk + edges->first, edges->risk, sizeof(dist_t) * edges->count);
+	}
+	purgeSearchEdges(edges);
+	
+	for(k = 0; k < count; k++) {
+		if(!edits[k].closed && edits[k].distance < 0) continue;
+		for(e = copy->outStart[edits[k].from]; e < copy->outStart[edits[k].from + 1]; e++) {
+			if(copy->outTo[e] != edits[k].to) continue;
+			copy->outDist[e] = edits[k].closed ? DIST_INF : distClamp(edits[k].distance);
+			if(edits[k].closed) copy->outRisk[e] = DIST_INF;
+		}
+		for(e = copy->inStart[edits[k].to]; e < copy->inStart[edits[k].to + 1]; e++) {
+			if(copy->inFrom[e] != edits[k].from) continue;
+			copy->inDist[e] = edits[k].closed ? DIST_INF : distClamp(edits[k].distance);
+			if(edits[k].closed) copy->inRisk[e] = DIST_INF;
+		}
+		if(!edits[k].closed && edits[k].distance > copy->maxWeight) copy->maxWeight = edits[k].distance;
+	}
+	
+	findComponents(copy);
+	
+	return copy;
+}
+
+/*
+ Returns the resource bits of every city that can reach the given one, the city included, so a
+ resource whose bit is missing is not available there however far a search goes.
+*/
+unsigned char searchReachers(sgraph* graph, long int city)
+{
+	return graph->reachers[graph->component[city]];
+}
+
+/*
+ Returns 0 if one city certainly cannot reach another, as it sits in a component ordered after
+ the other's, and 1 if it may.
+*/
+int searchMayReach(sgraph* graph, long int from, long int to)
+{
+	return graph->component[from] >= graph->component[to];
+}
+
+/*
+ Returns the index of the city with the given ID, or -1 if there is no such city.
+*/
+long int searchIndexOf(sgraph* graph, long int id)
+{
+	long int low = 0;
+	long int high = graph->size - 1;
+	long int mid;
+	
+	while(low <= high) {
+		mid = low + (high - low) / 2;
+		if(graph->cities[graph->byID[mid]]->id == id) return graph->byID[mid];
+		if(graph->cities[graph->byID[mid]]->id < id) low = mid + 1;
+		else high = mid - 1;
+	}
+	
+	return -1;
+}
+
+void purgeSearchGraph(sgraph* graph)
+{
+	if(graph == NULL) return;
+	memFree(graph->cities);
+	memFree(graph->outStart);
+	memFree(graph->outTo);
+	memFree(graph->outDist);
+	memFree(graph->outRisk);
+	memFree(graph->inStart);
+	memFree(graph->inFrom);
+	memFree(graph->inDist);
+	memFree(graph->inRisk);
+	memFree(graph->resources);
+	memFree(graph->byID);
+	memFree(graph->loadOrder);
+	memFree(graph->component);
+	memFree(graph->reachers);
+	memFree(graph->outVia);
+	memFree(graph->inVia);
+	memFree(graph->viaStart);
+	memFree(graph->viaCity);
+	memFree(graph->viaDist);
+	purgePackedAdjacency(graph->outPacked);
+	purgePackedAdjacency(graph->inPacked);
+	memFree(graph);
+}
+
+/*
+ Creates an empty edge view for searchEdges. Its buffers are only allocated once it is used on
+ a packed graph.
+*/
+sedges* newSearchEdges(void)
+{
+	sedges* edges = (sedges*)memAlloc(MEM_SCRATCH, sizeof(sedges));
+	
+	edges->count = 0;
+	edges->first = 0;
+	edges->to = NULL;
+	edges->dist = NULL;
+	edges->risk = NULL;
+	edges->capacity = 0;
+	edges->toBuffer = NULL;
+	edges->distBuffer = NULL;
+	edges->riskBuffer = NULL;
+	
+	return edges;
+}
+
+void purgeSearchEdges(sedges* edges)
+{
+	if(edges == NULL) return;
+	memFree(edges->toBuffer);
+	memFree(edges->distBuffer);
+	memFree(edges->riskBuffer);
+	memFree(edges);
+}
+
+/*
+ Fills an edge view with the edges leaving a city (SEARCH_FORWARD) or arriving at it
+ (SEARCH_BACKWARD). A packed graph's edges are decoded, their risks only if risks is 1;
+ a plain graph's are simply pointed at.
+*/
+void searchEdges(sgraph* graph, long int city, int direction, int risks, sedges* edges)
+{
+	int forward = direction == SEARCH_FORWARD;
+	long int* start = forward ? graph->outStart : graph->inStart;
+	
+	edges->first = start[city];
+	edges->count = start[city + 1] - start[city];
+	
+	if(graph->outPacked == NULL) {
+		edges->to = (forward ? graph->outTo : graph->inFrom) + edges->first;
+		edges->dist = (forward ? graph->outDist : graph->inDist) + edges->first;
+		edges->risk = (forward ? graph->outRisk : graph->inRisk) + edges->first;
+		return;
+	}
+	
+	if(edges->count > edges->capacity) {
+		edges->capacity = edges->count > 2 * edges->capacity ? edges->count : 2 * edges->capacity;
+		memFree(edges->toBuffer);
+		memFree(edges->distBuffer);
+		memFree(edges->riskBuffer);
+		edges->toBuffer = (long int*)memAlloc(MEM_SCRATCH, sizeof(long int) * edges->capacity);
+		edges->distBuffer = (dist_t*)memAlloc(MEM_SCRATCH, sizeof(dist_t) * edges->capacity);
+		edges->riskBuffer = (dist_t*)memAlloc(MEM_SCRATCH, sizeof(dist_t) * edges->capacity);
+	}
+	unpackEdges(forward ? graph->outPacked : graph->inPacked, city, edges->first, edges->count, risks,
+				edges->toBuffer, edges->distBuffer, edges->riskBuffer);
+	edges->to = edges->toBuffer;
+	edges->dist = edges->distBuffer;
+	edges->risk = edges->riskBuffer;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////QUERY CONTEXT//////////////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/*
+ Creates a query context large enough for a graph of the given size.
+ This is the only allocation a query ever needs.
+*/
+qctx* newQueryContext(long int size)
+{
+	qctx* ctx = (qctx*)memAlloc(MEM_SCRATCH, sizeof(qctx));
+	
+	ctx->size = size;
+	ctx->version = 0;
+	ctx->stamp = (unsigned int*)memCalloc(MEM_SCRATCH, size + 1, sizeof(unsigned int));
+	ctx->done = (unsigned int*)memCalloc(MEM_SCRATCH, size + 1, sizeof(unsigned int));
+	ctx->dist = (dist_t*)memAlloc(MEM_SCRATCH, sizeof(dist_t) * (size + 1));
+	ctx->pred = (long int*)memAlloc(MEM_SCRATCH, sizeof(long int) * (size + 1));
+	ctx->heap = (long int*)memAlloc(MEM_SCRATCH, sizeof(long int) * (size + 1));
+	ctx->heapPos = (long int*)memAlloc(MEM_SCRATCH, sizeof(long int) * (size + 1));
+	ctx->heapSize = 0;
+	ctx->queue = QUEUE_HEAP;
+	ctx->useBuckets = 0;
+	ctx->bucketSpan = 0;
+	ctx->bucketCursor = 0;
+	ctx->bucket = NULL;
+	ctx->bucketNext = NULL;
+	ctx->bucketPrev = NULL;
+	ctx->edges = newSearchEdges();
+	ctx->limit = DIST_INF;
+	
+	ctx->path = newPath(-1, 0, 0, (tt**)memAlloc(MEM_SCRATCH, sizeof(tt*) * (size + 1)));
+	initPathTT(ctx->path, size + 1);
+	
+	return ctx;
+}
+
+void purgeQueryContext(qctx* ctx)
+{
+	if(ctx == NULL) return;
+	purgePath(ctx->path);
+	memFree(ctx->stamp);
+	memFree(ctx->done);
+	memFree(ctx->dist);
+	memFree(ctx->pred);
+	memFree(ctx->heap);
+	memFree(ctx->heapPos);
+	memFree(ctx->bucket);
+	memFree(ctx->bucketNext);
+	memFree(ctx->bucketPrev);
+	purgeSearchEdges(ctx->edges);
+	memFree(ctx);
+}
+
+/*
+ Chooses the queue a context's searches use. QUEUE_BUCKETS needs the longest edge the searches
+ will relax; when it is too long for MAX_BUCKETS buckets, the binary heap is kept instead.
+ Searches that turn out to need longer steps than promised still work, falling back to the heap.
+ 
+ Returns the queue chosen.
+*/
+int searchQueue(qctx* ctx, int queue, long int maxWeight)
+{
+	long int span = 1;
+	
+	if(queue == QUEUE_BUCKETS) {
+		while(span <= maxWeight && span < MAX_BUCKETS) span *= 2;
+		if(span <= maxWeight) queue = QUEUE_HEAP;
+	}
+	
+	ctx->queue = queue;
+	if(queue == QUEUE_HEAP || span == ctx->bucketSpan) return queue;
+	
+	memFree(ctx->bucket);
+	ctx->bucketSpan = span;
+	ctx->bucket = (long int*)memAlloc(MEM_SCRATCH, sizeof(long int) * span);
+	for(span = 0; span < ctx->bucketSpan; span++) ctx->bucket[span] = -1;
+	if(ctx->bucketNext == NULL) {
+		ctx->bucketNext = (long int*)memAlloc(MEM_SCRATCH, sizeof(long int) * (ctx->size + 1));
+		ctx->bucketPrev = (long int*)memAlloc(MEM_SCRATCH, sizeof(long int) * (ctx->size + 1));
+	}
+	
+	return queue;
+}
+
+/*
+ Makes a city's slots valid for the current query, the first time the
+ query touches it.
+*/
+static void touch(qctx* ctx, long int city)
+{
+	if(ctx->stamp[city] == ctx->version) return;
+	ctx->stamp[city] = ctx->version;
+	ctx->dist[city] = DIST_INF;
+	ctx->pred[city] = -1;
+	ctx->heapPos[city] = -1;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////HEAP///////////////////////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+static void heapPlace(qctx* ctx, long int slot, long int city)
+{
+	ctx->heap[slot] = city;
+	ctx->heapPos[city] = slot;
+}
+
+/*
+ Moves the city at the given heap slot up until its parent is no further away.
+*/
+static void heapUp(qctx* ctx, long int slot)
+{
+	long int city = ctx->heap[slot];
+	long int parent;
+	
+	while(slot > 0) {
+		parent = (slot - 1) / 2;
+		if(ctx->dist[ctx->heap[parent]] <= ctx->dist[city]) break;
+		heapPlace(ctx, slot, ctx->heap[parent]);
+		slot = parent;
+	}
+	heapPlace(ctx, slot, city);
+}
+
+/*
+ Moves the city at the given heap slot down until neither child is nearer.
+*/
+static void heapDown(qctx* ctx, long int slot)
+{
+	long int city = ctx->heap[slot];
+	long int child;
+	
+	while((child = slot * 2 + 1) < ctx->heapSize) {
+		if(child + 1 < ctx->heapSize && ctx->dist[ctx->heap[child + 1]] < ctx->dist[ctx->heap[child]]) child++;
+		if(ctx->dist[ctx->heap[child]] >= ctx->dist[city]) break;
+		heapPlace(ctx, slot, ctx->heap[child]);
+		slot = child;
+	}
+	heapPlace(ctx, slot, city);
+}
+
+/*
+ Adds a city to the heap, or moves it up if it is already there.
+*/
+static void heapPush(qctx* ctx, long int city)
+{
+	STAT_INC(STAT_HEAPOPS);
+	if(ctx->heapPos[city] == -1) {
+		ctx->heapPos[city] = ctx->heapSize;
+		ctx->heap[ctx->heapSize++] = city;
+	}
+	heapUp(ctx, ctx->heapPos[city]);
+}
+
+/*
+ Removes and returns the nearest city in the heap.
+*/
+static long int heapPop(qctx* ctx)
+{
+	STAT_INC(STAT_HEAPOPS);
+	long int city = ctx->heap[0];
+	
+	ctx->heapSize--;
+	if(ctx->heapSize > 0) {
+		heapPlace(ctx, 0, ctx->heap[ctx->heapSize]);
+		heapDown(ctx, 0);
+	}
+	ctx->heapPos[city] = -1;
+	
+	return city;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////BUCKETS////////////////////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/*
+ Unlinks a queued city from its bucket.
+*/
+static void bucketRemove(qctx* ctx, long int city)
+{
+	if(ctx->bucketPrev[city] == -1) ctx->bucket[ctx->heapPos[city]] = ctx->bucketNext[city];
+	else ctx->bucketNext[ctx->bucketPrev[city]] = ctx->bucketNext[city];
+	if(ctx->bucketNext[city] != -1) ctx->bucketPrev[ctx->bucketNext[city]] = ctx->bucketPrev[city];
+}
+
+/*
+ Links a city into the bucket for its distance.
+*/
+static void bucketInsert(qctx* ctx, long int city)
+{
+	long int slot = ctx->dist[city] & (ctx->bucketSpan - 1);
+	
+	ctx->bucketPrev[city] = -1;
+	ctx->bucketNext[city] = ctx->bucket[slot];
+	if(ctx->bucket[slot] != -1) ctx->bucketPrev[ctx->bucket[slot]] = city;
+	ctx->bucket[slot] = city;
+	ctx->heapPos[city] = slot;
+}
+
+/*
+ Moves every queued city from the bucket ring into the binary heap, which the
+ rest of the query then uses.
+*/
+static void bucketsToHeap(qctx* ctx)
+{
+	long int slot;
+	long int city;
+	long int n = 0;
+	
+	for(slot = 0; slot < ctx->bucketSpan && n < ctx->heapSize; slot++) {
+		for(city = ctx->bucket[slot]; city != -1; city = ctx->bucketNext[city]) {
+			heapPlace(ctx, n++, city);
+		}
+		ctx->bucket[slot] = -1;
+	}
+	for(slot = ctx->heapSize / 2 - 1; slot >= 0; slot--) heapDown(ctx, slot);
+	ctx->useBuckets = 0;
+}
+
+/*
+ Removes and returns the nearest city in the bucket ring, for callers that know the query is
+ using it.
+*/
+static long int bucketPop(qctx* ctx)
+{
+	long int city;
+	
+	STAT_INC(STAT_HEAPOPS);
+	while(ctx->bucket[ctx->bucketCursor & (ctx->bucketSpan - 1)] == -1) ctx->bucketCursor++;
+	city = ctx->bucket[ctx->bucketCursor & (ctx->bucketSpan - 1)];
+	bucketRemove(ctx, city);
+	ctx->heapPos[city] = -1;
+	ctx->heapSize--;
+	
+	return city;
+}
+
+/*
+ Queues a city at its current distance, or moves it if it is already queued.
+*/
+static void queuePush(qctx* ctx, long int city)
+{
+	if(ctx->useBuckets) {
+		if(ctx->heapSize == 0) ctx->bucketCursor = ctx->dist[city];
+		if(ctx->dist[city] >= ctx->bucketCursor && ctx->dist[city] - ctx->bucketCursor < ctx->bucketSpan) {
+			STAT_INC(STAT_HEAPOPS);
+			if(ctx->heapPos[city] != -1) bucketRemove(ctx, city);
+			else ctx->heapSize++;
+			bucketInsert(ctx, city);
+			return;
+		}
+		bucketsToHeap(ctx);
+	}
+	heapPush(ctx, city);
+}
+
+/*
+ Removes and returns the nearest queued city.
+*/
+static long int queuePop(qctx* ctx)
+{
+	return ctx->useBuckets ? bucketPop(ctx) : heapPop(ctx);
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////SEARCH/////////////////////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/*
+ Starts a new query on the context. Nothing is cleared; bumping the version
+ invalidates every slot from the previous query at once.
+*/
+void searchBegin(qctx* ctx)
+{
+	long int slot;
+	
+	// A query that stopped early leaves cities in the buckets.
+	if(ctx->useBuckets && ctx->heapSize > 0) {
+		for(slot = 0; slot < ctx->bucketSpan; slot++) ctx->bucket[slot] = -1;
+	}
+	
+	ctx->version++;
+	ctx->heapSize = 0;
+	ctx->limit = DIST_INF;
+	ctx->useBuckets = ctx->queue == QUEUE_BUCKETS;
+	
+	// The version has wrapped around, so old stamps could look current again.
+	if(ctx->version == 0) {
+		memset(ctx->stamp, 0, sizeof(unsigned int) * (ctx->size + 1));
+		memset(ctx->done, 0, sizeof(unsigned int) * (ctx->size + 1));
+		ctx->version = 1;
+	}
+}
+
+/*
+ Adds a source city to the current query at the given distance.
+*/
+void searchSeed(qctx* ctx, long int city, long int distance)
+{
+	distance = distClamp(distance);
+	touch(ctx, city);
+	if(distance >= ctx->dist[city]) return;
+	ctx->dist[city] = distance;
+	ctx->pred[city] = -1;
+	queuePush(ctx, city);
+}
+
+/*
+ Bounds the current query to the given distance from its sources: cities further away are never
+ queued, so the search ends once it has settled every city within the limit rather than the whole
+ graph, and its queue only ever holds cities inside it. Sources must be seeded within the limit.
+*/
+void searchLimit(qctx* ctx, long int limit)
+{
+	ctx->limit = distClamp(limit);
+}
+
+/*
+ Keeps the current query out of a city: it is treated as already settled,
+ so it is never reached or passed through.
+*/
+void searchBlock(qctx* ctx, long int city)
+{
+	touch(ctx, city);
+	ctx->done[city] = ctx->version;
+}
+
+/*
+ Settles the nearest unsettled city of the current query without relaxing
+ its edges, for engines that work out edge weights themselves and feed them
+ back through searchRelax.
+ 
+ Returns the index of the city settled.
+ Returns -1 when every reachable city has been settled.
+*/
+long int searchSettle(qctx* ctx)
+{
+	if(ctx->heapSize == 0) return -1;
+	
+	long int city = queuePop(ctx);
+	ctx->done[city] = ctx->version;
+	STAT_INC(STAT_SETTLED);
+	
+	return city;
+}
+
+/*
+ Lowers a city's distance to the given one, reached from the city from, if it is shorter, and
+ queues the city. Settled and blocked cities are left alone, as are distances past the limit.
+*/
+static void improve(qctx* ctx, long int from, long int city, dist_t distance)
+{
+	if(ctx->done[city] == ctx->version || distance > ctx->limit) return;
+	touch(ctx, city);
+	if(distance < ctx->dist[city]) {
+		ctx->dist[city] = distance;
+		ctx->pred[city] = from;
+		queuePush(ctx, city);
+	}
+}
+
+/*
+ Offers the current query a new distance to a city, reached from another.
+ Settled cities are left alone, as are distances saturated at DIST_INF.
+*/
+void searchRelax(qctx* ctx, long int from, long int city, dist_t distance)
+{
+	STAT_INC(STAT_RELAXED);
+	improve(ctx, from, city, distance);
+}
+
+#if defined(__GNUC__)
+#define STEP_INLINE static inline __attribute__((always_inline))
+#else
+#define STEP_INLINE static inline
+#endif
+
+/*
+ One step of a search: settles the nearest unsettled city and relaxes its edges. Every feature
+ a query may or may not use is a constant here, so each copy made by SEARCH_VARIANT keeps only
+ the code its query needs:
+ 
+ - forward picks the direction's travel tables.
+ - packed decodes the edges through searchEdges; otherwise the plain arrays are read in place.
+ - buckets pops from the bucket ring; otherwise from the heap. A push that falls outside the
+   ring still moves the query onto the heap, through queuePush.
+ - limited leaves out cities past the query's limit.
+ - targeted carries on settling until a city offering one of the resources in wanted is
+   settled, so searches after the nearest providers of a resource set skip the others without
+   leaving the loop.
+ 
+ Returns the index of the city settled (for targeted steps, the provider).
+ Returns -1 when every reachable city has been settled.
+*/
+STEP_INLINE long int searchStep(qctx* ctx, sgraph* graph, unsigned char wanted,
+								const int forward, const int packed, const int buckets, const int limited, const int targeted)
+{
+	const long int* start = forward ? graph->outStart : graph->inStart;
+	const long int* to;
+	const dist_t* weight;
+	long int improved[RELAX_BATCH];
+	long int city;
+	long int count;
+	long int found;
+	long int next;
+	long int e;
+	long int k;
+	dist_t base;
+	dist_t distance;
+	
+	do {
+		if(ctx->heapSize == 0) return -1;
+		
+		// A push outside the ring has moved the query onto the heap, which the heap's own step takes.
+		if(buckets && !ctx->useBuckets) return targeted ? searchNextProvider(ctx, graph, forward ? SEARCH_FORWARD : SEARCH_BACKWARD, wanted)
+																: searchNext(ctx, graph, forward ? SEARCH_FORWARD : SEARCH_BACKWARD);
+		
+		city = buckets ? bucketPop(ctx) : heapPop(ctx);
+		ctx->done[city] = ctx->version;
+		STAT_INC(STAT_SETTLED);
+		
+		if(packed) {
+			searchEdges(graph, city, forward ? SEARCH_FORWARD : SEARCH_BACKWARD, 0, ctx->edges);
+			to = ctx->edges->to;
+			weight = ctx->edges->dist;
+			count = ctx->edges->count;
+		}
+		else {
+			to = (forward ? graph->outTo : graph->inFrom) + start[city];
+			weight = (forward ? graph->outDist : graph->inDist) + start[city];
+			count = start[city + 1] - start[city];
+		}
+		base = ctx->dist[city];
+		
+		// The kernel picks out the edges that improve on a known distance, and only those are relaxed.
+		for(e = 0; e < count; e += RELAX_BATCH) {
+			found = relaxKernel(to + e, weight + e, count - e < RELAX_BATCH ? count - e : RELAX_BATCH, base, ctx->dist, ctx->stamp, ctx->version, improved);
+			STAT_ADD(STAT_RELAXED, count - e < RELAX_BATCH ? count - e : RELAX_BATCH);
+			for(k = 0; k < found; k++) {
+				next = to[e + improved[k]];
+				distance = base + weight[e + improved[k]];
+				if(ctx->done[next] == ctx->version || (limited && distance > ctx->limit)) continue;
+				touch(ctx, next);
+				if(distance >= ctx->dist[next]) continue;
+				ctx->dist[next] = distance;
+				ctx->pred[next] = city;
+				if(buckets) queuePush(ctx, next);
+				else heapPush(ctx, next);
+			}
+		}
+	} while(targeted && !(graph->resources[city] & wanted));
+	
+	return city;
+}
+
+/*
+ Makes the copy of searchStep for one combination of its features, named after them.
+ SEARCH_VARIANTS lists every combination in the order of their number in searchVariant, so
+ searchSteps can be filled from the same list.
+*/
+#define SEARCH_VARIANT(forward, packed, buckets, limited, targeted) \
+	static long int searchStep##forward##packed##buckets##limited##targeted(qctx* ctx, sgraph* graph, unsigned char wanted) \
+	{ \
+		return searchStep(ctx, graph, wanted, forward, packed, buckets, limited, targeted); \
+	}
+#define SEARCH_STEP(forward, packed, buckets, limited, targeted) searchStep##forward##packed##buckets##limited##targeted,
+
+#define SEARCH_DIRECTIONS(X, packed, buckets, limited, targeted) X(0, packed, buckets, limited, targeted) X(1, packed, buckets, limited, targeted)
+#define SEARCH_LAYOUTS(X, buckets, limited, targeted) SEARCH_DIRECTIONS(X, 0, buckets, limited, targeted) SEARCH_DIRECTIONS(X, 1, buckets, limited, targeted)
+#define SEARCH_QUEUES(X, limited, targeted) SEARCH_LAYOUTS(X, 0, limited, targeted) SEARCH_LAYOUTS(X, 1, limited, targeted)
+#define SEARCH_LIMITS(X, targeted) SEARCH_QUEUES(X, 0, targeted) SEARCH_QUEUES(X, 1, targeted)
+#define SEARCH_VARIANTS(X) SEARCH_LIMITS(X, 0) SEARCH_LIMITS(X, 1)
+
+SEARCH_VARIANTS(SEARCH_VARIANT)
+
+static long int (*const searchSteps[32])(qctx* ctx, sgraph* graph, unsigned char wanted) = {
+	SEARCH_VARIANTS(SEARCH_STEP)
+};
+
+/*
+ Numbers the copy of searchStep that suits the current query on a graph: bit 0 is set for
+ forward searches, bit 1 for a packed graph, bit 2 while the bucket ring is in use, bit 3 if
+ the query has a limit and bit 4 if it is after providers.
+*/
+static int searchVariant(qctx* ctx, sgraph* graph, int direction, int targeted)
+{
+	return (direction == SEARCH_FORWARD) | (graph->outPacked != NULL) << 1 | (ctx->useBuckets != 0) << 2
+		| (ctx->limit != DIST_INF) << 3 | targeted << 4;
+}
+
+/*
+ Settles the nearest unsettled city of the current query and relaxes its
+ edges in the given direction.
+ Cities therefore come out in order of distance from the sources, which lets
+ callers stop as soon as they have what they need.
+ 
+ Returns the index of the city settled.
+ Returns -1 when every reachable city has been settled.
+*/
+long int searchNext(qctx* ctx, sgraph* graph, int direction)
+{
+	return searchSteps[searchVariant(ctx, graph, direction, 0)](ctx, graph, 0);
+}
+
+/*
+ Settles cities as searchNext does until one offering any of the resources in wanted (bits by
+ position in RESOURCE_LETTERS) is settled. The cities passed over are settled all the same.
+ 
+ Returns the index of the provider settled.
+ Returns -1 when every reachable city has been settled without finding one.
+*/
+long int searchNextProvider(qctx* ctx, sgraph* graph, int direction, unsigned char wanted)
+{
+	return searchSteps[searchVariant(ctx, graph, direction, 1)](ctx, graph, wanted);
+}
+
+/*
+ Returns the distance the current query has found to a city, or INF if it
+ has not reached it.
+*/
+long int searchDistance(qctx* ctx, long int city)
+{
+	if(ctx->stamp[city] != ctx->version) return INF;
+	return distLong(ctx->dist[city]);
+}
+
+/*
+ Returns 1 if the current query has settled the city, 0 if not.
+*/
+int searchSettled(qctx* ctx, long int city)
+{
+	return ctx->done[city] == ctx->version;
+}
+
+/*
+ Finds the chain a simplified graph's search took between two neighbouring cities of a route,
+ given in travelling order: the edge between them whose weight matches the search's distances.
+ A plain travel table wins over a chain of the same length.
+ 
+ Returns the chain's number, or -1 if the cities are joined by a plain travel table.
+*/
+static long int shortcutBetween(qctx* ctx, sgraph* graph, long int from, long int to, int direction)
+{
+	sedges* edges = ctx->edges;
+	long int* via = direction == SEARCH_FORWARD ? graph->outVia : graph->inVia;
+	long int other = direction == SEARCH_FORWARD ? to : from;
+	long int found = -1;
+	long int e;
+	
+	searchEdges(graph, direction == SEARCH_FORWARD ? from : to, direction, 0, edges);
+	for(e = 0; e < edges->count; e++) {
+		if(edges->to[e] != other || edges->dist[e] != (direction == SEARCH_FORWARD ? ctx->dist[to] - ctx->dist[from] : ctx->dist[from] - ctx->dist[to])) continue;
+		if(via[edges->first + e] == -1) return -1;
+		found = via[edges->first + e];
+	}
+	
+	return found;
+}
+
+/*
+ Writes the route the current query found to a city into the context's
+ preallocated path, in travelling order, without allocating.
+ 
+ For a forward search the route runs from the source to the city; for a
+ backward search it runs from the city to the source.
+ The first hop has distance 0 and every other hop holds the distance of the
+ travel table taken to reach it, as in every other path. In a simplified
+ graph every contracted chain the search took is unpacked again, so the
+ route lists every city it passes through.
+ 
+ Returns the context's path, which is overwritten by the next call.
+*/
+cpath* buildSearchPath(qctx* ctx, sgraph* graph, long int city, int direction)
+{
+	cpath* path = ctx->path;
+	long int length = 0;
+	long int source = city;
+	long int cur;
+	long int from;
+	long int to;
+	long int via;
+	long int chain;
+	long int travelled;
+	long int hop;
+	long int x;
+	long int y;
+	
+	for(cur = city; cur != -1; cur = ctx->pred[cur]) {
+		length++;
+		source = cur;
+	}
+	
+	if(graph->shortcuts == 0) {
+		// The search's distances give the running totals directly, without summing the hops.
+		x = direction == SEARCH_FORWARD ? length - 1 : 0;
+		for(cur = city; cur != -1; cur = ctx->pred[cur]) {
+			setTravelTable(path->path[x], graph->cities[cur], 0);
+			if(direction == SEARCH_FORWARD) {
+				path->prefix[x] = ctx->dist[cur] - ctx->dist[source];
+				if(ctx->pred[cur] != -1) path->path[x]->distance = ctx->dist[cur] - ctx->dist[ctx->pred[cur]];
+				x--;
+			}
+			else {
+				path->prefix[x] = ctx->dist[city] - ctx->dist[cur];
+				if(x > 0) path->path[x]->distance = ctx->dist[path->path[x - 1]->citypntr->index] - ctx->dist[cur];
+				x++;
+			}
+		}
+	}
+	else {
+		// Each step is a plain travel table or a chain; chains add their cities to the route.
+		for(cur = city; ctx->pred[cur] != -1; cur = ctx->pred[cur]) {
+			from = direction == SEARCH_FORWARD ? ctx->pred[cur] : cur;
+			to = direction == SEARCH_FORWARD ? cur : ctx->pred[cur];
+			if((via = shortcutBetween(ctx, graph, from, to, direction)) != -1) length += graph->viaStart[via + 1] - graph->viaStart[via];
+		}
+		
+		x = direction == SEARCH_FORWARD ? length - 1 : 0;
+		for(cur = city; cur != -1; cur = ctx->pred[cur]) {
+			setTravelTable(path->path[x], graph->cities[cur], 0);
+			path->prefix[x] = direction == SEARCH_FORWARD ? ctx->dist[cur] - ctx->dist[source] : ctx->dist[city] - ctx->dist[cur];
+			if(ctx->pred[cur] == -1) break;
+			
+			from = direction == SEARCH_FORWARD ? ctx->pred[cur] : cur;
+			to = direction == SEARCH_FORWARD ? cur : ctx->pred[cur];
+			via = shortcutBetween(ctx, graph, from, to, direction);
+			chain = via == -1 ? 0 : graph->viaStart[via + 1] - graph->viaStart[via];
+			
+			// The chain's cities sit between from and to, timed from whichever of them comes first.
+			travelled = direction == SEARCH_FORWARD ? ctx->dist[from] - ctx->dist[source] : path->prefix[x];
+			for(y = 0; y < chain; y++) {
+				travelled += graph->viaDist[graph->viaStart[via] + y];
+				hop = direction == SEARCH_FORWARD ? x - chain + y : x + 1 + y;
+				setTravelTable(path->path[hop], graph->cities[graph->viaCity[graph->viaStart[via] + y]], 0);
+				path->prefix[hop] = travelled;
+			}
+			x += direction == SEARCH_FORWARD ? -(chain + 1) : chain + 1;
+		}
+		for(x = 1; x < length; x++) path->path[x]->distance = path->prefix[x] - path->prefix[x - 1];
+	}
+	
+	path->length = length;
+	path->endID = path->path[length - 1]->cityid;
+	path->totalDistance = distLong(ctx->dist[city]);
+	
+	return path;
+}
@@ -0,0 +1,199 @@
+#include "reliefdb.h"
+#include "dist.h"
+
+#ifndef search_h
+#define search_h
+
+#define SEARCH_FORWARD 0	// Follow travel tables from a city to the cities it goes to.
+#define SEARCH_BACKWARD 1	// Follow travel tables in reverse, towards the cities that lead here.
+
+#define QUEUE_HEAP 0		// Indexed binary heap: any weights, O(log n) per operation.
+#define QUEUE_BUCKETS 1		// Dial's bucket queue: small integer weights, amortised O(1) per operation.
+#define MAX_BUCKETS 65536	// Largest bucket ring a query context will keep.
+
+#define ORDER_NONE 0		// Keep cities in database order.
+#define ORDER_BFS 1		// Breadth-first order, so neighbours get nearby indexes.
+#define ORDER_RCM 2		// Reverse Cuthill-McKee, breadth-first by increasing degree and reversed.
+
+/*
+ A search graph is a compact copy of the city database built once after
+ loading, used by every search engine.
+ 
+ - size is the number of cities.
+ - cities maps a city's index back to its node.
+ - outStart/outTo/outDist hold the travel tables in compressed sparse row
+   form: the edges leaving city i are outStart[i] to outStart[i + 1] - 1.
+ - inStart/inFrom/inDist hold the same edges grouped by the city they
+   arrive at, for searches that run backwards from a destination.
+ - outRisk/inRisk hold each edge's risk, parallel to outDist/inDist, so
+   searches on distance alone never load them.
+ - Weights are stored as dist_t, saturating at DIST_INF.
+ - maxWeight is the longest single edge, which decides whether a bucket
+   queue can be used.
+ - resources holds a bit for each resource a city offers, by its position in
+   RESOURCE_LETTERS, so provider tests never read the city itself.
+ - byID holds every index sorted by city ID, for searchIndexOf.
+ - loadOrder holds the index of each city in database order. Cities are
+   indexed in that order unless the graph was built with a reordering, which
+   lays cities, edges and resources out so that cities close in the road
+   network sit close in memory; anything listed back to the user walks
+   loadOrder so its output does not depend on the ordering.
+ - component numbers each city's strongly connected component, in reverse
+   topological order: an edge never leads to a higher number, so a city in
+   a lower numbered component than another can never reach it.
+ - reachers holds, for each component, the resource bits of every city
+   that can reach it, so a resource no provider can bring to a city is
+   known to be unavailable without searching.
+ - shortcuts is the number of contracted chains in a simplified graph (see
+   simplifyGraph), 0 otherwise. outVia/inVia give each edge's chain, or -1
+   for a plain travel table; chain s passes through the cities viaCity[viaStart[s]]
+   to viaCity[viaStart[s + 1] - 1] in travelling order, and viaDist holds the
+   distance of the travel table arriving at each. All four are NULL in a
+   graph without shortcuts.
+ - outPacked/inPacked are NULL unless the graph has been packed (see
+   packSearchGraph), in which case they hold the travel tables and outTo,
+   outDist, outRisk, inFrom, inDist and inRisk are NULL. outStart and
+   inStart number the edges either way, so searches read edges through
+   searchEdges rather than the arrays.
+*/
+typedef struct searchgraph {
+	long int size;
+	long int edges;
+	long int maxWeight;
+	cn** cities;
+	long int* outStart;
+	long int* outTo;
+	dist_t* outDist;
+	dist_t* outRisk;
+	long int* inStart;
+	long int* inFrom;
+	dist_t* inDist;
+	dist_t* inRisk;
+	unsigned char* resources;
+	long int* byID;
+	long int* loadOrder;
+	long int components;
+	long int* component;
+	unsigned char* reachers;
+	long int shortcuts;
+	long int* outVia;
+	long int* inVia;
+	long int* viaStart;
+	long int* viaCity;
+	dist_t* viaDist;
+	struct packedadjacency* outPacked;
+	struct packedadjacency* inPacked;
+} sgraph;
+
+/*
+ The edges of one city in one direction, as searchEdges hands them out: count
+ edges numbered first to first + count - 1, leading to (or coming from) the
+ cities in to, with their distances in dist and their risks in risk.
+ 
+ In a plain graph the pointers lead straight into the graph's arrays. In a
+ packed graph the edges are decoded into the buffers, which grow to fit the
+ busiest city seen, and risk is only filled in if it was asked for. Either
+ way the edges stay valid until the next call with the same sedges.
+*/
+typedef struct searchedges {
+	long int count;
+	long int first;
+	const long int* to;
+	const dist_t* dist;
+	const dist_t* risk;
+	long int capacity;
+	long int* toBuffer;
+	dist_t* distBuffer;
+	dist_t* riskBuffer;
+} sedges;
+
+/*
+ A road edit changes the roads from one city to another, by index, in a
+ copy of a search graph (see copySearchGraph). Closed roads are never taken;
+ otherwise a distance of 0 or more replaces the one the travel tables give,
+ and -1 keeps it.
+*/
+typedef struct roadedit {
+	long int from;
+	long int to;
+	long int distance;
+	int closed;
+} redit;
+
+/*
+ A query context is the working space for one search at a time. Each thread
+ running queries owns its own.
+ 
+ Everything is allocated once for the size of the graph and reused by every
+ query. Instead of clearing the arrays, each query takes a new version
+ number; a city's dist, pred and heap slot are only valid while its stamp
+ equals the current version, and it is settled while its done mark does.
+ Starting a query is therefore O(1) however large the graph is.
+ 
+ - dist is the best known distance to each city, as a dist_t.
+ - pred is the index of the city each city was reached from (-1 for a source).
+ - heap/heapPos/heapSize form an indexed binary heap on dist.
+ - path is a preallocated path long enough for any route in the graph.
+ - edges is where the context's searches read each city's edges.
+ - limit is the furthest the current query goes, DIST_INF unless set with
+   searchLimit.
+ 
+ The queue of cities waiting to be settled is the binary heap unless the
+ context has been given a bucket ring with searchQueue. The ring is Dial's
+ bucket queue: while every key is within bucketSpan of the smallest, city
+ lists hung off bucket (key % bucketSpan) are kept with bucketNext/bucketPrev,
+ heapPos holds a city's bucket, and bucketCursor walks forward to the next
+ non-empty one. A key outside the ring (a long edge, or a seed far from the
+ others) moves everything into the heap for the rest of that query.
+ heapSize counts the cities queued either way.
+*/
+typedef struct querycontext {
+	long int size;
+	unsigned int version;
+	unsigned int* stamp;
+	unsigned int* done;
+	dist_t* dist;
+	long int* pred;
+	long int* heap;
+	long int* heapPos;
+	long int heapSize;
+	cpath* path;
+	sedges* edges;
+	dist_t limit;
+	int queue;
+	int useBuckets;
+	long int bucketSpan;
+	long int bucketCursor;
+	long int* bucket;
+	long int* bucketNext;
+	long int* bucketPrev;
+} qctx;
+
+sgraph* buildSearchGraph(cdb* db, int order);
+sgraph* copySearchGraph(sgraph* graph, cn** stock, redit* edits, long int count);
+void purgeSearchGraph(sgraph* graph);
+long int searchIndexOf(sgraph* graph, long int id);
+unsigned char searchReachers(sgraph* graph, long int city);
+int searchMayReach(sgraph* graph, long int from, long int to);
+
+sedges* newSearchEdges(void);
+void purgeSearchEdges(sedges* edges);
+void searchEdges(sgraph* graph, long int city, int direction, int risks, sedges* edges);
+
+qctx* newQueryContext(long int size);
+void purgeQueryContext(qctx* ctx);
+int searchQueue(qctx* ctx, int queue, long int maxWeight);
+
+void searchBegin(qctx* ctx);
+void searchSeed(qctx* ctx, long int city, long int distance);
+void searchLimit(qctx* ctx, long int limit);
+void searchBlock(qctx* ctx, long int city);
+long int searchSettle(qctx* ctx);
+void searchRelax(qctx* ctx, long int from, long int city, dist_t distance);
+long int searchNext(qctx* ctx, sgraph* graph, int direction);
+long int searchNextProvider(qctx* ctx, sgraph* graph, int direction, unsigned char wanted);
+long int searchDistance(qctx* ctx, long int city);
+int searchSettled(qctx* ctx, long int city);
+cpath* buildSearchPath(qctx* ctx, sgraph* graph, long int city, int direction);
+
+#endif
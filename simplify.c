@@ -0,0 +1,320 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "reliefdb.h"
+#include "search.h"
+#include "simplify.h"
+#include "memacct.h"
+
+/*
+ A contracted chain while the simplified graph is being put together: the chain's cities are
+ chainCity[first] to chainCity[first + length - 1].
+*/
+typedef struct chainshortcut {
+	long int from;
+	long int to;
+	dist_t dist;
+	dist_t risk;
+	long int first;
+	long int length;
+} shortcut;
+
+/*
+ Copies count longs into a new block in the graph domain.
+*/
+static long int* copyLongs(long int* from, long int count)
+{
+	long int* to = (long int*)memAlloc(MEM_GRAPH, sizeof(long int) * (count + 1));
+	memcpy(to, from, sizeof(long int) * count);
+	return to;
+}
+
+/*
+ Adds an edge to a city's out list in the simplified graph, unless the list already has an edge
+ to the same city at least as short. A plain travel table beats a chain of the same length.
+*/
+static void addCoreEdge(sgraph* core, long int start, long int to, dist_t dist, dist_t risk, long int via)
+{
+	long int e;
+	
+	for(e = start; e < core->edges; e++) {
+		if(core->outTo[e] != to) continue;
+		if(dist < core->outDist[e] || (dist == core->outDist[e] && via == -1)) {
+			core->outDist[e] = dist;
+			core->outRisk[e] = risk;
+			core->outVia[e] = via;
+		}
+		return;
+	}
+	core->outTo[core->edges] = to;
+	core->outDist[core->edges] = dist;
+	core->outRisk[core->edges] = risk;
+	core->outVia[core->edges] = via;
+	core->edges++;
+}
+
+/*
+ Builds a simplified copy of a search graph for searches on distance alone, in three steps:
+ 
+ 1. Of several travel tables between the same two cities only the shortest is kept, and a
+    travel table from a city to itself, or a closed road (DIST_INF), is dropped.
+ 2. A travel table is dropped if going through some other city is strictly shorter, as it can
+    then never be part of a shortest route. Strictly, so that two routes can never be dropped
+    in favour of each other.
+ 3. Chains of pass-through cities, with no resources and no roads but the ones in and out of
+    the chain (one way, or both ways along the same two roads), are contracted into a single
+    shortcut from the city before the chain to the city after it.
+ 
+ A contracted city keeps its own travel tables, so a search can still start from it or run back
+ from it, but no other city's edges lead into it: a search from anywhere else steps over the
+ whole chain in one edge. Each shortcut remembers the cities it passes through, and
+ buildSearchPath puts them back into every route, so routes and distances are exactly those of
+ the full graph, ties aside.
+ 
+ Risks are carried along but routes that trade distance against risk, time-dependent travel and
+ alternative routes all need every travel table, so they keep using the full graph.
+ 
+ The full graph must not be packed yet; the simplified one can be packed afterwards.
+ 
+ Returns the simplified graph, which shares nothing with the full one.
+*/
+sgraph* simplifyGraph(sgraph* graph)
+{
+	long int n = graph->size;
+	char* keep = (char*)memCalloc(MEM_SCRATCH, graph->edges + 1, sizeof(char));
+	char* dominated = (char*)memCalloc(MEM_SCRATCH, graph->edges + 1, sizeof(char));
+	long int* edgeTo = (long int*)memAlloc(MEM_SCRATCH, sizeof(long int) * (n + 1));
+	long int* mark = (long int*)memAlloc(MEM_SCRATCH, sizeof(long int) * (n + 1));
+	long int* inCount = (long int*)memCalloc(MEM_SCRATCH, n + 1, sizeof(long int));
+	long int* outCount = (long int*)memCalloc(MEM_SCRATCH, n + 1, sizeof(long int));
+	long int* inFrom = (long int*)memAlloc(MEM_SCRATCH, sizeof(long int) * 2 * (n + 1));
+	long int* outEdge = (long int*)memAlloc(MEM_SCRATCH, sizeof(long int) * 2 * (n + 1));
+	char* candidate = (char*)memCalloc(MEM_SCRATCH, n + 1, sizeof(char));
+	char* contracted = (char*)memCalloc(MEM_SCRATCH, n + 1, sizeof(char));
+	long int* chainCity = (long int*)memAlloc(MEM_SCRATCH, sizeof(long int) * 2 * (n + 1));
+	dist_t* chainDist = (dist_t*)memAlloc(MEM_SCRATCH, sizeof(dist_t) * 2 * (n + 1));
+	long int chainCities = 0;
+	long int shortcutCount = 0;
+	long int shortcutCapacity = 16;
+	shortcut* shortcuts = (shortcut*)memAlloc(MEM_SCRATCH, sizeof(shortcut) * shortcutCapacity);
+	sgraph* core = (sgraph*)memAlloc(MEM_GRAPH, sizeof(sgraph));
+	long int* fill;
+	long int prev;
+	long int cur;
+	long int u;
+	long int v;
+	long int e;
+	long int f;
+	long int s;
+	long int x;
+	dist_t entering;
+	dist_t dist;
+	dist_t risk;
+	
+	for(u = 0; u < n; u++) mark[u] = -1;
+	
+	// 1. The shortest travel table to each neighbour.
+	for(u = 0; u < n; u++) {
+		for(e = graph->outStart[u]; e < graph->outStart[u + 1]; e++) {
+			v = graph->outTo[e];
+			if(v == u || graph->outDist[e] == DIST_INF) continue;
+			if(mark[v] == u && graph->outDist[edgeTo[v]] <= graph->outDist[e]) continue;
+			if(mark[v] == u) keep[edgeTo[v]] = 0;
+			mark[v] = u;
+			edgeTo[v] = e;
+			keep[e] = 1;
+		}
+	}
+	
+	// 2. Travel tables beaten by a detour through a neighbour, tested against the tables kept in step 1.
+	for(u = 0; u < n; u++) mark[u] = -1;
+	for(u = 0; u < n; u++) {
+		for(e = graph->outStart[u]; e < graph->outStart[u + 1]; e++) {
+			if(!keep[e]) continue;
+			mark[graph->outTo[e]] = u;
+			edgeTo[graph->outTo[e]] = e;
+		}
+		for(e = graph->outStart[u]; e < graph->outStart[u + 1]; e++) {
+			if(!keep[e]) continue;
+			v = graph->outTo[e];
+			for(f = graph->outStart[v]; f < graph->outStart[v + 1]; f++) {
+				if(!keep[f] || mark[graph->outTo[f]] != u) continue;
+				if(distAdd(graph->outDist[e], graph->outDist[f]) < graph->outDist[edgeTo[graph->outTo[f]]]) dominated[edgeTo[graph->outTo[f]]] = 1;
+			}
+		}
+	}
+	for(e = 0; e < graph->edges; e++) {
+		if(dominated[e]) keep[e] = 0;
+	}
+	
+	// 3. Pass-through cities: no resources, and the same one or two neighbours in and out.
+	for(u = 0; u < n; u++) {
+		for(e = graph->outStart[u]; e < graph->outStart[u + 1]; e++) {
+			if(!keep[e]) continue;
+			v = graph->outTo[e];
+			if(outCount[u] < 2) outEdge[2 * u + outCount[u]] = e;
+			if(inCount[v] < 2) inFrom[2 * v + inCount[v]] = u;
+			outCount[u]++;
+			inCount[v]++;
+		}
+	}
+	for(v = 0; v < n; v++) {
+		if(graph->resources[v] || inCount[v] != outCount[v] || inCount[v] < 1 || inCount[v] > 2) continue;
+		if(inCount[v] == 1) candidate[v] = inFrom[2 * v] != graph->outTo[outEdge[2 * v]];
+		else candidate[v] = (inFrom[2 * v] == graph->outTo[outEdge[2 * v]] && inFrom[2 * v + 1] == graph->outTo[outEdge[2 * v + 1]])
+			|| (inFrom[2 * v] == graph->outTo[outEdge[2 * v + 1]] && inFrom[2 * v + 1] == graph->outTo[outEdge[2 * v]]);
+	}
+	
+	// Walk every chain from the city before it, carrying straight on through each pass-through city.
+	// A two way chain is walked once from each end, so a city can be in two chains.
+	for(u = 0; u < n; u++) {
+		if(candidate[u]) continue;
+		for(e = graph->outStart[u]; e < graph->outStart[u + 1]; e++) {
+			if(!keep[e] || !candidate[graph->outTo[e]]) continue;
+			
+			if(shortcutCount == shortcutCapacity) {
+				shortcutCapacity *= 2;
+				shortcuts = (shortcut*)memRealloc(shortcuts, sizeof(shortcut) * shortcutCapacity);
+			}
+			shortcuts[shortcutCount].from = u;
+			shortcuts[shortcutCount].first = chainCities;
+			dist = graph->outDist[e];
+			risk = graph->outRisk[e];
+			entering = graph->outDist[e];
+			prev = u;
+			cur = graph->outTo[e];
+			
+			while(candidate[cur]) {
+				contracted[cur] = 1;
+				chainCity[chainCities] = cur;
+				chainDist[chainCities++] = entering;
+				f = outCount[cur] == 1 || graph->outTo[outEdge[2 * cur]] != prev ? outEdge[2 * cur] : outEdge[2 * cur + 1];
+				entering = graph->outDist[f];
+				dist = distAdd(dist, graph->outDist[f]);
+				risk = distAdd(risk, graph->outRisk[f]);
+				prev = cur;
+				cur = graph->outTo[f];
+			}
+			
+			// A chain that comes back to where it started is never worth taking.
+			shortcuts[shortcutCount].to = cur;
+			shortcuts[shortcutCount].dist = dist;
+			shortcuts[shortcutCount].risk = risk;
+			shortcuts[shortcutCount].length = chainCities - shortcuts[shortcutCount].first;
+			if(cur != u) shortcutCount++;
+		}
+	}
+	
+	core->size = n;
+	core->shortcuts = shortcutCount;
+	core->outPacked = NULL;
+	core->inPacked = NULL;
+	core->maxWeight = 0;
+	core->cities = (cn**)memAlloc(MEM_GRAPH, sizeof(cn*) * (n + 1));
+	memcpy(core->cities, graph->cities, sizeof(cn*) * n);
+	core->resources = (unsigned char*)memAlloc(MEM_GRAPH, sizeof(unsigned char) * (n + 1));
+	memcpy(core->resources, graph->resources, sizeof(unsigned char) * n);
+	core->byID = copyLongs(graph->byID, n);
+	core->loadOrder = copyLongs(graph->loadOrder, n);
+	core->components = graph->components;
+	core->component = copyLongs(graph->component, n);
+	core->reachers = (unsigned char*)memAlloc(MEM_GRAPH, sizeof(unsigned char) * (graph->components + 1));
+	memcpy(core->reachers, graph->reachers, sizeof(unsigned char) * graph->components);
+	
+	core->viaStart = (long int*)memAlloc(MEM_GRAPH, sizeof(long int) * (shortcutCount + 1));
+	core->viaCity = (long int*)memAlloc(MEM_GRAPH, sizeof(long int) * (chainCities + 1));
+	core->viaDist = (dist_t*)memAlloc(MEM_GRAPH, sizeof(dist_t) * (chainCities + 1));
+	for(s = 0, x = 0; s < shortcutCount; s++) {
+		core->viaStart[s] = x;
+		for(f = 0; f < shortcuts[s].length; f++, x++) {
+			core->viaCity[x] = chainCity[shortcuts[s].first + f];
+			core->viaDist[x] = chainDist[shortcuts[s].first + f];
+		}
+	}
+	core->viaStart[shortcutCount] = x;
+	
+	// Out lists: a contracted city keeps its own tables, every other city steps over the chains.
+	x = graph->edges + shortcutCount + 1;
+	core->outStart = (long int*)memAlloc(MEM_GRAPH, sizeof(long int) * (n + 1));
+	core->outTo = (long int*)memAlloc(MEM_GRAPH, sizeof(long int) * x);
+	core->outDist = (dist_t*)memAlloc(MEM_GRAPH, sizeof(dist_t) * x);
+	core->outRisk = (dist_t*)memAlloc(MEM_GRAPH, sizeof(dist_t) * x);
+	core->outVia = (long int*)memAlloc(MEM_GRAPH, sizeof(long int) * x);
+	core->edges = 0;
+	for(u = 0, s = 0; u < n; u++) {
+		core->outStart[u] = core->edges;
+		for(e = graph->outStart[u]; e < graph->outStart[u + 1]; e++) {
+			if(!keep[e] || (!contracted[u] && contracted[graph->outTo[e]])) continue;
+			addCoreEdge(core, core->outStart[u], graph->outTo[e], graph->outDist[e], graph->outRisk[e], -1);
+		}
+		for(; s < shortcutCount && shortcuts[s].from == u; s++) {
+			addCoreEdge(core, core->outStart[u], shortcuts[s].to, shortcuts[s].dist, shortcuts[s].risk, s);
+		}
+	}
+	core->outStart[n] = core->edges;
+	
+	// In lists mirror the out lists, except that a contracted city also lists the tables leading into its chain.
+	x = core->edges + graph->edges + 1;
+	core->inStart = (long int*)memCalloc(MEM_GRAPH, n + 1, sizeof(long int));
+	core->inFrom = (long int*)memAlloc(MEM_GRAPH, sizeof(long int) * x);
+	core->inDist = (dist_t*)memAlloc(MEM_GRAPH, sizeof(dist_t) * x);
+	core->inRisk = (dist_t*)memAlloc(MEM_GRAPH, sizeof(dist_t) * x);
+	core->inVia = (long int*)memAlloc(MEM_GRAPH, sizeof(long int) * x);
+	for(u = 0; u < n; u++) {
+		if(contracted[u]) continue;
+		for(e = core->outStart[u]; e < core->outStart[u + 1]; e++) core->inStart[core->outTo[e] + 1]++;
+		for(e = graph->outStart[u]; e < graph->outStart[u + 1]; e++) {
+			if(keep[e] && contracted[graph->outTo[e]]) core->inStart[graph->outTo[e] + 1]++;
+		}
+	}
+	for(u = 0; u < n; u++) {
+		if(!contracted[u]) continue;
+		for(e = core->outStart[u]; e < core->outStart[u + 1]; e++) {
+			if(contracted[core->outTo[e]]) core->inStart[core->outTo[e] + 1]++;
+		}
+	}
+	for(u = 0; u < n; u++) core->inStart[u + 1] += core->inStart[u];
+	fill = copyLongs(core->inStart, n + 1);
+	for(u = 0; u < n; u++) {
+		for(e = core->outStart[u]; e < core->outStart[u + 1]; e++) {
+			v = core->outTo[e];
+			if(contracted[u] && !contracted[v]) continue;
+			core->inFrom[fill[v]] = u;
+			core->inDist[fill[v]] = core->outDist[e];
+			core->inRisk[fill[v]] = core->outRisk[e];
+			core->inVia[fill[v]] = core->outVia[e];
+			fill[v]++;
+		}
+		if(contracted[u]) continue;
+		for(e = graph->outStart[u]; e < graph->outStart[u + 1]; e++) {
+			v = graph->outTo[e];
+			if(!keep[e] || !contracted[v]) continue;
+			core->inFrom[fill[v]] = u;
+			core->inDist[fill[v]] = graph->outDist[e];
+			core->inRisk[fill[v]] = graph->outRisk[e];
+			core->inVia[fill[v]] = -1;
+			fill[v]++;
+		}
+	}
+	memFree(fill);
+	
+	for(e = 0; e < core->edges; e++) {
+		if(core->outDist[e] > core->maxWeight) core->maxWeight = core->outDist[e];
+	}
+	
+	memFree(keep);
+	memFree(dominated);
+	memFree(edgeTo);
+	memFree(mark);
+	memFree(inCount);
+	memFree(outCount);
+	memFree(inFrom);
+	memFree(outEdge);
+	memFree(candidate);
+	memFree(contracted);
+	memFree(chainCity);
+	memFree(chainDist);
+	memFree(shortcuts);
+	
+	return core;
+}
@@ -0,0 +1,9 @@
+#include "reliefdb.h"
+#include "search.h"
+
+#ifndef simplify_h
+#define simplify_h
+
+sgraph* simplifyGraph(sgraph* graph);
+
+#endif
@@ -5,6 +5,8 @@
 #include "skipdict.h"
 #include "strlib.h"
 #include "reliefdb.h"
+#include "stats.h"
+#include "memacct.h"
 
 #define PVAL 0.05
 #define MAX_LEVEL 10
@@ -40,7 +42,7 @@ int level()
 */
 skipDict* newSkipDict()
 {
-	skipDict* theSkipDict = (skipDict*)malloc(sizeof(skipDict));
+	skipDict* theSkipDict = (skipDict*)memAlloc(MEM_NAMES, sizeof(skipDict));
 	theSkipDict->level = 0;
 	theSkipDict->head = newSkipEntry("NULL", NULL, MAX_LEVEL);
 	return theSkipDict;
@@ -51,9 +53,9 @@ skipDict* newSkipDict()
 */
 skipDictEntry* newSkipEntry(char* key, cn* city, int level)
 {
-	skipDictEntry* theEntry = (skipDictEntry*)malloc(sizeof(skipDictEntry));
-	theEntry->next = (skipDictEntry**)calloc(level + 1, sizeof(skipDictEntry*)); // Set all pointers to NULL.
-	theEntry->key = cpystr(key);
+	skipDictEntry* theEntry = (skipDictEntry*)memAlloc(MEM_NAMES, sizeof(skipDictEntry));
+	theEntry->next = (skipDictEntry**)memCalloc(MEM_NAMES, level + 1, sizeof(skipDictEntry*)); // Set all pointers to NULL.
+	theEntry->key = memStrdup(MEM_NAMES, key);
 	theEntry->city = city;
 	return theEntry;
 }
@@ -67,7 +69,7 @@ void addSkipEntry(skipDict* theSkipDict, char* key, cn* city)
 {
 	int x;
 	skipDictEntry* curNode = theSkipDict->head;
-	skipDictEntry** nodesToUpdate = (skipDictEntry**)calloc(sizeof(skipDictEntry*),MAX_LEVEL + 1);
+	skipDictEntry** nodesToUpdate = (skipDictEntry**)memCalloc(MEM_SCRATCH, MAX_LEVEL + 1, sizeof(skipDictEntry*));
 
 	for(x = theSkipDict->level; x >= 0; x--) {
 		
@@ -113,6 +115,8 @@ void addSkipEntry(skipDict* theSkipDict, char* key, cn* city)
 			nodesToUpdate[x]->next[x] = curNode;
 		}
 	}
+	
+	memFree(nodesToUpdate);
 }
 
 /*
@@ -121,6 +125,7 @@ void addSkipEntry(skipDict* theSkipDict, char* key, cn* city)
 */
 skipDictEntry* skipDictSearch(skipDict* theSkipDict, char* queryKey) {
 	skipDictEntry* curNode = theSkipDict->head;
+	STAT_INC(STAT_LOOKUPS);
 	
 	if(curNode->next[0] == NULL) return NULL; // Cannot search an empty list.
 	
@@ -153,7 +158,7 @@ void skipDictDelete(skipDict* theSkipDict, char* key) {
 	int comparisons = 0;
 	int x;
 	skipDictEntry* curNode = theSkipDict->head;
-	skipDictEntry** nodesToUpdate = (skipDictEntry**)calloc(sizeof(skipDictEntry*),MAX_LEVEL + 1);
+	skipDictEntry** nodesToUpdate = (skipDictEntry**)memCalloc(MEM_SCRATCH, MAX_LEVEL + 1, sizeof(skipDictEntry*));
 	for(x = theSkipDict->level; x >= 0; x--) {
 		/*
 		 Search for all the nodes that point to this node
@@ -181,15 +186,17 @@ void skipDictDelete(skipDict* theSkipDict, char* key) {
 		}
 		
 		// Delete the node.
-		free(curNode->key);
-		free(curNode->next);
-        free(curNode);
+		memFree(curNode->key);
+		memFree(curNode->next);
+        memFree(curNode);
 		
 		// Finally, check through the list to see if the skip list level needs to be lowered.
         while(theSkipDict->level > 0 && theSkipDict->head->next[theSkipDict->level] == NULL) {
 			theSkipDict->level--;
 		}
     }
+	
+	memFree(nodesToUpdate);
 }
 
 /*
@@ -204,3 +211,14 @@ void purgeSkipDict(skipDict* theSkipDict) {
 		curNode = nextNode;
 	}
 }
+
+/*
+ Deletes everything in a skip list dictionary, including the dictionary itself.
+*/
+void freeSkipDict(skipDict* theSkipDict) {
+	purgeSkipDict(theSkipDict);
+	memFree(theSkipDict->head->key);
+	memFree(theSkipDict->head->next);
+	memFree(theSkipDict->head);
+	memFree(theSkipDict);
+}
@@ -28,5 +28,6 @@ void addSkipEntry(skipDict* theSkipDict, char* key, cn* city);
 skipDictEntry* skipDictSearch(skipDict* theSkipDict, char* queryKey);
 void skipDictDelete(skipDict* theSkipDict, char* key);
 void purgeSkipDict(skipDict* theSkipDict);
+void freeSkipDict(skipDict* theSkipDict);
 
 #endif
@@ -0,0 +1,715 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <unistd.h>
+#include "reliefdb.h"
+#include "objects.h"
+#include "search.h"
+#include "simplify.h"
+#include "packed.h"
+#include "snapshot.h"
+#include "dbfile.h"
+#include "strlib.h"
+#include "memacct.h"
+
+#define MAX_FEED_LINE 256
+#define MAX_STOCK_LENGTH 64
+#define EDITS_START 16
+
+#define UPDATE_NONE 0		// Not an update.
+#define UPDATE_CLOSE 1		// "close from,to": close the roads from one city to another.
+#define UPDATE_OPEN 2		// "open from,to": open them again.
+#define UPDATE_DISTANCE 3	// "distance from,to hours": give them a new distance.
+#define UPDATE_STOCK 4		// "stock city resources": give a city a new resources string.
+
+/*
+ One change, as a journal or feed line gives it, with cities by index.
+*/
+typedef struct storeupdate {
+	int kind;
+	long int from;
+	long int to;
+	long int distance;
+	char resources[MAX_STOCK_LENGTH];
+} supdate;
+
+/*
+ Builds the snapshot of the given version from the database's graph, the roads closed now and
+ the stock as it is now. The caller holds the writer lock.
+*/
+static gsnap* buildSnapshot(sstore* store, unsigned long version)
+{
+	gsnap* snap = (gsnap*)memAlloc(MEM_GRAPH, sizeof(gsnap));
+	long int n = store->db->graph->size;
+	long int x;
+	
+	snap->version = version;
+	snap->view = *store->db;
+	snap->stock = NULL;
+	if(store->stock != NULL) {
+		snap->stock = (cn**)memCalloc(MEM_GRAPH, n + 1, sizeof(cn*));
+		for(x = 0; x < n; x++) {
+			if(store->stock[x] != NULL) snap->stock[x] = copyCNode(store->stock[x]);
+		}
+	}
+	snap->view.graph = copySearchGraph(store->db->graph, snap->stock, store->edits, store->editCount);
+	snap->view.core = store->options & LINK_SIMPLIFY ? simplifyGraph(snap->view.graph) : NULL;
+	if(store->options & LINK_PACK) {
+		packSearchGraph(snap->view.graph);
+		if(snap->view.core != NULL) packSearchGraph(snap->view.core);
+	}
+	snap->closed = 0;
+	for(x = 0; x < store->editCount; x++) snap->closed += store->edits[x].closed;
+	snap->retired = 0;
+	snap->next = NULL;
+	
+	return snap;
+}
+
+/*
+ Frees a city list of the kind sstore and gsnap keep their stock in, with the copies in it.
+*/
+static void purgeStock(cn** stock, long int size)
+{
+	long int x;
+	
+	if(stock == NULL) return;
+	for(x = 0; x < size; x++) {
+		if(stock[x] == NULL) continue;
+		memFree(stock[x]->resources);
+		memFree(stock[x]);
+	}
+	memFree(stock);
+}
+
+static void purgeSnapshot(gsnap* snap)
+{
+	if(snap->version != 0) {
+		purgeStock(snap->stock, snap->view.graph->size);
+		purgeSearchGraph(snap->view.graph);
+		purgeSearchGraph(snap->view.core);
+	}
+	memFree(snap);
+}
+
+/*
+ Frees every retired snapshot that no reader can still have pinned. The caller holds the
+ writer lock.
+*/
+static void reclaim(sstore* store)
+{
+	unsigned long oldest = ULONG_MAX;
+	unsigned long epoch;
+	gsnap** link = &store->retired;
+	gsnap* snap;
+	int x;
+	
+	for(x = 0; x < atomic_load(&store->readers); x++) {
+		epoch = atomic_load(&store->pinned[x]);
+		if(epoch != 0 && epoch < oldest) oldest = epoch;
+	}
+	
+	while((snap = *link) != NULL) {
+		if(snap->retired < oldest) {
+			*link = snap->next;
+			purgeSnapshot(snap);
+			atomic_fetch_add(&store->reclaimed, 1);
+		}
+		else link = &snap->next;
+	}
+}
+
+/*
+ Publishes a new snapshot with the road edits made so far and retires the current one.
+ The caller holds the writer lock.
+*/
+static void publish(sstore* store)
+{
+	gsnap* old = atomic_load(&store->current);
+	gsnap* snap = buildSnapshot(store, old->version + 1);
+	
+	atomic_exchange(&store->current, snap);
+	old->retired = atomic_fetch_add(&store->epoch, 1);
+	old->next = store->retired;
+	store->retired = old;
+	atomic_fetch_add(&store->published, 1);
+	
+	reclaim(store);
+}
+
+/*
+ Creates a snapshot store for a linked database, with version 0 being the database as linked.
+ options are the LINK_ options it was linked with.
+*/
+sstore* newSnapshotStore(cdb* db, int options)
+{
+	sstore* store = (sstore*)memAlloc(MEM_GRAPH, sizeof(sstore));
+	gsnap* first = (gsnap*)memAlloc(MEM_GRAPH, sizeof(gsnap));
+	int x;
+	
+	first->version = 0;
+	first->view = *db;
+	first->closed = 0;
+	first->stock = NULL;
+	first->retired = 0;
+	first->next = NULL;
+	
+	store->db = db;
+	store->options = options;
+	atomic_init(&store->current, first);
+	atomic_init(&store->epoch, 1);
+	for(x = 0; x < MAX_READERS; x++) atomic_init(&store->pinned[x], 0);
+	atomic_init(&store->readers, 0);
+	pthread_mutex_init(&store->writer, NULL);
+	store->retired = NULL;
+	store->editCapacity = EDITS_START;
+	store->editCount = 0;
+	store->edits = (redit*)memAlloc(MEM_GRAPH, sizeof(redit) * store->editCapacity);
+	store->stock = NULL;
+	store->journal = NULL;
+	store->journalName = NULL;
+	store->databaseName = NULL;
+	store->journaled = 0;
+	store->ownsDatabase = 0;
+	atomic_init(&store->published, 1);
+	atomic_init(&store->reclaimed, 0);
+	store->feeding = 0;
+	store->feedFile = NULL;
+	atomic_init(&store->feedApplied, 0);
+	atomic_init(&store->feedSkipped, 0);
+	atomic_init(&store->feedDone, 0);
+	
+	return store;
+}
+
+/*
+ Stops the feed thread, if there is one, and frees every snapshot. No reader may still have
+ one pinned.
+*/
+void purgeSnapshotStore(sstore* store)
+{
+	gsnap* snap;
+	
+	if(store == NULL) return;
+	
+	if(store->feeding) {
+		if(!atomic_load(&store->feedDone)) pthread_cancel(store->feed);
+		pthread_join(store->feed, NULL);
+		fclose(store->feedFile);
+	}
+	
+	while((snap = store->retired) != NULL) {
+		store->retired = snap->next;
+		purgeSnapshot(snap);
+	}
+	purgeSnapshot(atomic_load(&store->current));
+	pthread_mutex_destroy(&store->writer);
+	if(store->journal != NULL) fclose(store->journal);
+	memFree(store->journalName);
+	memFree(store->databaseName);
+	memFree(store->edits);
+	purgeStock(store->stock, store->db->graph->size);
+	memFree(store);
+}
+
+/*
+ Gives a thread its own reader slot, to pin snapshots with.
+ 
+ Returns the slot, or -1 if MAX_READERS threads already have one.
+*/
+int joinSnapshotReaders(sstore* store)
+{
+	int reader = atomic_fetch_add(&store->readers, 1);
+	
+	if(reader < MAX_READERS) return reader;
+	atomic_fetch_sub(&store->readers, 1);
+	return -1;
+}
+
+/*
+ Pins the current snapshot for a reader until it calls unpinSnapshot; the snapshot is not
+ freed before then, however many newer ones are published. Never waits.
+ 
+ Returns the snapshot.
+*/
+gsnap* pinSnapshot(sstore* store, int reader)
+{
+	atomic_store(&store->pinned[reader], atomic_load(&store->epoch));
+	return atomic_load(&store->current);
+}
+
+void unpinSnapshot(sstore* store, int reader)
+{
+	atomic_store(&store->pinned[reader], 0);
+}
+
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////UPDATES////////////////////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/*
+ Returns 1 if the database's graph has a road from one city to another, 0 if not.
+*/
+static int roadExists(sgraph* graph, long int from, long int to)
+{
+	sedges* edges = newSearchEdges();
+	long int found = 0;
+	long int e;
+	
+	searchEdges(graph, from, SEARCH_FORWARD, 0, edges);
+	for(e = 0; e < edges->count && !found; e++) found = edges->to[e] == to;
+	purgeSearchEdges(edges);
+	
+	return found;
+}
+
+/*
+ Returns the edit of the roads from one city to another, adding one that changes nothing if
+ there is none and create is 1, or returning NULL if create is 0.
+*/
+static redit* findEdit(sstore* store, long int from, long int to, int create)
+{
+	long int x;
+	
+	for(x = 0; x < store->editCount; x++) {
+		if(store->edits[x].from == from && store->edits[x].to == to) return &store->edits[x];
+	}
+	if(!create) return NULL;
+	
+	if(store->editCount == store->editCapacity) {
+		store->editCapacity *= 2;
+		store->edits = (redit*)memRealloc(store->edits, sizeof(redit) * store->editCapacity);
+	}
+	store->edits[store->editCount].from = from;
+	store->edits[store->editCount].to = to;
+	store->edits[store->editCount].distance = -1;
+	store->edits[store->editCount].closed = 0;
+	
+	return &store->edits[store->editCount++];
+}
+
+/*
+ Makes an update, or with apply 0 only checks whether it would change anything. The caller holds
+ the writer lock and publishes afterwards.
+ 
+ Returns 1 if the update changes anything, 0 if not: the road does not exist, or it or the city
+ already is as the update says.
+*/
+static int applyUpdate(sstore* store, supdate* update, int apply)
+{
+	sgraph* graph = store->db->graph;
+	redit* edit;
+	cn* city;
+	
+	if(update->kind == UPDATE_STOCK) {
+		city = store->stock != NULL && store->stock[update->from] != NULL ? store->stock[update->from] : graph->cities[update->from];
+		if(!strcmp(city->resources, update->resources)) return 0;
+		if(!apply) return 1;
+		
+		// The database's city is left as it was loaded; the store keeps the city as it is now.
+		if(store->stock == NULL) store->stock = (cn**)memCalloc(MEM_GRAPH, graph->size + 1, sizeof(cn*));
+		if(store->stock[update->from] == NULL) store->stock[update->from] = copyCNode(city);
+		setCityResources(store->stock[update->from], update->resources);
+		return 1;
+	}
+	
+	if(!roadExists(graph, update->from, update->to)) return 0;
+	edit = findEdit(store, update->from, update->to, 0);
+	if(update->kind == UPDATE_OPEN && (edit == NULL || !edit->closed)) return 0;
+	if(update->kind == UPDATE_CLOSE && edit != NULL && edit->closed) return 0;
+	if(update->kind == UPDATE_DISTANCE && edit != NULL && edit->distance == update->distance) return 0;
+	if(!apply) return 1;
+	
+	edit = edit == NULL ? findEdit(store, update->from, update->to, 1) : edit;
+	if(update->kind == UPDATE_DISTANCE) edit->distance = update->distance;
+	else edit->closed = update->kind == UPDATE_CLOSE;
+	
+	// An open road at its own distance needs no edit.
+	if(!edit->closed && edit->distance == -1) *edit = store->edits[--store->editCount];
+	
+	return 1;
+}
+
+/*
+ Reads an update from a journal or feed line, mapping city IDs to indexes.
+ 
+ Returns 1 if the line is an update of known cities, 0 if not.
+*/
+static int parseUpdate(sstore* store, char* line, supdate* update)
+{
+	sgraph* graph = store->db->graph;
+	char* at;
+	char* end;
+	long int length;
+	
+	update->kind = UPDATE_NONE;
+	if(!strncmp(line, "close ", 6)) update->kind = UPDATE_CLOSE;
+	else if(!strncmp(line, "open ", 5)) update->kind = UPDATE_OPEN;
+	else if(!strncmp(line, "distance ", 9)) update->kind = UPDATE_DISTANCE;
+	else if(!strncmp(line, "stock ", 6)) update->kind = UPDATE_STOCK;
+	else return 0;
+	
+	at = strchr(line, ' ') + 1;
+	update->from = searchIndexOf(graph, strtol(at, &end, 10));
+	if(end == at || update->from == -1) return 0;
+	
+	if(update->kind == UPDATE_STOCK) {
+		at = end;
+		while(*at == ' ') at++;
+		for(length = 0; at[length] != '\0' && at[length] != '\n' && at[length] != ' '; length++);
+		if(length == 0 || length >= MAX_STOCK_LENGTH) return 0;
+		memcpy(update->resources, at, length);
+		update->resources[length] = '\0';
+		return 1;
+	}
+	
+	if(*end != ',') return 0;
+	at = end + 1;
+	update->to = searchIndexOf(graph, strtol(at, &end, 10));
+	if(end == at || update->to == -1) return 0;
+	if(update->kind != UPDATE_DISTANCE) return 1;
+	
+	at = end;
+	update->distance = strtol(at, &end, 10);
+	
+	return end != at && update->distance >= 0;
+}
+
+/*
+ Writes the journal line for an update, with city IDs, into line.
+*/
+static void formatUpdate(sstore* store, supdate* update, char* line)
+{
+	cn** cities = store->db->graph->cities;
+	
+	switch(update->kind) {
+		case UPDATE_CLOSE:
+			sprintf(line, "close %ld,%ld\n", cities[update->from]->id, cities[update->to]->id);
+			break;
+		
+		case UPDATE_OPEN:
+			sprintf(line, "open %ld,%ld\n", cities[update->from]->id, cities[update->to]->id);
+			break;
+			
+		case UPDATE_DISTANCE:
+			sprintf(line, "distance %ld,%ld %ld\n", cities[update->from]->id, cities[update->to]->id, update->distance);
+			break;
+			
+		default:
+			sprintf(line, "stock %ld %s\n", cities[update->from]->id, update->resources);
+			break;
+	}
+}
+
+/*
+ Appends a line to the journal and flushes it to disk. The caller holds the writer lock.
+ 
+ Returns 1 if the line is safely on disk (or journaling is off), 0 if not.
+*/
+static int journalLine(sstore* store, char* line)
+{
+	if(store->journalName == NULL) return 1;
+	if(store->journal == NULL && (store->journal = fopen(store->journalName, "a")) == NULL) return 0;
+	if(fputs(line, store->journal) == EOF || fflush(store->journal) != 0 || fsync(fileno(store->journal)) != 0) return 0;
+	store->journaled++;
+	
+	return 1;
+}
+
+/*
+ Writes the database with the road edits made so far to the database file, then empties the
+ journal, whose changes it now holds. The caller holds the writer lock.
+ 
+ Returns 1 on success, 0 if the database file cannot be written, or is some other run's (the
+ journal is kept either way).
+*/
+static int compact(sstore* store)
+{
+	cn** cities = store->db->graph->cities;
+	redit* edits;
+	char* journalName;
+	long int x;
+	int ok;
+	
+	if(store->databaseName == NULL) return 0;
+	if(!store->ownsDatabase && access(store->databaseName, F_OK) == 0) return 0;
+	journalName = (char*)memAlloc(MEM_GRAPH, strlen(store->databaseName) + 9);
+	sprintf(journalName, "%s.journal", store->databaseName);
+	
+	// A journal left beside the database file by some earlier run does not belong to what is written now.
+	if(strcmp(journalName, store->journalName)) remove(journalName);
+	
+	edits = (redit*)memAlloc(MEM_SCRATCH, sizeof(redit) * (store->editCount + 1));
+	for(x = 0; x < store->editCount; x++) {
+		edits[x] = store->edits[x];
+		edits[x].from = cities[store->edits[x].from]->id;
+		edits[x].to = cities[store->edits[x].to]->id;
+	}
+	ok = saveDatabaseFile(store->db, store->stock, edits, store->editCount, store->databaseName);
+	memFree(edits);
+	if(!ok) {
+		memFree(journalName);
+		return 0;
+	}
+	
+	if(store->journal != NULL) fclose(store->journal);
+	store->journal = NULL;
+	remove(store->journalName);
+	memFree(store->journalName);
+	store->journalName = journalName;
+	store->journaled = 0;
+	store->ownsDatabase = 1;
+	
+	return 1;
+}
+
+/*
+ Journals an update, then makes it and publishes the new version, compacting the journal once it
+ has grown to JOURNAL_COMPACT changes.
+ 
+ Returns 1 if a new version was published, 0 if the update changes nothing and -1 if it could
+ not be journaled, and so was not made.
+*/
+static int commitUpdate(sstore* store, supdate* update)
+{
+	char line[MAX_FEED_LINE];
+	
+	pthread_mutex_lock(&store->writer);
+	if(!applyUpdate(store, update, 0)) {
+		pthread_mutex_unlock(&store->writer);
+		return 0;
+	}
+	formatUpdate(store, update, line);
+	if(!journalLine(store, line)) {
+		pthread_mutex_unlock(&store->writer);
+		return -1;
+	}
+	
+	applyUpdate(store, update, 1);
+	publish(store);
+	if(store->journaled >= JOURNAL_COMPACT) compact(store);
+	pthread_mutex_unlock(&store->writer);
+	
+	return 1;
+}
+
+/*
+ Closes the roads from one city to another (closed = 1) or opens them again (closed = 0), by
+ city index, and publishes the new version of the roads. Roads in the other direction are not
+ touched.
+ 
+ Returns 1 if a new version was published, 0 if there is no such road or it already was
+ closed or open, and -1 if the change could not be journaled.
+*/
+int setRoadClosed(sstore* store, long int from, long int to, int closed)
+{
+	supdate update;
+	
+	update.kind = closed ? UPDATE_CLOSE : UPDATE_OPEN;
+	update.from = from;
+	update.to = to;
+	
+	return commitUpdate(store, &update);
+}
+
+/*
+ Gives the roads from one city to another, by city index, a new distance in place of the one
+ their travel tables give, and publishes the new version of the roads. A closed road stays
+ closed until it is opened.
+ 
+ Returns 1 if a new version was published, 0 if there is no such road or it already has that
+ distance, and -1 if the change could not be journaled.
+*/
+int setRoadDistance(sstore* store, long int from, long int to, long int distance)
+{
+	supdate update;
+	
+	update.kind = UPDATE_DISTANCE;
+	update.from = from;
+	update.to = to;
+	update.distance = distance;
+	
+	return commitUpdate(store, &update);
+}
+
+/*
+ Gives a city, by index, a new resources string with stock levels (eg "B20W"), and publishes a
+ new version so searches see which resources it provides. Versions already published, and the
+ database's own city, keep the stock they had.
+ 
+ Returns 1 if a new version was published, 0 if the city already has those resources, and -1 if
+ the change could not be journaled or the string is too long.
+*/
+int setCityStock(sstore* store, long int city, char* resources)
+{
+	supdate update;
+	
+	if(lengthof(resources) >= MAX_STOCK_LENGTH) return -1;
+	update.kind = UPDATE_STOCK;
+	update.from = city;
+	strcpy(update.resources, resources);
+	
+	return commitUpdate(store, &update);
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////JOURNAL////////////////////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/*
+ Brings a store back to where it was before a restart, before any query runs: makes the road
+ edits a binary database file was written with (by city ID, as loadDatabaseFile gives them), then
+ replays the journal named journalName, if there is one, and publishes the result as one version
+ however many lines it has. A restart therefore still costs loading and linking the database, in
+ proportion to the graph, plus one pass over the journal and one publish. A last line cut short by
+ a crash is dropped from the journal.
+ 
+ Changes are journaled to journalName from then on, and compacted into the binary database file
+ databaseName. If that file already exists it must be the one the store's database was loaded
+ from: compaction never writes over a file the store did not start from.
+ 
+ Returns the number of journal lines replayed.
+*/
+long int restoreSnapshotStore(sstore* store, redit* edits, long int count, char* journalName, char* databaseName)
+{
+	sgraph* graph = store->db->graph;
+	char line[MAX_FEED_LINE];
+	supdate update;
+	long int replayed = 0;
+	long int whole = 0;
+	long int changed = 0;
+	FILE* file;
+	long int x;
+	
+	pthread_mutex_lock(&store->writer);
+	
+	for(x = 0; x < count; x++) {
+		update.from = searchIndexOf(graph, edits[x].from);
+		update.to = searchIndexOf(graph, edits[x].to);
+		if(update.from == -1 || update.to == -1) continue;
+		update.kind = UPDATE_DISTANCE;
+		update.distance = edits[x].distance;
+		if(edits[x].distance >= 0) changed += applyUpdate(store, &update, 1);
+		update.kind = UPDATE_CLOSE;
+		if(edits[x].closed) changed += applyUpdate(store, &update, 1);
+	}
+	
+	if((file = fopen(journalName, "r")) != NULL) {
+		while(fgets(line, MAX_FEED_LINE, file) != NULL && line[strlen(line) - 1] == '\n') {
+			whole = ftell(file);
+			replayed++;
+			if(parseUpdate(store, line, &update)) changed += applyUpdate(store, &update, 1);
+		}
+		fclose(file);
+		if(truncate(journalName, whole) != 0) printf("WARNING: the end of journal %s could not be cut off.\n", journalName);
+	}
+	
+	store->journalName = memStrdup(MEM_GRAPH, journalName);
+	store->databaseName = memStrdup(MEM_GRAPH, databaseName);
+	store->journaled = replayed;
+	store->ownsDatabase = access(databaseName, F_OK) == 0;
+	if(changed > 0) publish(store);
+	
+	pthread_mutex_unlock(&store->writer);
+	
+	return replayed;
+}
+
+/*
+ Writes the database and every change made to it to the binary database file now, and empties
+ the journal.
+ 
+ Returns 1 on success, 0 if the file cannot be written, was not loaded or written by this store,
+ or journaling is off.
+*/
+int compactJournal(sstore* store)
+{
+	int ok;
+	
+	pthread_mutex_lock(&store->writer);
+	ok = compact(store);
+	pthread_mutex_unlock(&store->writer);
+	
+	return ok;
+}
+
+/*
+ Copies the name of the journal into name, which holds size characters, as the feed thread may
+ compact it away at any time.
+ 
+ Returns the changes journaled since the database file was last written.
+*/
+long int journalStatus(sstore* store, char* name, int size)
+{
+	long int journaled;
+	
+	pthread_mutex_lock(&store->writer);
+	snprintf(name, size, "%s", store->journalName == NULL ? "(none)" : store->journalName);
+	journaled = store->journaled;
+	pthread_mutex_unlock(&store->writer);
+	
+	return journaled;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////FEED///////////////////////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/*
+ Reads road updates on the feed thread until the file runs out, publishing a version for each.
+*/
+static void* roadFeed(void* arg)
+{
+	sstore* store = (sstore*)arg;
+	char line[MAX_FEED_LINE];
+	supdate update;
+	int state;
+	
+	while(fgets(line, MAX_FEED_LINE, store->feedFile) != NULL) {
+		if(!parseUpdate(store, line, &update)) {
+			atomic_fetch_add(&store->feedSkipped, 1);
+			continue;
+		}
+		
+		// A version is never left half published, whenever the feed is stopped.
+		pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &state);
+		if(commitUpdate(store, &update) == 1) atomic_fetch_add(&store->feedApplied, 1);
+		else atomic_fetch_add(&store->feedSkipped, 1);
+		pthread_setcancelstate(state, NULL);
+	}
+	
+	atomic_store(&store->feedDone, 1);
+	return NULL;
+}
+
+/*
+ Starts a feed thread applying the road updates in a file, one per line as the journal writes
+ them: "close 12,40", "open 12,40" or "distance 12,40 30", with the IDs of the cities the road
+ leaves and arrives at, or "stock 12 B20W", while queries go on. The file can be a named pipe that another program
+ writes updates to as they happen. The store owns the file from then on.
+ 
+ Returns 1 if the feed started, 0 if another is still running.
+*/
+int startRoadFeed(sstore* store, FILE* file)
+{
+	if(store->feeding) {
+		if(!atomic_load(&store->feedDone)) return 0;
+		pthread_join(store->feed, NULL);
+		fclose(store->feedFile);
+		store->feeding = 0;
+	}
+	
+	store->feedFile = file;
+	atomic_store(&store->feedApplied, 0);
+	atomic_store(&store->feedSkipped, 0);
+	atomic_store(&store->feedDone, 0);
+	if(pthread_create(&store->feed, NULL, roadFeed, store) != 0) {
+		store->feedFile = NULL;
+		return 0;
+	}
+	store->feeding = 1;
+	
+	return 1;
+}
@@ -0,0 +1,128 @@
+#include <stdio.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include "reliefdb.h"
+#include "search.h"
+
+#ifndef snapshot_h
+#define snapshot_h
+
+#define MAX_READERS 16		// Most threads that can pin snapshots.
+#define JOURNAL_COMPACT 4096	// Changes journaled before the journal is compacted into a database file.
+
+/*
+ One published version of the roads: a view of the database that shares its
+ cities but has its own search graph (and simplified core graph), with the
+ road edits and stock levels of the time: closed roads are never taken, roads
+ given a new distance take that, and restocked cities are the snapshot's own
+ copies. A snapshot never changes once it is published.
+ 
+ - version counts the snapshots published before it. Version 0 is the
+   database as linked, whose graphs belong to the database.
+ - view is what queries on this version are given: the database, with graph
+   and core replaced.
+ - closed is the number of roads closed in it.
+ - stock holds, by city index, the snapshot's own copy of each city whose
+   stock has changed (see copyCNode), which its graphs list in place of the
+   database's; NULL for the rest, or as a whole if no stock has changed.
+ - retired is the epoch at which a newer snapshot replaced it, and next links
+   the retired snapshots still waiting to be freed.
+*/
+typedef struct graphsnapshot {
+	unsigned long version;
+	cdb view;
+	long int closed;
+	cn** stock;
+	unsigned long retired;
+	struct graphsnapshot* next;
+} gsnap;
+
+/*
+ A snapshot store lets roads be closed, opened and given new distances while
+ queries run, RCU style: readers never wait, and the roads never change under
+ a query.
+ 
+ A reader pins the current snapshot for each query and unpins it after.
+ Pinning stores the global epoch in the reader's slot and then loads the
+ current snapshot, without a lock. A writer builds the next snapshot off to
+ the side, from the database's own graph and the list of road edits, swaps
+ it in with one atomic exchange, then moves the epoch on and stamps the old
+ snapshot with the epoch it was retired at. The old snapshot is freed once no
+ pinned slot holds that epoch or an earlier one: a reader that pinned later
+ loaded the new snapshot, as the exchange came before the epoch moved.
+ 
+ Writers only wait for each other, on the writer lock. Updates come from the
+ REPL or stream in from a file on a feed thread (see startRoadFeed). Neither
+ roads nor stock are ever changed in the database itself once it is loaded:
+ a stock change is made to the store's copy of the city, and each snapshot
+ takes copies of its own.
+ 
+ Every change is written ahead to a journal, one line per change as the
+ feed takes them, and flushed to disk before it is made. Each line says what
+ the road or city is now, not how it changed, so replaying a line twice does
+ no harm. On restart the database file plus a replay of the journal gives
+ back every change (see restoreSnapshotStore). After JOURNAL_COMPACT changes,
+ or on compactJournal, the database and its edits are written to a binary
+ database file and the journal starts again empty.
+ 
+ - db is the database the snapshots share their cities with, and options the
+   LINK_ options it was linked with, applied again to every version.
+ - pinned holds each reader's epoch while it has a snapshot pinned, 0 when not.
+ - edits holds the roads closed or given a new distance so far, and stock
+   (NULL until the first stock change) a copy of each city with its stock as
+   changed so far, by index.
+ - journal is open on the file named journalName once a change has been
+   journaled there, and journaled counts the changes in it; compactions write
+   the binary database file databaseName. Journaling is off while journalName
+   is NULL. ownsDatabase is 1 once databaseName holds this store's roads,
+   because it was loaded at the start or written by a compaction; a
+   compaction never writes over a database file the store does not own.
+ - published and reclaimed count the snapshots made and freed so far.
+ - feed is the feed thread, if feeding; feedApplied and feedSkipped count its
+   lines, and feedDone is set once its file has run out.
+*/
+typedef struct snapshotstore {
+	cdb* db;
+	int options;
+	_Atomic(gsnap*) current;
+	atomic_ulong epoch;
+	atomic_ulong pinned[MAX_READERS];
+	atomic_int readers;
+	pthread_mutex_t writer;
+	gsnap* retired;
+	redit* edits;
+	long int editCount;
+	long int editCapacity;
+	cn** stock;
+	FILE* journal;
+	char* journalName;
+	char* databaseName;
+	long int journaled;
+	int ownsDatabase;
+	atomic_long published;
+	atomic_long reclaimed;
+	pthread_t feed;
+	int feeding;
+	FILE* feedFile;
+	atomic_long feedApplied;
+	atomic_long feedSkipped;
+	atomic_int feedDone;
+} sstore;
+
+sstore* newSnapshotStore(cdb* db, int options);
+void purgeSnapshotStore(sstore* store);
+
+int joinSnapshotReaders(sstore* store);
+gsnap* pinSnapshot(sstore* store, int reader);
+void unpinSnapshot(sstore* store, int reader);
+
+long int restoreSnapshotStore(sstore* store, redit* edits, long int count, char* journalName, char* databaseName);
+int compactJournal(sstore* store);
+long int journalStatus(sstore* store, char* name, int size);
+
+int setRoadClosed(sstore* store, long int from, long int to, int closed);
+int setRoadDistance(sstore* store, long int from, long int to, long int distance);
+int setCityStock(sstore* store, long int city, char* resources);
+int startRoadFeed(sstore* store, FILE* file);
+
+#endif
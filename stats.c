@@ -0,0 +1,80 @@
+#include <stdio.h>
+#include <time.h>
+#include "stats.h"
+
+#ifdef RELIEF_STATS
+
+atomic_ulong statCounters[STAT_COUNT];
+
+static const char* counterNames[STAT_COUNT] = {
+	"settled", "relaxed", "heap ops", "lookups", "path copies", "bytes"
+};
+
+static const char* phaseNames[PHASE_COUNT] = {
+	"load", "link", "search", "print"
+};
+
+static double phaseTotal[PHASE_COUNT];
+static double phaseStart[PHASE_COUNT];
+static unsigned long phaseRuns[PHASE_COUNT];
+
+/*
+ Returns a monotonic timestamp in milliseconds.
+*/
+static double nowms()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+/*
+ Starts timing the given phase.
+*/
+void phaseBegin(int phase)
+{
+	phaseStart[phase] = nowms();
+}
+
+/*
+ Stops timing the given phase and adds the elapsed time to its total.
+*/
+void phaseEnd(int phase)
+{
+	phaseTotal[phase] += nowms() - phaseStart[phase];
+	phaseRuns[phase]++;
+}
+
+/*
+ Prints a compact report of all counters and phase timings.
+*/
+void printStats(FILE* out)
+{
+	int x;
+	
+	fprintf(out, "stats:");
+	for(x = 0; x < STAT_COUNT; x++) {
+		fprintf(out, " %s=%lu", counterNames[x], atomic_load_explicit(&statCounters[x], memory_order_relaxed));
+	}
+	fprintf(out, "\ntimes:");
+	for(x = 0; x < PHASE_COUNT; x++) {
+		fprintf(out, " %s=%.3fms/%lu", phaseNames[x], phaseTotal[x], phaseRuns[x]);
+	}
+	fprintf(out, "\n");
+}
+
+/*
+ Zeroes all counters and phase timings.
+*/
+void resetStats()
+{
+	int x;
+	
+	for(x = 0; x < STAT_COUNT; x++) atomic_store_explicit(&statCounters[x], 0, memory_order_relaxed);
+	for(x = 0; x < PHASE_COUNT; x++) {
+		phaseTotal[x] = 0;
+		phaseRuns[x] = 0;
+	}
+}
+
+#endif
@@ -0,0 +1,64 @@
+#include <stdio.h>
+#include <stdatomic.h>
+
+#ifndef stats_h
+#define stats_h
+
+/*
+ Hot-path instrumentation.
+ 
+ Counters and phase timers are only compiled in when RELIEF_STATS is defined
+ (eg gcc -DRELIEF_STATS ...). Without it every macro below expands to nothing,
+ so a normal build carries no instrumentation overhead at all.
+ 
+ The counters are bumped by road update and delta-stepping threads as well as
+ the query thread, so they are atomic; the phase timers are only run by the
+ query thread.
+*/
+
+enum statCounter {
+	STAT_SETTLED,		// Cities settled (moved into) by a search.
+	STAT_RELAXED,		// Edges examined by a search.
+	STAT_HEAPOPS,		// Priority queue pushes and pops.
+	STAT_LOOKUPS,		// CSearch and name dictionary lookups.
+	STAT_PATHCOPIES,	// Deep path copies.
+	STAT_BYTES,			// Bytes allocated.
+	STAT_COUNT
+};
+
+enum statPhase {
+	PHASE_LOAD,
+	PHASE_LINK,
+	PHASE_SEARCH,
+	PHASE_PRINT,
+	PHASE_COUNT
+};
+
+#ifdef RELIEF_STATS
+
+extern atomic_ulong statCounters[STAT_COUNT];
+
+void phaseBegin(int phase);
+void phaseEnd(int phase);
+void printStats(FILE* out);
+void resetStats();
+
+#define STAT_INC(counter) atomic_fetch_add_explicit(&statCounters[(counter)], 1, memory_order_relaxed)
+#define STAT_ADD(counter, n) atomic_fetch_add_explicit(&statCounters[(counter)], (unsigned long)(n), memory_order_relaxed)
+#define PHASE_BEGIN(phase) phaseBegin(phase)
+#define PHASE_END(phase) phaseEnd(phase)
+#define STATS_REPORT(out) printStats(out)
+#define STATS_RESET() resetStats()
+
+#else
+
+#define STAT_INC(counter) ((void)0)
+#define STAT_ADD(counter, n) ((void)0)
+#define PHASE_BEGIN(phase) ((void)0)
+#define PHASE_END(phase) ((void)0)
+#define STATS_REPORT(out) fprintf((out), "Statistics are disabled (rebuild with -DRELIEF_STATS).\n")
+#define STATS_RESET() ((void)0)
+
+#endif
+
+#endif
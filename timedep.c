@@ -0,0 +1,250 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <limits.h> //for LONG_MAX
+#include "reliefdb.h"
+#include "search.h"
+#include "timedep.h"
+#include "memacct.h"
+
+#define INF LONG_MAX
+#define MAX_PROFILE_LINE 4096
+#define CACHE_LINE 64
+
+/*
+ Divides, rounding towards negative infinity rather than zero.
+*/
+static long int floorDiv(long int a, long int b)
+{
+	return a / b - (a % b != 0 && (a < 0) != (b < 0));
+}
+
+/*
+ Reads breakpoints "time:travel,time:travel,..." into points.
+ Times must be hours of the day in increasing order and travel times must not be negative, and
+ the profile must be FIFO: between two breakpoints, the travel time may not fall faster than the
+ clock moves on, counting the wrap from the last breakpoint back to the first.
+ 
+ Returns the number of breakpoints read, or 0 if the profile is not valid.
+*/
+static int parseProfile(char* text, tdpoint* points, int maxPoints)
+{
+	int count = 0;
+	long int time;
+	long int travel;
+	long int span;
+	char* end;
+	int x;
+	
+	while(*text != '\0' && *text != '\n') {
+		if(count == maxPoints) return 0;
+		time = strtol(text, &end, 10);
+		if(end == text || *end != ':') return 0;
+		text = end + 1;
+		travel = strtol(text, &end, 10);
+		if(end == text || (*end != ',' && *end != '\0' && *end != '\n')) return 0;
+		text = *end == ',' ? end + 1 : end;
+		
+		if(time < 0 || time >= TD_PERIOD || travel < 0 || travel > INT_MAX) return 0;
+		if(count > 0 && time <= points[count - 1].time) return 0;
+		points[count].time = (int)time;
+		points[count].travel = (int)travel;
+		count++;
+	}
+	
+	for(x = 0; x < count && count > 1; x++) {
+		span = x + 1 < count ? points[x + 1].time - points[x].time : points[0].time + TD_PERIOD - points[x].time;
+		if(points[(x + 1) % count].travel - points[x].travel < -span) return 0;
+	}
+	
+	return count;
+}
+
+/*
+ Loads travel time profiles for a search graph from a file with one edge per line, as in
+ "12|40|0:5,7:9,10:6,18:5": the IDs of the cities the edge leaves and arrives at, then the
+ breakpoints of its profile. A profile applies to every edge between the two cities.
+ A later line for the same edge replaces an earlier one; lines that name no edge or hold an
+ invalid profile are reported and skipped.
+ 
+ Returns the profiles, which must be purged with purgeProfiles.
+*/
+tdprof* loadProfiles(sgraph* graph, FILE* file)
+{
+	tdprof* profiles = (tdprof*)memAlloc(MEM_GRAPH, sizeof(tdprof));
+	char* line = (char*)memAlloc(MEM_SCRATCH, MAX_PROFILE_LINE);
+	long int* latest = (long int*)memAlloc(MEM_SCRATCH, sizeof(long int) * (graph->edges + 1));
+	long int* stagedStart = (long int*)memAlloc(MEM_SCRATCH, sizeof(long int));
+	int* stagedCount = (int*)memAlloc(MEM_SCRATCH, sizeof(int));
+	tdpoint* staged = (tdpoint*)memAlloc(MEM_SCRATCH, sizeof(tdpoint) * MAX_PROFILE_LINE);
+	sedges* edges = newSearchEdges();
+	long int stagedPoints = 0;
+	long int stagedCapacity = MAX_PROFILE_LINE;
+	long int lines = 0;
+	long int lineNumber = 0;
+	long int offset = 0;
+	long int from;
+	long int to;
+	long int e;
+	int count;
+	int found;
+	char* text;
+	char* end;
+	
+	for(e = 0; e < graph->edges; e++) latest[e] = -1;
+	
+	while(fgets(line, MAX_PROFILE_LINE, file) != NULL) {
+		lineNumber++;
+		if(line[0] == '\n' || line[0] == '\0') continue;
+		
+		from = strtol(line, &end, 10);
+		text = end;
+		if(*text == '|') to = strtol(text + 1, &end, 10);
+		if(*text != '|' || *end != '|') {
+			printf("Line %ld is not of the form from|to|time:travel,..., skipping.\n", lineNumber);
+			continue;
+		}
+		text = end + 1;
+		
+		if(stagedPoints + MAX_PROFILE_LINE / 2 > stagedCapacity) {
+			stagedCapacity *= 2;
+			staged = (tdpoint*)memRealloc(staged, sizeof(tdpoint) * stagedCapacity);
+		}
+		if(!(count = parseProfile(text, staged + stagedPoints, MAX_PROFILE_LINE / 2))) {
+			printf("Profile on line %ld is not valid (times 0-%d in order, FIFO), skipping.\n", lineNumber, TD_PERIOD - 1);
+			continue;
+		}
+		
+		from = searchIndexOf(graph, from);
+		to = searchIndexOf(graph, to);
+		found = 0;
+		if(from != -1 && to != -1) searchEdges(graph, from, SEARCH_FORWARD, 0, edges);
+		for(e = 0; from != -1 && to != -1 && e < edges->count; e++) {
+			if(edges->to[e] != to) continue;
+			latest[edges->first + e] = lines;
+			found = 1;
+		}
+		if(!found) {
+			printf("No travel table on line %ld joins those cities, skipping.\n", lineNumber);
+			continue;
+		}
+		
+		stagedStart = (long int*)memRealloc(stagedStart, sizeof(long int) * (lines + 1));
+		stagedCount = (int*)memRealloc(stagedCount, sizeof(int) * (lines + 1));
+		stagedStart[lines] = stagedPoints;
+		stagedCount[lines] = count;
+		stagedPoints += count;
+		lines++;
+	}
+	
+	// Lay the profiles out so a short one never straddles two cache lines.
+	profiles->edges = graph->edges;
+	profiles->profiles = 0;
+	profiles->start = (long int*)memAlloc(MEM_GRAPH, sizeof(long int) * (graph->edges + 1));
+	profiles->count = (int*)memCalloc(MEM_GRAPH, graph->edges + 1, sizeof(int));
+	for(e = 0; e < graph->edges; e++) {
+		profiles->start[e] = offset;
+		if(latest[e] == -1) continue;
+		count = stagedCount[latest[e]];
+		if(count <= TD_LINE_POINTS && offset % TD_LINE_POINTS + count > TD_LINE_POINTS) {
+			offset += TD_LINE_POINTS - offset % TD_LINE_POINTS;
+		}
+		profiles->start[e] = offset;
+		profiles->count[e] = count;
+		profiles->profiles++;
+		offset += count;
+	}
+	
+	profiles->block = memAlloc(MEM_GRAPH, sizeof(tdpoint) * (offset + 1) + CACHE_LINE - 1);
+	profiles->points = (tdpoint*)(((uintptr_t)profiles->block + CACHE_LINE - 1) & ~(uintptr_t)(CACHE_LINE - 1));
+	for(e = 0; e < graph->edges; e++) {
+		if(latest[e] == -1) continue;
+		memcpy(profiles->points + profiles->start[e], staged + stagedStart[latest[e]], sizeof(tdpoint) * profiles->count[e]);
+	}
+	
+	memFree(line);
+	memFree(latest);
+	memFree(stagedStart);
+	memFree(stagedCount);
+	memFree(staged);
+	purgeSearchEdges(edges);
+	
+	return profiles;
+}
+
+void purgeProfiles(tdprof* profiles)
+{
+	if(profiles == NULL) return;
+	memFree(profiles->start);
+	memFree(profiles->count);
+	memFree(profiles->block);
+	memFree(profiles);
+}
+
+/*
+ Returns the hours it takes to travel a forward edge of the given distance leaving at the given
+ hour, counted from midnight on the first day. Static edges take their distance at any hour.
+ Interpolated times round down, which keeps integer departures FIFO.
+*/
+long int travelTime(tdprof* profiles, long int edge, dist_t distance, long int departure)
+{
+	if(profiles == NULL || profiles->count[edge] == 0) return distLong(distance);
+	
+	tdpoint* points = profiles->points + profiles->start[edge];
+	int count = profiles->count[edge];
+	long int hour = ((departure % TD_PERIOD) + TD_PERIOD) % TD_PERIOD;
+	long int before = count - 1;
+	long int after;
+	long int startTime;
+	long int endTime;
+	int x;
+	
+	if(count == 1) return points[0].travel;
+	
+	// The breakpoint at or before this hour, wrapping to yesterday's last one.
+	for(x = 0; x < count && points[x].time <= hour; x++) before = x;
+	after = (before + 1) % count;
+	startTime = points[before].time > hour ? points[before].time - TD_PERIOD : points[before].time;
+	endTime = after == 0 ? points[0].time + (startTime >= 0 ? TD_PERIOD : 0) : points[after].time;
+	
+	return points[before].travel + floorDiv((long int)(points[after].travel - points[before].travel) * (hour - startTime), endTime - startTime);
+}
+
+/*
+ Finds the quickest route between two cities leaving at the given hour, with a time-dependent
+ Dijkstra: labels are arrival times, and each edge is timed from the moment it is reached.
+ Because every profile is FIFO, waiting never helps and the first arrival is the best.
+ 
+ Returns the route in the query context's path, hop distances being the hours each leg took
+ and the total the length of the journey, or NULL if the destination cannot be reached.
+*/
+cpath* departAt(sgraph* graph, tdprof* profiles, qctx* ctx, cn* from, cn* to, long int departure)
+{
+	cpath* path;
+	long int target = graph->component[to->index];
+	sedges* edges = ctx->edges;
+	long int city;
+	long int e;
+	
+	if(!searchMayReach(graph, from->index, to->index)) return NULL;
+	
+	searchBegin(ctx);
+	searchSeed(ctx, from->index, departure);
+	
+	// Cities in components ordered after the destination's cannot lead to it, so they are never queued.
+	while((city = searchSettle(ctx)) != -1 && city != to->index) {
+		searchEdges(graph, city, SEARCH_FORWARD, 0, edges);
+		for(e = 0; e < edges->count; e++) {
+			if(graph->component[edges->to[e]] < target || edges->dist[e] == DIST_INF) continue;
+			searchRelax(ctx, city, edges->to[e], distAdd(ctx->dist[city], distClamp(travelTime(profiles, edges->first + e, edges->dist[e], ctx->dist[city]))));
+		}
+	}
+	
+	if(searchDistance(ctx, to->index) == INF) return NULL;
+	
+	path = buildSearchPath(ctx, graph, to->index, SEARCH_FORWARD);
+	path->totalDistance -= departure;
+	
+	return path;
+}
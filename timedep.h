@@ -0,0 +1,55 @@
+#include "reliefdb.h"
+#include "search.h"
+
+#ifndef timedep_h
+#define timedep_h
+
+#define TD_PERIOD 24		// Travel time profiles repeat every day.
+#define TD_LINE_POINTS 8	// Breakpoints that fit in one 64 byte cache line.
+
+/*
+ One breakpoint of a travel time profile: leaving at hour time of the day,
+ the edge takes travel hours. Kept to two ints so a whole short profile sits
+ in one cache line.
+*/
+typedef struct tdpoint {
+	int time;
+	int travel;
+} tdpoint;
+
+/*
+ Time-dependent travel times for some of the edges of a search graph.
+ 
+ Each profile is a piecewise-linear function of the hour of the day,
+ interpolated between its breakpoints and wrapping from the last back to
+ the first, so it repeats every TD_PERIOD hours. Every profile is FIFO:
+ leaving later never means arriving earlier.
+ 
+ Edges without a profile keep their static distance, and the profiles live
+ apart from the search graph, so searches that do not ask for a departure
+ time never touch them.
+ 
+ - edges is the number of forward edges in the search graph.
+ - start holds the profiles in compressed sparse row form over the forward
+   edges: edge e's breakpoints are points[start[e]] to points[start[e] + count[e] - 1],
+   and an edge with a count of 0 is static.
+ - points is aligned to a cache line, and a profile short enough to fit in
+   one line never straddles two.
+ - block is the allocation points was carved from.
+*/
+typedef struct tdprofiles {
+	long int edges;
+	long int profiles;
+	long int* start;
+	int* count;
+	tdpoint* points;
+	void* block;
+} tdprof;
+
+tdprof* loadProfiles(sgraph* graph, FILE* file);
+void purgeProfiles(tdprof* profiles);
+
+long int travelTime(tdprof* profiles, long int edge, dist_t distance, long int departure);
+cpath* departAt(sgraph* graph, tdprof* profiles, qctx* ctx, cn* from, cn* to, long int departure);
+
+#endif
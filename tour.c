@@ -0,0 +1,315 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <limits.h> //for LONG_MAX
+#include "reliefdb.h"
+#include "search.h"
+#include "distcache.h"
+#include "routes.h"
+#include "tour.h"
+#include "memacct.h"
+
+#define INF LONG_MAX
+#define TOUR_DP_LIMIT 4000000	// Largest (2^groups * candidates^2) solved exactly.
+#define DESTINATION -1
+
+/*
+ Working state for one tour plan.
+ 
+ - groups is the number of different resources wanted; tour bit b stands for RESOURCE_LETTERS[letter[b]].
+ - count is the number of candidate providers, with their city index and the tour bits they cover.
+ - between[a * count + b] is the distance from candidate a to candidate b.
+ - back[a] is the distance from candidate a to the city in distress.
+*/
+typedef struct tourplan {
+	int groups;
+	int letter[NUM_RESOURCES];
+	long int count;
+	long int* city;
+	int* mask;
+	long int* between;
+	long int* back;
+} tplan;
+
+/*
+ Distance between two candidates, where DESTINATION stands for the city in distress.
+*/
+static long int legLength(tplan* plan, long int from, long int to)
+{
+	if(to == DESTINATION) return plan->back[from];
+	return plan->between[from * plan->count + to];
+}
+
+/*
+ Adds two distances, staying at INF if either is INF.
+*/
+static long int addLegs(long int a, long int b)
+{
+	if(a == INF || b == INF) return INF;
+	return a + b;
+}
+
+/*
+ Solves the tour exactly with dynamic programming over (resources covered, last stop).
+ 
+ Returns the number of stops written to order, or 0 if no tour exists.
+*/
+static long int exactTour(tplan* plan, long int* order)
+{
+	int full = (1 << plan->groups) - 1;
+	long int states = (long int)(full + 1) * plan->count;
+	long int* best = (long int*)memAlloc(MEM_SCRATCH, sizeof(long int) * states);
+	long int* prev = (long int*)memAlloc(MEM_SCRATCH, sizeof(long int) * states);
+	long int c;
+	long int d;
+	long int x;
+	long int cost;
+	long int bestCost = INF;
+	long int bestEnd = -1;
+	long int stops = 0;
+	int mask;
+	int next;
+	
+	for(x = 0; x < states; x++) best[x] = INF;
+	for(c = 0; c < plan->count; c++) {
+		best[plan->mask[c] * plan->count + c] = 0;
+		prev[plan->mask[c] * plan->count + c] = -1;
+	}
+	
+	// Every useful move covers something new, so masks only grow and can be taken in order.
+	for(mask = 1; mask <= full; mask++) {
+		for(c = 0; c < plan->count; c++) {
+			if(best[mask * plan->count + c] == INF) continue;
+			for(d = 0; d < plan->count; d++) {
+				if(!(plan->mask[d] & ~mask)) continue;
+				cost = addLegs(best[mask * plan->count + c], legLength(plan, c, d));
+				next = mask | plan->mask[d];
+				if(cost < best[next * plan->count + d]) {
+					best[next * plan->count + d] = cost;
+					prev[next * plan->count + d] = mask * plan->count + c;
+				}
+			}
+		}
+	}
+	
+	for(c = 0; c < plan->count; c++) {
+		cost = addLegs(best[full * plan->count + c], plan->back[c]);
+		if(cost < bestCost) {
+			bestCost = cost;
+			bestEnd = full * plan->count + c;
+		}
+	}
+	
+	// Walk back from the last stop, then put the stops in visiting order.
+	for(x = bestEnd; x != -1; x = prev[x]) order[stops++] = x % plan->count;
+	for(x = 0; x < stops / 2; x++) {
+		c = order[x];
+		order[x] = order[stops - 1 - x];
+		order[stops - 1 - x] = c;
+	}
+	
+	memFree(best);
+	memFree(prev);
+	return stops;
+}
+
+/*
+ Builds a tour by cheapest insertion: while a resource is still missing, insert the candidate
+ and position that add the least distance per new resource covered.
+ 
+ Returns the number of stops written to order, or 0 if no tour exists.
+*/
+static long int insertionTour(tplan* plan, long int* order)
+{
+	int full = (1 << plan->groups) - 1;
+	int covered = 0;
+	int gained;
+	int bits;
+	long int stops = 0;
+	long int c;
+	long int p;
+	long int x;
+	long int before;
+	long int after;
+	long int delta;
+	long int bestCandidate;
+	long int bestPosition = 0;
+	double score;
+	double bestScore;
+	
+	while(covered != full) {
+		bestCandidate = -1;
+		bestScore = 0;
+		
+		for(c = 0; c < plan->count; c++) {
+			gained = plan->mask[c] & ~covered;
+			if(!gained) continue;
+			for(bits = 0; gained; gained &= gained - 1) bits++;
+			
+			for(p = 0; p <= stops; p++) {
+				before = p > 0 ? order[p - 1] : -1;
+				after = p < stops ? order[p] : DESTINATION;
+				
+				delta = addLegs(before == -1 ? 0 : legLength(plan, before, c), legLength(plan, c, after));
+				if(delta == INF) continue;
+				if(before != -1) delta -= legLength(plan, before, after);
+				
+				score = (double)delta / bits;
+				if(bestCandidate == -1 || score < bestScore) {
+					bestScore = score;
+					bestCandidate = c;
+					bestPosition = p;
+				}
+			}
+		}
+		
+		if(bestCandidate == -1) return 0;
+		
+		for(x = stops; x > bestPosition; x--) order[x] = order[x - 1];
+		order[bestPosition] = bestCandidate;
+		stops++;
+		covered |= plan->mask[bestCandidate];
+	}
+	
+	return stops;
+}
+
+/*
+ Plans the shortest route for one vehicle that collects every wanted resource from providers
+ and ends at the destination.
+ 
+ Providers are drawn from the nearest few (candidates) of each wanted resource, so the tour
+ is optimal over those candidates rather than over every provider in the database. Distances
+ between candidates come from one-to-many rows in the distance cache, so planning again for
+ the same cities needs no searching at all. Small problems are solved exactly; larger ones
+ fall back on cheapest insertion.
+ 
+ Returns 1 and fills tour if a tour exists.
+ Returns 0 if some wanted resource cannot reach the destination.
+*/
+int planTour(cdb* db, qctx* ctx, dcache* cache, cn* destination, char* wanted, long int candidates, rtour* tour)
+{
+	sgraph* graph = db->graph;
+	plist* lists[NUM_RESOURCES];
+	int bit[NUM_RESOURCES];
+	long int order[NUM_RESOURCES * 2];
+	dist_t* row;
+	long int stops;
+	long int a;
+	long int b;
+	long int x;
+	int collected;
+	int found = 1;
+	int r;
+	tplan plan;
+	cn* city;
+	
+	plan.groups = 0;
+	for(r = 0; r < NUM_RESOURCES; r++) bit[r] = -1;
+	for(x = 0; wanted[x] != '\0'; x++) {
+		r = resourceIndex(wanted[x]);
+		if(r == -1 || bit[r] != -1) continue;
+		bit[r] = plan.groups;
+		plan.letter[plan.groups++] = r;
+	}
+	if(plan.groups == 0) return 0;
+	
+	for(r = 0; r < NUM_RESOURCES; r++) lists[r] = newProviderList(RESOURCE_LETTERS[r], bit[r] == -1 ? 0 : candidates);
+	nearestProviders(db, ctx, destination, wanted, lists);
+	
+	// Gather the candidates, once per city, with every wanted resource each one has.
+	plan.count = 0;
+	for(r = 0; r < NUM_RESOURCES; r++) {
+		if(bit[r] != -1 && lists[r]->size == 0) found = 0;
+		plan.count += lists[r]->size;
+	}
+	plan.city = (long int*)memAlloc(MEM_SCRATCH, sizeof(long int) * (plan.count + 1));
+	plan.mask = (int*)memAlloc(MEM_SCRATCH, sizeof(int) * (plan.count + 1));
+	plan.count = 0;
+	for(r = 0; r < NUM_RESOURCES && found; r++) {
+		for(a = 0; a < lists[r]->size; a++) {
+			city = lists[r]->providers[a]->city;
+			for(b = 0; b < plan.count && plan.city[b] != city->index; b++);
+			if(b < plan.count) continue;
+			
+			plan.city[plan.count] = city->index;
+			plan.mask[plan.count] = 0;
+			for(x = 0; city->resources[x] != '\0'; x++) {
+				if(resourceIndex(city->resources[x]) != -1 && bit[resourceIndex(city->resources[x])] != -1 && city->stock[resourceIndex(city->resources[x])] != 0) {
+					plan.mask[plan.count] |= 1 << bit[resourceIndex(city->resources[x])];
+				}
+			}
+			plan.count++;
+		}
+	}
+	for(r = 0; r < NUM_RESOURCES; r++) purgeProviderList(lists[r]);
+	
+	if(!found) {
+		memFree(plan.city);
+		memFree(plan.mask);
+		return 0;
+	}
+	
+	// Copy the distances needed out of the cached rows.
+	plan.between = (long int*)memAlloc(MEM_SCRATCH, sizeof(long int) * plan.count * plan.count);
+	plan.back = (long int*)memAlloc(MEM_SCRATCH, sizeof(long int) * plan.count);
+	row = cachedDistances(cache, graph, ctx, destination->index, SEARCH_BACKWARD);
+	for(a = 0; a < plan.count; a++) plan.back[a] = distLong(row[plan.city[a]]);
+	for(a = 0; a < plan.count; a++) {
+		row = cachedDistances(cache, graph, ctx, plan.city[a], SEARCH_FORWARD);
+		for(b = 0; b < plan.count; b++) plan.between[a * plan.count + b] = distLong(row[plan.city[b]]);
+	}
+	
+	if(((long int)1 << plan.groups) * plan.count * plan.count <= TOUR_DP_LIMIT) {
+		tour->exact = 1;
+		stops = exactTour(&plan, order);
+	}
+	else {
+		tour->exact = 0;
+		stops = insertionTour(&plan, order);
+	}
+	
+	// Keep only the stops that collect something new, and measure the legs between them.
+	tour->stops = 0;
+	tour->totalDistance = 0;
+	collected = 0;
+	for(x = 0; x < stops; x++) {
+		if(!(plan.mask[order[x]] & ~collected)) continue;
+		tour->stop[tour->stops] = graph->cities[plan.city[order[x]]];
+		tour->collect[tour->stops] = 0;
+		for(r = 0; r < plan.groups; r++) {
+			if((plan.mask[order[x]] & ~collected) & (1 << r)) tour->collect[tour->stops] |= 1 << plan.letter[r];
+		}
+		collected |= plan.mask[order[x]];
+		order[tour->stops++] = order[x];
+	}
+	for(x = 0; x < tour->stops; x++) {
+		tour->legDistance[x] = legLength(&plan, order[x], x + 1 < tour->stops ? order[x + 1] : DESTINATION);
+		tour->totalDistance = addLegs(tour->totalDistance, tour->legDistance[x]);
+	}
+	
+	memFree(plan.city);
+	memFree(plan.mask);
+	memFree(plan.between);
+	memFree(plan.back);
+	
+	return stops > 0;
+}
+
+/*
+ Finds the cities travelled through on one leg of a tour: from stop leg to the next stop, or to
+ the destination for the last leg.
+ 
+ Returns the query context's path, which is overwritten by the next search.
+*/
+cpath* tourLeg(cdb* db, qctx* ctx, rtour* tour, long int leg, cn* destination)
+{
+	sgraph* graph = db->graph;
+	cn* to = leg + 1 < tour->stops ? tour->stop[leg + 1] : destination;
+	long int city;
+	
+	searchBegin(ctx);
+	searchSeed(ctx, tour->stop[leg]->index, 0);
+	while((city = searchNext(ctx, graph, SEARCH_FORWARD)) != -1 && city != to->index);
+	
+	return buildSearchPath(ctx, graph, to->index, SEARCH_FORWARD);
+}
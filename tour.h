@@ -0,0 +1,34 @@
+#include "reliefdb.h"
+#include "search.h"
+#include "distcache.h"
+
+#ifndef tour_h
+#define tour_h
+
+/*
+ A tour is a single vehicle's route collecting several resources on its way
+ to a city in distress. Every stop collects at least one new resource, so a
+ tour never has more than NUM_RESOURCES stops.
+ 
+ - stops is the number of providers visited.
+ - stop holds the providers in visiting order.
+ - collect holds, for each stop, a bit per RESOURCE_LETTERS position for the
+   resources first collected there.
+ - legDistance holds the distance from each stop to the next, the last leg
+   ending at the city in distress.
+ - exact is 1 if the tour is optimal over the candidates considered, 0 if it
+   came from the insertion heuristic.
+*/
+typedef struct tour {
+	long int stops;
+	cn* stop[NUM_RESOURCES];
+	int collect[NUM_RESOURCES];
+	long int legDistance[NUM_RESOURCES];
+	long int totalDistance;
+	int exact;
+} rtour;
+
+int planTour(cdb* db, qctx* ctx, dcache* cache, cn* destination, char* wanted, long int candidates, rtour* tour);
+cpath* tourLeg(cdb* db, qctx* ctx, rtour* tour, long int leg, cn* destination);
+
+#endif
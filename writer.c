@@ -0,0 +1,345 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <limits.h> //for LONG_MAX
+#include "reliefdb.h"
+#include "objects.h"
+#include "search.h"
+#include "writer.h"
+#include "memacct.h"
+
+#define INF LONG_MAX
+#define MAX_LONG_DIGITS 20
+#define MAX_MESSAGE 1024
+
+/*
+ Creates a result writer for an open stream, which the writer does not close.
+*/
+rwriter* newResultWriter(FILE* out, int format)
+{
+	rwriter* writer = (rwriter*)memAlloc(MEM_SCRATCH, sizeof(rwriter));
+	
+	writer->out = out;
+	writer->owned = 0;
+	writer->format = format;
+	writer->buffer = (char*)memAlloc(MEM_SCRATCH, WRITER_BUFFER);
+	writer->used = 0;
+	writer->chain = (long int*)memAlloc(MEM_SCRATCH, sizeof(long int));
+	writer->chainCapacity = 1;
+	
+	return writer;
+}
+
+/*
+ Creates a result writer for a new file, which the writer closes when purged.
+ 
+ Returns the writer, or NULL if the file cannot be opened.
+*/
+rwriter* openResultWriter(char* filename, int format)
+{
+	FILE* out = fopen(filename, format == FORMAT_BINARY ? "wb" : "w");
+	rwriter* writer;
+	
+	if(out == NULL) return NULL;
+	writer = newResultWriter(out, format);
+	writer->owned = 1;
+	
+	return writer;
+}
+
+/*
+ Hands everything in the buffer to the stream.
+*/
+void flushResults(rwriter* writer)
+{
+	if(writer->used > 0) fwrite(writer->buffer, 1, writer->used, writer->out);
+	writer->used = 0;
+	fflush(writer->out);
+}
+
+void purgeResultWriter(rwriter* writer)
+{
+	if(writer == NULL) return;
+	flushResults(writer);
+	if(writer->owned) fclose(writer->out);
+	memFree(writer->buffer);
+	memFree(writer->chain);
+	memFree(writer);
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////FORMATTING/////////////////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/*
+ Makes room for size more bytes, flushing the buffer if they do not fit.
+*/
+static void reserve(rwriter* writer, long int size)
+{
+	if(writer->used + size > WRITER_BUFFER) {
+		fwrite(writer->buffer, 1, writer->used, writer->out);
+		writer->used = 0;
+	}
+}
+
+static void putBytes(rwriter* writer, const void* bytes, long int size)
+{
+	if(size > WRITER_BUFFER) {
+		reserve(writer, WRITER_BUFFER);
+		fwrite(bytes, 1, size, writer->out);
+		return;
+	}
+	reserve(writer, size);
+	memcpy(writer->buffer + writer->used, bytes, size);
+	writer->used += size;
+}
+
+static void putText(rwriter* writer, const char* text)
+{
+	putBytes(writer, text, strlen(text));
+}
+
+/*
+ Writes a long int in decimal, digit by digit from the end, without going through printf.
+*/
+static void putLong(rwriter* writer, long int value)
+{
+	char digits[MAX_LONG_DIGITS + 1];
+	unsigned long int magnitude = value < 0 ? -(unsigned long int)value : (unsigned long int)value;
+	int at = MAX_LONG_DIGITS + 1;
+	
+	do {
+		digits[--at] = '0' + magnitude % 10;
+		magnitude /= 10;
+	} while(magnitude > 0);
+	if(value < 0) digits[--at] = '-';
+	
+	putBytes(writer, digits + at, MAX_LONG_DIGITS + 1 - at);
+}
+
+static void putRecord(rwriter* writer, long int value)
+{
+	int64_t record = value;
+	putBytes(writer, &record, sizeof(int64_t));
+}
+
+/*
+ Writes text as a JSON string, escaping quotes, backslashes and control characters.
+*/
+static void putJSONString(rwriter* writer, const char* text, long int length)
+{
+	char escape[7];
+	long int x;
+	
+	putBytes(writer, "\"", 1);
+	for(x = 0; x < length; x++) {
+		if(text[x] == '"' || text[x] == '\\') {
+			escape[0] = '\\';
+			escape[1] = text[x];
+			putBytes(writer, escape, 2);
+		}
+		else if((unsigned char)text[x] < 0x20) {
+			snprintf(escape, sizeof(escape), "\\u%04x", (unsigned char)text[x]);
+			putBytes(writer, escape, 6);
+		}
+		else putBytes(writer, text + x, 1);
+	}
+	putBytes(writer, "\"", 1);
+}
+
+/*
+ Formats text with printf into the buffer, or straight to the stream if it is too long for it.
+*/
+static void putFormatted(rwriter* writer, const char* format, va_list args)
+{
+	va_list again;
+	long int length;
+	
+	va_copy(again, args);
+	length = vsnprintf(NULL, 0, format, again);
+	va_end(again);
+	
+	if(length + 1 > WRITER_BUFFER) {
+		reserve(writer, WRITER_BUFFER);
+		vfprintf(writer->out, format, args);
+		return;
+	}
+	reserve(writer, length + 1);
+	vsnprintf(writer->buffer + writer->used, length + 1, format, args);
+	writer->used += length;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////RESULTS////////////////////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/*
+ Writes a message about the results, as in "Resource B is not available.\n\n".
+ JSON Lines gets the message without its surrounding blank lines, cut to MAX_MESSAGE bytes,
+ and nothing for a message that is only blank lines; binary leaves it out.
+*/
+void writeMessage(rwriter* writer, const char* format, ...)
+{
+	char message[MAX_MESSAGE];
+	va_list args;
+	long int start = 0;
+	long int end;
+	
+	if(writer->format == FORMAT_BINARY) return;
+	
+	va_start(args, format);
+	if(writer->format == FORMAT_TEXT) putFormatted(writer, format, args);
+	else vsnprintf(message, MAX_MESSAGE, format, args);
+	va_end(args);
+	if(writer->format == FORMAT_TEXT) return;
+	
+	end = strlen(message);
+	while(start < end && (message[start] == '\n' || message[start] == ' ')) start++;
+	while(end > start && (message[end - 1] == '\n' || message[end - 1] == ' ')) end--;
+	if(start == end) return;
+	putText(writer, "{\"message\":");
+	putJSONString(writer, message + start, end - start);
+	putText(writer, "}\n");
+}
+
+/*
+ Starts a route from one city to another, carrying the given resource letters (NULL for none).
+ The heading is printf formatted, and only text shows it.
+*/
+void beginRoute(rwriter* writer, char* resources, cn* from, cn* to, const char* heading, ...)
+{
+	unsigned char mask = 0;
+	va_list args;
+	int x;
+	
+	if(writer->format == FORMAT_TEXT) {
+		va_start(args, heading);
+		putFormatted(writer, heading, args);
+		va_end(args);
+	}
+	else if(writer->format == FORMAT_JSONL) {
+		putText(writer, "{\"resources\":");
+		if(resources == NULL) putText(writer, "null");
+		else putJSONString(writer, resources, strlen(resources));
+		putText(writer, ",\"from\":");
+		putLong(writer, from->id);
+		putText(writer, ",\"to\":");
+		putLong(writer, to->id);
+		putText(writer, ",\"hops\":[");
+	}
+	else {
+		for(x = 0; resources != NULL && resources[x] != '\0'; x++) {
+			if(resourceIndex(resources[x]) != -1) mask |= 1 << resourceIndex(resources[x]);
+		}
+		putBytes(writer, "R", 1);
+		putBytes(writer, &mask, 1);
+		putRecord(writer, from->id);
+		putRecord(writer, to->id);
+	}
+}
+	
+/*
+ Writes the number'th hop of the current route (counting from 1). The hours elapsed go out in
+ JSON Lines and binary only; the text line is the one printed before the writer.
+*/
+static void writeHop(rwriter* writer, long int number, long int id, char* name, long int distance, long int elapsed)
+{
+	if(writer->format == FORMAT_TEXT) {
+		putLong(writer, number);
+		putText(writer, " - City: ");
+		putText(writer, name);
+		putText(writer, " (");
+		putLong(writer, id);
+		putText(writer, ") | Distance: ");
+		putLong(writer, distance);
+		putText(writer, " hrs\n");
+	}
+	else if(writer->format == FORMAT_JSONL) {
+		putText(writer, number == 1 ? "[" : ",[");
+		putLong(writer, id);
+		putText(writer, ",");
+		putLong(writer, distance);
+		putText(writer, ",");
+		putLong(writer, elapsed);
+		putText(writer, "]");
+	}
+	else {
+		putRecord(writer, id);
+		putRecord(writer, elapsed);
+	}
+}
+	
+/*
+ Finishes the current route with its total distance.
+*/
+static void endRoute(rwriter* writer, long int total)
+{
+	if(writer->format == FORMAT_TEXT) {
+		putText(writer, "Total Distance: ");
+		putLong(writer, total);
+		putText(writer, " hrs\n\n");
+	}
+	else if(writer->format == FORMAT_JSONL) {
+		putText(writer, "],\"total\":");
+		putLong(writer, total);
+		putText(writer, "}\n");
+	}
+	else {
+		putRecord(writer, -1);
+		putRecord(writer, total);
+	}
+}
+
+/*
+ Writes every hop of a path and its total, finishing the route begun with beginRoute.
+ Hops whose travel table was never linked are named from the search graph's ID table.
+*/
+void writePath(rwriter* writer, sgraph* graph, cpath* path)
+{
+	long int index;
+	char* name;
+	long int y;
+	
+	for(y = 0; y < path->length; y++) {
+		if(path->path[y]->citypntr != NULL) name = path->path[y]->citypntr->name;
+		else if((index = searchIndexOf(graph, path->path[y]->cityid)) != -1) name = graph->cities[index]->name;
+		else name = "unknown";
+		writeHop(writer, y + 1, path->path[y]->cityid, name, path->path[y]->distance, path->prefix[y]);
+	}
+	endRoute(writer, getTotalDistance(path, 0));
+}
+
+/*
+ Writes the route the current query of a context found to a city, straight from its predecessor
+ and distance arrays, finishing the route begun with beginRoute. As with buildSearchPath, a
+ forward route runs from the source to the city and a backward one from the city to the source.
+*/
+void writeSearchPath(rwriter* writer, sgraph* graph, qctx* ctx, long int city, int direction)
+{
+	long int length = 0;
+	long int source;
+	long int cur;
+	long int prev = -1;
+	long int x;
+	
+	for(cur = city; cur != -1; cur = ctx->pred[cur]) {
+		if(length == writer->chainCapacity) {
+			writer->chainCapacity *= 2;
+			writer->chain = (long int*)memRealloc(writer->chain, sizeof(long int) * writer->chainCapacity);
+		}
+		writer->chain[length++] = cur;
+	}
+	source = writer->chain[length - 1];
+	
+	// The chain runs from the city back to the source; forward routes travel it the other way.
+	for(x = 0; x < length; x++) {
+		cur = writer->chain[direction == SEARCH_FORWARD ? length - 1 - x : x];
+		writeHop(writer, x + 1, graph->cities[cur]->id, graph->cities[cur]->name,
+				 prev == -1 ? 0 : (direction == SEARCH_FORWARD ? ctx->dist[cur] - ctx->dist[prev] : ctx->dist[prev] - ctx->dist[cur]),
+				 direction == SEARCH_FORWARD ? ctx->dist[cur] - ctx->dist[source] : ctx->dist[city] - ctx->dist[cur]);
+		prev = cur;
+	}
+	endRoute(writer, ctx->dist[city] - ctx->dist[source]);
+}
@@ -0,0 +1,64 @@
+#include <stdio.h>
+#include "reliefdb.h"
+#include "search.h"
+
+#ifndef writer_h
+#define writer_h
+
+#define FORMAT_TEXT 0		// The human readable text the REPL has always printed.
+#define FORMAT_JSONL 1		// One JSON object per line for each route or message.
+#define FORMAT_BINARY 2		// Compact fixed-width records, routes only.
+
+#define WRITER_BUFFER (1L << 20)	// Bytes gathered before the writer hands them to its stream.
+
+/*
+ A result writer formats the routes a query finds into one large buffer and
+ writes it to its stream in big blocks, instead of a printf per hop.
+ Integers are formatted by hand, and routes can be written straight from a
+ search's predecessor array without building a path first.
+ 
+ A route is started with beginRoute and finished by writePath or
+ writeSearchPath. In text the heading passed to beginRoute comes first, then
+ one line per hop and the total, exactly as printed before. In JSON Lines a
+ route is one object:
+ 
+   {"resources":"B","from":12,"to":40,"hops":[[12,0,0],[7,9,9],[40,5,14]],"total":14}
+ 
+ with each hop as [city ID, hours for the hop, hours elapsed], and resources
+ null when the route is not for a resource. In binary a route is the byte 'R',
+ a byte with a bit per resource carried (bit r for RESOURCE_LETTERS[r]), the
+ from and to IDs as 8 byte integers,
+ then each hop as its city ID and hours elapsed, 8 bytes each, and finally an
+ ID of -1 with the total. Integers are in the machine's byte order.
+ 
+ Messages (eg a resource that is not available) are text as written, a
+ {"message": ...} object in JSON Lines, and left out of binary.
+ 
+ Anything else printed to the same stream must wait for flushResults, or it
+ will come out ahead of results still in the buffer.
+ 
+ - out is the stream written to; owned is 1 if the writer opened it.
+ - used is the number of bytes waiting in buffer.
+ - chain holds the cities of a route read back from a predecessor array.
+*/
+typedef struct resultwriter {
+	FILE* out;
+	int owned;
+	int format;
+	char* buffer;
+	long int used;
+	long int* chain;
+	long int chainCapacity;
+} rwriter;
+
+rwriter* newResultWriter(FILE* out, int format);
+rwriter* openResultWriter(char* filename, int format);
+void flushResults(rwriter* writer);
+void purgeResultWriter(rwriter* writer);
+
+void writeMessage(rwriter* writer, const char* format, ...);
+void beginRoute(rwriter* writer, char* resources, cn* from, cn* to, const char* heading, ...);
+void writePath(rwriter* writer, sgraph* graph, cpath* path);
+void writeSearchPath(rwriter* writer, sgraph* graph, qctx* ctx, long int city, int direction);
+
+#endif